@@ -33,9 +33,11 @@ int main(int argc, char * argv[])
     std::ofstream logfile(filename);
     auto oldbuf = std::cout.rdbuf( logfile.rdbuf());
 
-    // If in interactive or debug mode, don't log to a file
+    // If in interactive, debug, dry run or XML export mode, don't log to a
+    // file
     for (int i=0; i< argc; ++i) {
-        if ((strcmp(argv[i],"-i") == 0) || (strcmp(argv[i],"-d") == 0)) {
+        if ((strcmp(argv[i],"-i") == 0) || (strcmp(argv[i],"-d") == 0) ||
+            (strcmp(argv[i],"-P") == 0) || (strcmp(argv[i],"-X") == 0)) {
             // go back to writing to stdout
             std::cout << "Start logging" << std::endl;
             std::cout.rdbuf(oldbuf);
@@ -43,6 +45,27 @@ int main(int argc, char * argv[])
         }
     }
 
+    // Dry run the schedule without opening the iPM device
+    if (args.DryRun())
+    {
+        ipm.plan();
+        return 0;
+    }
+
+    // Write nidas sample definitions without opening the iPM device
+    if (args.XmlFile() != NULL)
+    {
+        ipm.printXml(args.XmlFile());
+        return 0;
+    }
+
+    // With -U, an interactive session is a client of the ipm_ctrl that
+    // owns the serial port
+    if (args.Interactive() and args.SocketPath() != NULL)
+    {
+        return ipm.remote();
+    }
+
     int fd = ipm.open_port();
 
     ipm.open_udp(acserver);
@@ -74,9 +97,18 @@ int main(int argc, char * argv[])
         }
 
         // Cycle on requested commands
+        ipm.setSchedule();
+        ipm.setFields();
+        ipm.setDeadband();
+        ipm.setAggregate();
+        ipm.setCapture();
+        ipm.setPolicy();
+        ipm.setShm();
+        ipm.setServer();
+        ipm.setTrace();
+        ipm.setRealtime();
         while (true)
         {
-            ipm.setRecordFreq();
             status = ipm.loop(fd);
             ipm.sleep();
         }
@@ -85,7 +117,7 @@ int main(int argc, char * argv[])
     std::cout << "Exiting ipm_ctrl" << std::endl;
 
     // Close socket descriptor
-    ipm.close_udp(-1);
+    ipm.close_udp();
 
     ipm.close_port(fd);
 
@@ -0,0 +1,142 @@
+/*************************************************************************
+ * Benchmark of the serial I/O backends (ipm_ctrl -I). A child process on
+ * the far side of a pty answers every command like an iPM answering
+ * MEASURE?, with the length line and 34 bytes of data, and each backend
+ * reads count responses. Prints the system calls, CPU time and elapsed
+ * time per sample for each backend.
+ *
+ *  2024, Copyright University Corporation for Atmospheric Research
+ *************************************************************************
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+#include "src/io.h"
+
+static const int RESPONSELEN = 3 + 34;  // "34\n" and the MEASURE data
+
+// The iPM: answer every line read
+static void emulate(int fd)
+{
+    char response[RESPONSELEN];
+    memcpy(response, "34\n", 3);
+    memset(response + 3, 0x55, RESPONSELEN - 3);
+    char buf[256];
+    int n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        if (memchr(buf, '\n', n) != NULL)
+        {
+            write(fd, response, RESPONSELEN);
+        }
+    }
+    exit(0);
+}
+
+static double cpu()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec * 1e6 + ru.ru_utime.tv_usec +
+        ru.ru_stime.tv_sec * 1e6 + ru.ru_stime.tv_usec;
+}
+
+int main(int argc, char * argv[])
+{
+    int count = (argc > 1) ? atoi(argv[1]) : 10000;
+    if (argc > 2 or count <= 0)
+    {
+        std::cout << "Usage: ipm_iobench [count]\n"
+            "\tCompare the serial I/O backends over count MEASURE?\n"
+            "\tresponses from an emulated iPM on a pty (Default:10000)"
+            << std::endl;
+        return 1;
+    }
+
+    int port = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (port < 0 or grantpt(port) < 0 or unlockpt(port) < 0)
+    {
+        std::cout << "Unable to open a pty" << std::endl;
+        return 1;
+    }
+    int dev = open(ptsname(port), O_RDWR | O_NOCTTY);
+    struct termios t;
+    tcgetattr(dev, &t);
+    cfmakeraw(&t);
+    tcsetattr(dev, TCSANOW, &t);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        close(port);
+        emulate(dev);
+    }
+    close(dev);
+
+    std::cout << "backend  syscalls/sample  cpu us/sample  elapsed us/sample"
+        << std::endl;
+    const char *names[] = {"epoll", "uring"};
+    for (const char *name : names)
+    {
+        ipmIo *io = ipmIo::create(name);
+        if (strcmp(io->name(), name) != 0)
+        {
+            std::cout << std::setw(7) << std::left << name <<
+                "  not available" << std::endl;
+            delete io;
+            continue;
+        }
+
+        char in[256];
+        double cpu0 = cpu();
+        auto start = std::chrono::steady_clock::now();
+        int failed = 0;
+        for (int j = 0; j < count; j++)
+        {
+            // Like naiipm::get_response(): the command goes with the first
+            // read, then read until the whole response is in
+            int got = 0;
+            const char *out = "MEASURE?\n";
+            int outlen = 9;
+            while (got < RESPONSELEN)
+            {
+                int n = io->transfer(port, out, outlen, in, sizeof(in),
+                    100000);
+                outlen = 0;
+                if (n <= 0)
+                {
+                    failed++;
+                    break;
+                }
+                got += n;
+            }
+        }
+        double elapsed = std::chrono::duration<double, std::micro>(
+            std::chrono::steady_clock::now() - start).count();
+
+        std::cout << std::setw(7) << std::left << name << std::right <<
+            std::fixed << std::setprecision(2) << std::setw(17) <<
+            (double)io->syscalls() / count << std::setw(15) <<
+            (cpu() - cpu0) / count << std::setw(19) << elapsed / count;
+        if (failed > 0)
+        {
+            std::cout << "  (" << failed << " timed out)";
+        }
+        std::cout << std::endl;
+        delete io;
+    }
+
+    close(port);
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+    return 0;
+}
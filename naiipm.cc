@@ -8,7 +8,9 @@
 #include <cstring>
 #include <bitset>
 #include <cstdio>
+#include <cmath>
 #include <regex>
+#include <fstream>
 #ifdef __linux__
     #include <sys/io.h>
 #endif
@@ -19,6 +21,18 @@
 #include "src/status.h"
 #include "src/record.h"
 #include "src/bitresult.h"
+#include "src/planner.h"
+#include "src/baud.h"
+#include "src/fields.h"
+#include "src/packet.h"
+#include "src/deadband.h"
+#include "src/aggregate.h"
+#include "src/capture.h"
+#include "src/policy.h"
+#include "src/shm.h"
+#include "src/server.h"
+#include "src/client.h"
+#include <sstream>
 
 ipmArgparse args;
 
@@ -35,13 +49,63 @@ naiipm::naiipm()
     _ipm_data["STATUS?"] = _statusdata;   // Device Status
     _ipm_data["RECORD?"] = _recorddata;   // Device Statistics
 
-    _recordCount = 0;
     _badData = 0;
 
+    for (int i = 0; i < 8; i++)
+    {
+        for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+        {
+            _frame[i][q][0] = '\0';
+            _fieldMask[i][q] = ipmFields::all(q);
+        }
+        _fresh[i] = 0;
+        _seq[i] = 0;
+        _policyPeriod[i] = 0;
+        _policyPhase[i] = 0;
+        for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+        {
+            _latestTime[i][q] = 0;
+        }
+    }
+    _cycleTime = {0, 0};
+    _dataTime = {0, 0};
+    _captureDir = "/var/log/ads";
+    for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+    {
+        _linkTime[q] = {0, 0, 0, 0};
+    }
+    _io = NULL;
+    _rxlen = _rxpos = 0;
+    _lastInterval = 0;
+    _addr = 0;
+
 }
 
 naiipm::~naiipm()
 {
+    delete _io;
+}
+
+// Serial I/O backend, chosen by -I the first time it's needed
+ipmIo& naiipm::io()
+{
+    if (_io != NULL and _io->broken())
+    {
+        std::cout << _io->name() << " serial I/O failed, using epoll" <<
+            std::endl;
+        delete _io;
+        _io = ipmIo::create("epoll");
+    }
+    if (_io == NULL)
+    {
+        _io = ipmIo::create(args.IoBackend());
+        if (args.Verbose() or strcmp(args.IoBackend(), _io->name()) != 0)
+        {
+            std::cout << "Using " << _io->name() << " serial I/O" <<
+                std::endl;
+        }
+    }
+    return *_io;
 }
 
 // When installed on the GV (as opposed to in the lab), on power up
@@ -52,102 +116,172 @@ naiipm::~naiipm()
 // times.
 bool naiipm::clear(int fd, int addr)
 {
-    bool status = true;
-    std::string msg;
-
     if (args.Interactive())
     {
       // Set silent so don't print VER output when clearing.
         args.setSilent(true);
     }
 
-    for (int j=0; j < 10; j++)
+    std::vector<ipmSequence> seq(1, ipmSequence(addr));
+    addClear(seq[0], 1);
+    run(fd, seq);
+
+    if (args.Interactive())
     {
-        // ADR should return nothing so can send it to gather junk on line
-        status = setActiveAddress(fd, addr);
+        // Turn output back on
+        args.setSilent(false);
+    }
 
-        // Query Firmware Version
-        msg = "VER?";
-        if((status = send_command(fd, msg))) {  // success so stop iterating
-            std::cout << "Took " << j << " ADR commands to clear iPM on" <<
-                " init" << std::endl;
-            break;
+    return seq[0].result() == 0;
+}
+
+// Add the steps that clear garbage off the line: select the address and ask
+// for the firmware version until the iPM answers, every half second up to
+// 10 times. The sequence ends with result fail if it never does, unless fail
+// is 0, when it says so and goes on.
+void naiipm::addClear(ipmSequence &seq, int fail)
+{
+    seq.retry("VER?", 10, 500000, fail, [fail](bool ok, int tries) {
+        if (ok)
+        {
+            std::cout << "Took " << tries - 1 << " ADR commands to clear " <<
+                "iPM on init" << std::endl;
+        }
+        else if (fail == 0)
+        {
+            // init carries on with the address regardless
+            std::cout << "Unable to clear device" << std::endl;
         }
+    });
+}
 
-        // Wait half a second and try again
-        usleep(500000);  // 0.5 seconds
+// Run sequences until they are all done. A sequence keeps the port until
+// it has to wait, then the next one that's ready gets it, so one address's
+// delays don't hold up the others. Only sleeps when every sequence is
+// waiting.
+void naiipm::run(int fd, std::vector<ipmSequence> &seqs)
+{
+    for (auto &seq : seqs)
+    {
+        seq.start(ipmSequence::now());
     }
 
-    if (args.Interactive())
+    int active = -1;  // address selected, or -1 if not known
+    int n = seqs.size();
+    int last = 0;     // sequence that last had the port
+    while (true)
     {
-        // Turn output back on
-        args.setSilent(false);
-    }
+        ipmSequence *next = NULL;
+        long wake = -1;   // earliest a waiting sequence is ready
+        long now = ipmSequence::now();
+        for (int j = 0; j < n; j++)
+        {
+            ipmSequence &seq = seqs[(last + j) % n];
+            if (seq.done())
+            {
+                continue;
+            }
+            if (seq.wake() <= now)
+            {
+                next = &seq;
+                last = (last + j) % n;
+                break;
+            }
+            if (wake < 0 or seq.wake() < wake)
+            {
+                wake = seq.wake();
+            }
+        }
+        if (next == NULL)
+        {
+            if (wake < 0)
+            {
+                return;  // all done
+            }
+            usleep(wake - now);
+            continue;
+        }
 
-    return status;
+        // Select the address if it isn't already, and before every try of
+        // a command that's retried. A retried command is sent whether or
+        // not ADR answered, since ADR there only clears the line.
+        const ipmSequence::step &step = next->current();
+        bool ok = true;
+        if (step.cmd == "ADR" or step.tries > 1 or next->addr() != active)
+        {
+            ok = setActiveAddress(fd, next->addr());
+            active = ok ? next->addr() : -1;
+        }
+        if (step.cmd != "ADR" and (ok or step.tries > 1))
+        {
+            ok = send_command(fd, step.cmd);
+        }
+        next->resume(ok, ipmSequence::now());
+    }
 }
 
 //Initialize the iPM device. Returns a verified list of device addresses
 // that may be shorter than the list passed in if some addresses did not
-// pass verification.
+// pass verification. The addresses are initialized together, each sending
+// while the others wait.
 bool naiipm::init(int fd)
 {
+    // How an address's initialization can end
+    enum { SKIPPED = 1, REMOVED, FAILED };
 
     flush(fd);
 
     // Verify device existence at all addresses
     std::cout << "This ipm should have " << args.numAddr() << " active address(es)"
         << std::endl;
+    std::vector<ipmSequence> seqs;
     for (int i=0; i < args.numAddr(); i++)
     {
-        std::string msg;
         std::cout << "Info for address " << i << " is " << args.Addr(i) << ","
             << args.Procqueries(i) << "," << args.Addrport(i)
             << std::endl;
 
-        bool status;
-        status = setActiveAddress(fd, args.Addr(i));
-        if(not status)
-        {
-            std::cout << "Unable to set active address to " << args.Addr(i) <<
-                ". Skipping address " << args.Addr(i) << "for this iteration" <<
-                std::endl;
-            continue;
-        }
+        int addr = args.Addr(i);
+        seqs.push_back(ipmSequence(addr));
+        ipmSequence &seq = seqs.back();
+        seq.select(SKIPPED, [addr](bool ok, int) {
+            if (not ok)
+            {
+                std::cout << "Unable to set active address to " << addr <<
+                    ". Skipping address " << addr << "for this iteration" <<
+                    std::endl;
+            }
+        });
+        addClear(seq, 0);
+
+        // Turn Device OFF, wait > 100ms then turn ON to reset state. If
+        // OFF fails, the address is removed from the active address list.
+        seq.send("OFF", REMOVED).delay(110000).send("RESET", FAILED);
+
+        // Query Serial Number and Firmware Version, and execute built-in
+        // self test
+        seq.send("SERNO?", FAILED).send("VER?", FAILED).send("TEST", FAILED);
+        seq.send("BITRESULT?", FAILED, [this, i](bool ok, int) {
+            if (ok)
+            {
+                parseData("BITRESULT?", i);
+            }
+        });
+    }
+    run(fd, seqs);
+    flush_udp();
 
-        status = clear(fd, args.Addr(i));
-        if (not status) {
-            std::cout << "Unable to clear device" << std::endl;
+    // Remove failed addresses last first, so indices stay valid
+    for (int i = seqs.size() - 1; i >= 0; i--)
+    {
+        if (seqs[i].result() == FAILED)
+        {
+            return false;
         }
-
-        // Turn Device OFF, wait > 100ms then turn ON to reset state
-        msg = "OFF";
-        if(not send_command(fd, msg)) {
-            // OFF query failed, so remove address from active address list
+        if (seqs[i].result() == REMOVED)
+        {
             rmAddr(i);
-            i--; // back up to where next addrinfo is now stored
-            continue;
         }
-
-        unsigned int microseconds = 110000;
-        usleep(microseconds);  // Wait > 100ms
-
-        msg = "RESET";
-        if(not send_command(fd, msg)) { return false; }
-
-        // Query Serial Number
-        msg = "SERNO?";
-        if(not send_command(fd, msg)) { return false; }
-        // Query Firmware Version
-        msg = "VER?";
-        if(not send_command(fd, msg)) { return false; }
-
-        // Execute build-in self test
-        msg = "TEST";
-        if(not send_command(fd, msg)) { return false; }
-        msg = "BITRESULT?";
-        if(not send_command(fd, msg)) { return false; }
-        parseData(msg, i);
     }
 
     if (args.numAddr() == 0)
@@ -174,6 +308,8 @@ void naiipm::rmAddr(int i)
         args.updateAddr(j, args.Addr(j+1));
         args.updateProcqueries(j, args.Procqueries(j+1));
         args.updateAddrPort(j, args.Addrport(j+1));
+        args.updateAddrRates(j, args.addrMeasureRate(j+1),
+            args.addrStatusRate(j+1), args.addrRecordPeriod(j+1));
     }
     args.updateNumAddr(args.numAddr() - 1);
 }
@@ -216,9 +352,17 @@ int naiipm::open_port()
         port_settings.c_cflag |= CREAD;  // turn on 8
         port_settings.c_cflag |= HUPCL;  // turn on 11
         port_settings.c_cflag |= CLOCAL; // turn on 12
-        if (cfsetspeed(&port_settings, get_baud()) == -1)
+        // Rates without a termios constant, and auto-detect, start at the
+        // default rate and are set once the port is configured.
+        uint_fast32_t speed = get_baud();
+        if (speed == 0)
+        {
+            speed = B57600;
+        }
+        if (cfsetspeed(&port_settings, speed) == -1)
         {
-            std::cout << "Failed to set baud rate to " << get_baud() << std::endl;
+            std::cout << "Failed to set baud rate to " << args.BaudRate()
+                << std::endl;
         }
 
         // |= turns on; &= ~ turns off
@@ -236,6 +380,26 @@ int naiipm::open_port()
             std::cout << "Failed to set serial attributes" << std::endl;
         }
 
+        if (strcmp(args.BaudRate(), "auto") == 0)
+        {
+            if (detectBaud(fd) == 0)
+            {
+                std::cout << "Unable to detect iPM baud rate" << std::endl;
+                close_port(fd);
+                exit(1);
+            }
+        }
+        else if (get_baud() == 0)
+        {
+            if (not ipmBaud::setCustom(fd, atoi(args.BaudRate())))
+            {
+                std::cout << "Failed to set baud rate to " << args.BaudRate()
+                    << "; the serial driver does not support it" << std::endl;
+                close_port(fd);
+                exit(1);
+            }
+        }
+
         if (args.Verbose())
         {
             std::cout << "Port for device " << args.Device() << " is open."
@@ -246,20 +410,84 @@ int naiipm::open_port()
     return(fd);
 } //open_port
 
-// Convert baud rate to value required by cfsetspeed command
+// Convert baud rate to value required by cfsetspeed command. Returns 0
+// for auto-detect and for rates that need a custom divisor.
 uint_fast32_t naiipm::get_baud()
 {
-    switch (atoi(args.BaudRate())) {
-        case 115200:
-            return B115200;
-        case 57600:
-            return B57600;
-        default:
-            std::cout << "Unknown baud rate " << args.BaudRate() <<
-                "If rate is valid please update get_baud() function"
-                << std::endl;
-            exit(1);
+    return ipmBaud::speed(atoi(args.BaudRate()));
+}
+
+// Baud rate used to estimate serial link time. Before auto-detect has run,
+// eg on a dry run, assume the default rate.
+int naiipm::linkBaud()
+{
+    int baud = atoi(args.BaudRate());
+    return baud > 0 ? baud : 57600;
+}
+
+// Change the baud rate of an open port
+bool naiipm::setBaud(int fd, int baud)
+{
+    uint_fast32_t speed = ipmBaud::speed(baud);
+    if (speed == 0)
+    {
+        return ipmBaud::setCustom(fd, baud);
+    }
+
+    struct termios port_settings;
+    if (tcgetattr(fd, &port_settings) == -1)
+    {
+        return false;
     }
+    cfsetspeed(&port_settings, speed);
+    return tcsetattr(fd, TCSANOW, &port_settings) != -1;
+}
+
+// Try candidate baud rates, fastest first, and keep the first one at which
+// the iPM answers VER? correctly three times in a row. Returns the rate
+// chosen, or 0 if none worked.
+int naiipm::detectBaud(int fd)
+{
+    int addr = args.Interactive() ? std::max(atoi(args.Address()), 0)
+                                  : args.Addr(0);
+    bool silent = args.Silent();
+    args.setSilent(true);  // Don't print VER output while probing
+
+    int found = 0;
+    for (int k=0; k < ipmBaud::ncandidates and found == 0; k++)
+    {
+        int baud = ipmBaud::candidates[k];
+        if (not setBaud(fd, baud))
+        {
+            continue;  // serial driver can't do this rate
+        }
+        flush(fd);
+        _badData = 0;  // failed probes aren't data errors
+
+        int ok = 0;
+        setActiveAddress(fd, addr);
+        while (ok < 3 and send_command(fd, "VER?"))
+        {
+            ok++;
+        }
+        std::cout << "Baud rate " << baud << (ok == 3 ? " is stable" :
+            " did not get a stable response") << std::endl;
+        if (ok == 3)
+        {
+            found = baud;
+        }
+    }
+
+    _badData = 0;
+    args.setSilent(silent);
+
+    if (found != 0)
+    {
+        _detectedBaud = std::to_string(found);
+        args.setBaud(_detectedBaud.c_str());
+        std::cout << "Auto-detected baud rate " << found << std::endl;
+    }
+    return found;
 }
 
 void naiipm::close_port(int fd)
@@ -267,151 +495,1203 @@ void naiipm::close_port(int fd)
     close(fd);
 }
 
-// Create UDP sockets to send packets to nidas
-// Each address needs it's own socket so it can send over it's own port.
+// Create the UDP socket to send packets to nidas. Each address sends to its
+// own port.
 void naiipm::open_udp(const char *ip)
 {
+    int ports[8];
     for (int i=0; i<args.numAddr(); i++)
     {
-        //  AF_INET for IPv4/ AF_INET6 for IPv6
-        //  SOCK_STREAM for TCP / SOCK_DGRAM for UDP
-        _sock[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        ports[i] = args.Addrport(i);
+    }
+    if (not _udp.open(ip, ports, args.numAddr()))
+    {
+        std::cout << "Socket creation failed" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    int port = args.capturePort();
+    if (port > 0 and not _captureUdp.open(ip, &port, 1))
+    {
+        std::cout << "Capture socket creation failed" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Queue a UDP message to nidas. Queued messages are sent by flush_udp() at
+// the end of each cycle.
+void naiipm::send_udp(const char *buf, int len, int i)
+{
+    std::cout << "sending to port " << args.Addrport(i) << " UDP string "
+        << buf;  // string already ends in /r/n so don't add std::endl here.
+    _udp.enqueue(buf, len, i);
+}
+
+// Send queued UDP messages without blocking. Network errors are counted
+// and logged by the queue; they never stop data acquisition.
+void naiipm::flush_udp()
+{
+    if (_udp.depth() > 0)
+    {
+        int64_t start = ipmStamp::monotonic();
+        _udp.flush();
+        int64_t end = ipmStamp::monotonic();
+        _metrics.sent(end - start);
+        _trace.add("send", "udp", CYCLETRACK, start, end);
+    }
+    if (args.Verbose())
+    {
+        std::cout << "UDP packets sent " << _udp.sent() << ", dropped " <<
+            _udp.dropped() << ", errors " << _udp.errors() << ", queued " <<
+            _udp.depth() << std::endl;
+        if (args.Deadband() != NULL)
+        {
+            std::cout << "Deadband frames published " <<
+                _deadband.published() << ", suppressed " <<
+                _deadband.suppressed() << std::endl;
+        }
+    }
+}
+
+// Combined mode: queue one packet for each address that read anything this
+// cycle. The packet is
+//     CYCLE,<time>,<mask>,MEASURE,...,STATUS,...,RECORD,...
+// where time is the unix time of the cycle start and mask uses the
+// procqueries bits [RECORD,MEASURE,STATUS] to flag the frames read this
+// cycle. Every requested frame is always included so nidas
+// sees a fixed layout; frames not read this cycle repeat their last values.
+// The packet ends before the first frame that hasn't been read yet, and nidas
+// marks the variables that follow as missing.
+void naiipm::send_cycle()
+{
+    // procqueries bit of MEASURE, STATUS, RECORD
+    const int bit[ipmSchedule::NQUERIES] = {2, 1, 4};
+    char packet[ipmUdp::PKTLEN];
+
+    for (int i=0; i < args.numAddr(); i++)
+    {
+        if (_fresh[i] == 0)
+        {
+            continue;
+        }
+        int mask = 0;
+        for (int q=0; q < ipmSchedule::NQUERIES; q++)
+        {
+            if (_fresh[i] & (1 << q))
+            {
+                mask |= bit[q];
+            }
+        }
+
+        int len = snprintf(packet, sizeof(packet), "CYCLE,%ld.%06ld,%x",
+            (long)_cycleTime.tv_sec, _cycleTime.tv_nsec / 1000, mask);
+        for (int q=0; q < ipmSchedule::NQUERIES; q++)
+        {
+            if (_schedule.period(i, q) == 0)
+            {
+                continue;  // query not requested
+            }
+            if (_frame[i][q][0] == '\0')
+            {
+                break;  // not read yet
+            }
+            len += snprintf(packet + len, sizeof(packet) - len, ",%s",
+                _frame[i][q]);
+        }
+        len += snprintf(packet + len, sizeof(packet) - len, "\r\n");
+
+        send_udp(packet, std::min(len, ipmUdp::PKTLEN - 1), i);
+        _fresh[i] = 0;
+    }
+}
+
+// Binary mode: queue the raw response to cmd from an address as a binary
+// packet. See src/packet.h for the format.
+void naiipm::send_binary(std::string cmd, int adr)
+{
+    char packet[ipmUdp::PKTLEN];
+    ipmPacket::header h;
+    h.version = ipmPacket::VERSION;
+    h.type = ipmPacket::type(cmd.c_str());
+    h.addr = args.Addr(adr);
+    h.flags = 0;
+    h.length = std::stoi(commands.response(cmd)->second);
+    h.seq = _seq[adr]++;
+    h.time = (uint64_t)_dataTime.tv_sec * 1000000 + _dataTime.tv_nsec / 1000;
+
+    int len = ipmPacket::encode(packet, sizeof(packet), h, getData(cmd));
+    std::cout << "sending to port " << args.Addrport(adr) << " binary " <<
+        cmd << " seq " << h.seq << ", " << len << " bytes" << std::endl;
+    _udp.enqueue(packet, len, adr);
+}
+
+// Close UDP port
+void naiipm::close_udp()
+{
+    // All addresses share one socket, so send what is left and close it
+    flush_udp();
+    _udp.close();
+    _captureUdp.close();
+}
+
+// Set active address
+bool naiipm::setActiveAddress(int fd, int addr)
+{
+    std::string msg = "ADR";
+    std::string msgarg = std::to_string(addr);
+
+    if(not send_command(fd, msg, msgarg)) { return false; }
+
+    return true;
+}
+
+// Set the recordPeriod per measureRate so can call RECORD only every
+// recordFreq times that MEASURE / STATUS are called.
+// measureRate is in hz; recordPeriod in minutes
+// So if measureRate is 1 and recordPeriod is 10 min, only send RECORD command
+// after send 600 MEASURE/STATUS commands.
+void naiipm::setRecordFreq()
+{
+    _recordFreq = (int)(atoi(args.recordPeriod())*60.0) * atoi(args.measureRate());
+}
+
+// Build the query schedule from the active address list. measureRate is the
+// base cycle rate. Each address/query pair gets its own rate from the address
+// info block, defaulting to measureRate for MEASURE and STATUS and
+// recordPeriod for RECORD. Queries not requested in procqueries are disabled.
+void naiipm::setSchedule()
+{
+    float cycleRate = atof(args.measureRate());
+    setRecordFreq();
+    _schedule.configure(cycleRate, args.numAddr());
+
+    for (int i=0; i < args.numAddr(); i++)
+    {
+        // ‘procqueries’ is an integer representation of 3-bit Boolean
+        // field indicating whether query responses [RECORD,MEASURE,STATUS]
+        // should be processed and variables included in a processed data
+        // file.
+        //     d’3 (b’011) indicates that MEASURE+STATUS are processed.
+        //     d’5 (b’101) indicates that RECORD+STATUS are processed.
+        std::bitset<3> x(args.Procqueries(i));
+        float rate[ipmSchedule::NQUERIES];
+        rate[ipmSchedule::MEASURE] = args.addrMeasureRate(i);
+        rate[ipmSchedule::STATUS] = args.addrStatusRate(i);
+        rate[ipmSchedule::RECORD] = 0;
+        if (args.addrRecordPeriod(i) > 0)
+        {
+            rate[ipmSchedule::RECORD] = 1.0 / (args.addrRecordPeriod(i) * 60);
+        }
+
+        for (int q=0; q < ipmSchedule::NQUERIES; q++)
+        {
+            if (rate[q] > cycleRate)
+            {
+                std::cout << "Requested " << ipmSchedule::command(q) <<
+                    " rate " << rate[q] << " hz for address " << args.Addr(i)
+                    << " exceeds measurerate; using " << cycleRate << " hz"
+                    << std::endl;
+                rate[q] = cycleRate;
+            }
+        }
+
+        if (x[1])  // MEASURE command requested
+        {
+            if (rate[ipmSchedule::MEASURE] > 0)
+                _schedule.setRate(i, ipmSchedule::MEASURE,
+                    rate[ipmSchedule::MEASURE]);
+            else
+                _schedule.setPeriod(i, ipmSchedule::MEASURE, 1);
+        }
+        if (x[0])  // STATUS command requested
+        {
+            if (rate[ipmSchedule::STATUS] > 0)
+                _schedule.setRate(i, ipmSchedule::STATUS,
+                    rate[ipmSchedule::STATUS]);
+            else
+                _schedule.setPeriod(i, ipmSchedule::STATUS, 1);
+        }
+        if (x[2])  // RECORD command requested
+        {
+            if (rate[ipmSchedule::RECORD] > 0)
+                _schedule.setRate(i, ipmSchedule::RECORD,
+                    rate[ipmSchedule::RECORD]);
+            else
+                _schedule.setPeriod(i, ipmSchedule::RECORD,
+                    _recordFreq > 0 ? _recordFreq : 1);
+        }
+
+        if (args.Verbose())
+        {
+            std::cout << "Address " << args.Addr(i) << " query periods "
+                "(cycles) MEASURE:" << _schedule.period(i, ipmSchedule::MEASURE)
+                << " STATUS:" << _schedule.period(i, ipmSchedule::STATUS)
+                << " RECORD:" << _schedule.period(i, ipmSchedule::RECORD)
+                << std::endl;
+        }
+    }
+
+    // Estimate serial link time of each query from its command and response
+    // frame sizes and the iPM latency. ADR returns nothing, so it always
+    // waits out the response timeout.
+    int baud = linkBaud();
+    for (int q=0; q < ipmSchedule::NQUERIES; q++)
+    {
+        std::string msg = ipmSchedule::command(q);
+        std::string expected = commands.response(msg)->second;
+        int bytes = msg.length() + 1 + expected.length() + std::stoi(expected);
+        _schedule.setCost(q, ipmSchedule::transferTime(bytes, baud) +
+            (long)(args.latency(q) * 1000));
+    }
+    _schedule.setSelectCost(ipmSchedule::transferTime(6, baud) +
+        responseTimeout());
+
+    // Spread RECORD and other slow queries across cycles and addresses
+    _schedule.stagger();
+    _schedule.report();
+}
+
+
+// Field projection: send only the fields each address's nidas sensor reads.
+// The sensor is found in the -F XML file by the address's UDP port, and the
+// fields it skips with %*x are dropped from the packets.
+void naiipm::setFields()
+{
+    if (args.FieldsFile() == NULL)
+    {
+        return;
+    }
+    for (int i=0; i < args.numAddr(); i++)
+    {
+        int found = ipmFields::readXml(args.FieldsFile(), args.Addrport(i),
+            _fieldMask[i]);
+        if (found < 0)
+        {
+            std::cout << "Unable to read " << args.FieldsFile() << std::endl;
+            exit(1);
+        }
+        std::cout << "Address " << args.Addr(i) << " port " <<
+            args.Addrport(i) << " fields sent:";
+        for (int q=0; q < ipmSchedule::NQUERIES; q++)
+        {
+            int n = 0;
+            for (int k=0; k < ipmFields::count(q); k++)
+            {
+                n += (_fieldMask[i][q] >> k) & 1;
+            }
+            std::cout << " " << ipmFields::prefix(q) << " " << n << "/" <<
+                ipmFields::count(q) << (found & (1 << q) ? "" : " (no sample)");
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Change-driven publishing: set field deadbands and the heartbeat from the
+// command line
+void naiipm::setDeadband()
+{
+    if (args.Deadband() == NULL)
+    {
+        return;
+    }
+    std::string error;
+    if (not _deadband.configure(args.Deadband(), error))
+    {
+        std::cout << "Invalid deadband " << error << ". Expected NAME=value "
+            "where NAME is a field name or *" << std::endl;
+        exit(1);
+    }
+    _deadband.setHeartbeat(args.heartbeat());
+    std::cout << "Publishing on change: deadbands " << args.Deadband() <<
+        ", heartbeat " << args.heartbeat() << " s" << std::endl;
+}
+
+// Windowed aggregation: publish MEASURE statistics once per window rather
+// than every response
+void naiipm::setAggregate()
+{
+    if (args.window() <= 0)
+    {
+        return;
+    }
+    _aggregate.configure(args.window());
+    std::cout << "Aggregating MEASURE over " << args.window() <<
+        " s windows" << std::endl;
+}
+
+// Burst capture: size the pre- and post-trigger windows
+void naiipm::setCapture()
+{
+    if (args.capturePort() <= 0)
+    {
+        return;
+    }
+    _capture.configure(args.capturePre(), args.capturePost());
+    std::cout << "Capturing " << args.capturePre() << " s before and " <<
+        args.capturePost() << " s after trip, caution and RECORD events to "
+        "port " << args.capturePort() << " and " << _captureDir << std::endl;
+
+    // MEASURE and STATUS kept per second on the schedule, and the most a
+    // capture adds by polling its address every cycle
+    double cycleRate = _schedule.cycleRate();
+    double rate = 0, burst = 0;
+    for (int i=0; i < args.numAddr(); i++)
+    {
+        double extra = 0;
+        for (int q = ipmSchedule::MEASURE; q <= ipmSchedule::STATUS; q++)
+        {
+            int period = _schedule.period(i, q);
+            rate += period > 0 ? cycleRate / period : 0;
+            extra += period > 0 ? cycleRate - cycleRate / period : cycleRate;
+        }
+        burst = std::max(burst, extra);
+    }
+    float reach = _capture.reach(rate, burst);
+    if (reach < args.capturePre())
+    {
+        std::cout << "Warning: the capture ring of " << ipmCapture::RINGLEN <<
+            " responses holds only " << reach << " s before an event at "
+            "these rates; lower the rates or the capture windows" <<
+            std::endl;
+    }
+}
+
+// Burst capture: keep MEASURE and STATUS in the ring and start a capture on
+// a new trip, caution or RECORD event. Returns true for responses polled
+// only because of a burst, which are captured but not published.
+bool naiipm::captureData(int adr, int query, const char *data)
+{
+    double now = _dataTime.tv_sec + _dataTime.tv_nsec / 1e9;
+    const char *reason = _capture.trigger(adr, query, data);
+    if (reason != NULL)
+    {
+        startCapture(adr, now, reason);
+    }
+
+    if (not _capture.active(adr) or query == ipmSchedule::RECORD)
+    {
+        return false;
+    }
+    int period = _basePeriod[adr][query];
+    return period <= 0 or
+        _schedule.cycle() % period != _basePhase[adr][query];
+}
+
+// Poll an address's MEASURE and STATUS every cycle until the capture ends
+void naiipm::startCapture(int adr, double now, const char *reason)
+{
+    char time_buf[100];
+    time_t sec = (time_t)now;
+    strftime(time_buf, 100, "%Y%m%dT%H%M%S", gmtime(&sec));
+    if (not _capture.start(adr, now, reason))
+    {
+        std::cout << time_buf << " Capture already running for address " <<
+            args.Addr(adr) << "; ignoring " << reason << std::endl;
+        return;
+    }
+    std::cout << time_buf << " Capture triggered for address " <<
+        args.Addr(adr) << ": " << reason << std::endl;
+
+    for (int q = ipmSchedule::MEASURE; q <= ipmSchedule::STATUS; q++)
+    {
+        _basePeriod[adr][q] = _schedule.period(adr, q);
+        _basePhase[adr][q] = _schedule.phase(adr, q);
+        if (_basePeriod[adr][q] > 1)
+        {
+            _schedule.setPeriod(adr, q, 1);
+        }
+    }
+}
+
+// Write captures whose post-trigger window has passed and return their
+// addresses to the normal schedule
+void naiipm::endCaptures()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double now = ts.tv_sec + ts.tv_nsec / 1e9;
+
+    for (int i=0; i < args.numAddr(); i++)
+    {
+        if (not _capture.done(i, now))
+        {
+            continue;
+        }
+        char time_buf[100];
+        time_t sec = (time_t)_capture.started(i);
+        strftime(time_buf, 100, "%Y%m%d_%H%M%S", gmtime(&sec));
+        std::string filename = (std::string)_captureDir + "/ipm_capture_" +
+            std::to_string(args.Addr(i)) + "_" + time_buf + ".csv";
+        std::ofstream file(filename);
+
+        int n = _capture.dump(i, args.Addr(i), file, _captureUdp, 0);
+        std::cout << "Capture for address " << args.Addr(i) << ": " << n <<
+            " responses sent to port " << args.capturePort();
+        if (file)
+        {
+            std::cout << " and written to " << filename << std::endl;
+        } else {
+            std::cout << "; unable to write " << filename << std::endl;
+        }
+
+        for (int q = ipmSchedule::MEASURE; q <= ipmSchedule::STATUS; q++)
+        {
+            _schedule.setPeriod(i, q, _basePeriod[i][q]);
+            _schedule.setPhase(i, q, _basePhase[i][q]);
+        }
+    }
+}
+
+// Adaptive MEASURE rate: set the power quality limits from the command line
+void naiipm::setPolicy()
+{
+    if (args.Policy() == NULL)
+    {
+        return;
+    }
+    std::string error;
+    if (not _policy.configure(args.Policy(), error))
+    {
+        std::cout << "Invalid limit " << error << ". Expected NAME=value "
+            "where NAME is rate, thd, vmin, vmax or hold" << std::endl;
+        exit(1);
+    }
+    std::cout << "Adaptive MEASURE rate: limits " << args.Policy() <<
+        std::endl;
+}
+
+// Return true if the average link time of the current schedule fits in the
+// cycle period. Peaks above it are handled by the cycle budget governor.
+bool naiipm::fitsBudget()
+{
+    long average, worst;
+    _schedule.budget(average, worst);
+    return average <= (long)(1000000 / _schedule.cycleRate());
+}
+
+// Adaptive MEASURE rate: raise an address's MEASURE rate when its power
+// goes out of limits, as far as the link budget allows, and restore it once
+// the power has been nominal for the hold time
+void naiipm::adaptRate(int adr, const char *data)
+{
+    double now = std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    int change = _policy.evaluate(adr, data, now);
+    if (change == ipmPolicy::STEADY)
+    {
+        return;
+    }
+
+    const int q = ipmSchedule::MEASURE;
+    int period = _schedule.period(adr, q);
+    float cycleRate = _schedule.cycleRate();
+    char time_buf[100];
+    time_t sec = time({});
+    strftime(time_buf, 100, "%Y%m%dT%H%M%S", gmtime(&sec));
+
+    if (change == ipmPolicy::RELAX)
+    {
+        if (period == _policyPeriod[adr])
+        {
+            return;
+        }
+        _schedule.setPeriod(adr, q, _policyPeriod[adr]);
+        _schedule.setPhase(adr, q, _policyPhase[adr]);
+        std::cout << time_buf << " Address " << args.Addr(adr) <<
+            " MEASURE rate " << cycleRate / period << " -> " <<
+            cycleRate / _policyPeriod[adr] << " hz: " << _policy.reason(adr)
+            << std::endl;
+        return;
+    }
+
+    // Try the degraded rate, then halve it until the schedule fits
+    _policyPeriod[adr] = period;
+    _policyPhase[adr] = _schedule.phase(adr, q);
+    float rate = _policy.rate() > 0 ? _policy.rate() : cycleRate;
+    int target = std::max(1, (int)std::lround(cycleRate / rate));
+    bool atRate = target >= period;  // already as fast as it would go
+    for (; target < period; target *= 2)
+    {
+        _schedule.setPeriod(adr, q, target);
+        if (fitsBudget())
+        {
+            break;
+        }
+    }
+    if (target >= period)
+    {
+        _schedule.setPeriod(adr, q, period);
+        _schedule.setPhase(adr, q, _policyPhase[adr]);
+        std::cout << time_buf << " Address " << args.Addr(adr) <<
+            " MEASURE rate stays " << cycleRate / period << " hz, " <<
+            (period == 1 ? "already at its maximum" : atRate ?
+            "already at the degraded rate" : "no link budget to raise it") <<
+            ": " << _policy.reason(adr) << std::endl;
+        return;
+    }
+    std::cout << time_buf << " Address " << args.Addr(adr) <<
+        " MEASURE rate " << cycleRate / period << " -> " <<
+        cycleRate / target << " hz: " << _policy.reason(adr) << std::endl;
+}
+
+// Shared memory publication: create the segment local readers map
+void naiipm::setShm()
+{
+    if (args.ShmName() == NULL)
+    {
+        return;
+    }
+    int addr[8];
+    for (int i=0; i < args.numAddr(); i++)
+    {
+        addr[i] = args.Addr(i);
+    }
+    if (not _shm.create(args.ShmName(), args.numAddr(), addr))
+    {
+        std::cout << "Unable to create shared memory " << args.ShmName() <<
+            ": " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    std::cout << "Publishing latest responses to shared memory " <<
+        args.ShmName() << std::endl;
+}
+
+// Real-time mode (-R). Whatever isn't permitted is skipped, so this works,
+// less well, without root.
+void naiipm::setRealtime()
+{
+    if (args.Realtime() == NULL)
+    {
+        return;
+    }
+    if (not _realtime.configure(args.Realtime()))
+    {
+        std::cout << "Real-time mode " << args.Realtime() << " is invalid. "
+            "Expected priority[,cpu], priority 1-99" << std::endl;
+        exit(1);
+    }
+    if (_realtime.apply(std::cout) > 0)
+    {
+        std::cout << "Real-time mode is degraded; run as root for all of it"
+            << std::endl;
+    }
+}
+
+// Trace events (-J). Called before setRealtime(), so the flush thread
+// doesn't run at real-time priority.
+void naiipm::setTrace()
+{
+    if (args.TraceFile() == NULL)
+    {
+        return;
+    }
+    if (not _trace.open(args.TraceFile(), args.Device()))
+    {
+        std::cout << "Unable to open " << args.TraceFile() << ": " <<
+            strerror(errno) << std::endl;
+        exit(1);
+    }
+    static const char *tracks[] = {"ADDR 0", "ADDR 1", "ADDR 2", "ADDR 3",
+        "ADDR 4", "ADDR 5", "ADDR 6", "ADDR 7"};
+    for (int i=0; i < args.numAddr(); i++)
+    {
+        _trace.name(args.Addr(i), tracks[args.Addr(i) & 7]);
+    }
+    _trace.name(CYCLETRACK, "cycle");
+    std::cout << "Tracing to " << args.TraceFile() << std::endl;
+}
+
+// Local query API: listen on the Unix socket given on the command line,
+// and for metrics scrapes on the TCP address and port
+void naiipm::setServer()
+{
+    if (args.SocketPath() != NULL)
+    {
+        if (not _server.open(args.SocketPath()))
+        {
+            std::cout << "Unable to listen on " << args.SocketPath() << ": "
+                << strerror(errno) << std::endl;
+            exit(1);
+        }
+        std::cout << "Answering queries on " << args.SocketPath() <<
+            std::endl;
+    }
+    if (args.metricsPort() > 0)
+    {
+        if (not _server.openTcp(args.metricsAddr(), args.metricsPort()))
+        {
+            std::cout << "Unable to listen on " << args.metricsAddr() << ":"
+                << args.metricsPort() << ": " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        std::cout << "Serving metrics on " << args.metricsAddr() << ":" <<
+            args.metricsPort() << std::endl;
+    }
+}
+
+// Answer the requests that have arrived
+void naiipm::serve()
+{
+    std::string line;
+    int client;
+    while ((client = _server.next(line)) >= 0)
+    {
+        request(client, line);
+    }
+}
+
+// Answer one query API request. See src/server.h for the requests.
+void naiipm::request(int client, const std::string &line)
+{
+    std::istringstream in(line);
+    std::ostringstream out;
+    std::string req, frameName, cmd;
+    int addr = -1;
+    in >> req;
+
+    int index = -1;
+    int query = -1;
+    if (req == "LATEST" or req == "HISTORY" or req == "SEND" or
+        req == "CLOCK")
+    {
+        in >> addr;
+        for (int i=0; i < args.numAddr(); i++)
+        {
+            if (args.Addr(i) == addr)
+            {
+                index = i;
+            }
+        }
+        if (in.fail() or index < 0)
+        {
+            _server.reply(client, "ERR unknown address\n");
+            return;
+        }
+    }
+    if (req == "LATEST" or req == "HISTORY")
+    {
+        in >> frameName;
+        for (int q=0; q < ipmSchedule::NQUERIES; q++)
+        {
+            if (frameName == ipmFields::prefix(q))
+            {
+                query = q;
+            }
+        }
+        if (query < 0)
+        {
+            _server.reply(client, "ERR unknown frame\n");
+            return;
+        }
+    }
+
+    if (req == "LATEST")
+    {
+        if (_latestTime[index][query] == 0)
+        {
+            _server.reply(client, "ERR no data\n");
+            return;
+        }
+        char text[256];
+        int len = snprintf(text, sizeof(text), "%.6f,",
+            _latestTime[index][query]);
+        len += ipmFields::format(text + len, sizeof(text) - len, query,
+            _latest[index][query], ipmFields::all(query));
+        len = std::min(len, (int)sizeof(text) - 1);
+        out.write(text, len - 2) << "\n";  // replies end in \n only
+    } else if (req == "HISTORY") {
+        int n = 0;
+        in >> n;
+        if (in.fail() or n <= 0 or query == ipmSchedule::RECORD)
+        {
+            _server.reply(client, "ERR expected HISTORY addr MEASURE|STATUS "
+                "n\n");
+            return;
+        }
+        _capture.history(index, query, n, out);
+    } else if (req == "HEALTH") {
+        out << "CYCLE=" << _schedule.cycle() << "\n" <<
+            "OVERRUNS=" << _schedule.overruns() << "\n" <<
+            "BADDATA=" << _badData << "\n" <<
+            "UDPSENT=" << _udp.sent() << "\n" <<
+            "UDPDROPPED=" << _udp.dropped() << "\n" <<
+            "UDPERRORS=" << _udp.errors() << "\n" <<
+            "CLIENTS=" << _server.clients() << "\n";
+        if (_trace.isOpen())
+        {
+            out << "TRACEDROPPED=" << _trace.dropped() << "\n";
+        }
+        for (int i=0; i < args.numAddr(); i++)
+        {
+            out << "ADDR" << args.Addr(i) << "_DEGRADED=" <<
+                _policy.degraded(i) << "\n" << "ADDR" << args.Addr(i) <<
+                "_CAPTURING=" << _capture.active(i) << "\n";
+        }
+        if (args.Deadband() != NULL)
+        {
+            out << "PUBLISHED=" << _deadband.published() << "\n" <<
+                "SUPPRESSED=" << _deadband.suppressed() << "\n";
+        }
+    } else if (req == "LATENCY") {
+        out.setf(std::ios::fixed);
+        out.precision(1);
+        for (int q=0; q < ipmSchedule::NQUERIES; q++)
+        {
+            const linkTime &lt = _linkTime[q];
+            out << ipmSchedule::command(q) << " n=" << lt.n << " min=" <<
+                lt.min / 1000 << " mean=" <<
+                (lt.n ? lt.sum / lt.n / 1000 : 0) << " max=" <<
+                lt.max / 1000 << " ms\n";
+        }
+        out << "WAKEUP ";
+        _wakeup.summary(out);
+        out << "\nJITTER ";
+        _jitter.summary(out);
+        out << "\n";
+    } else if (req == "JITTER") {
+        out << "WAKEUP\n";
+        _wakeup.print(out);
+        out << "JITTER\n";
+        _jitter.print(out);
+    } else if (req == "CLOCK") {
+        _clock.print(index, out);
+    } else if (req == "METRICS") {
+        _metrics.print(out);
+    } else if (req == "GET") {
+        std::string path;
+        in >> path;
+        if (path != "/metrics")
+        {
+            _server.reply(client, "ERR unknown request\n");
+            return;
+        }
+        expose(out);
+        _server.reply(client, out.str());
+        return;  // no OK, it's for scrapers
+    } else if (req == "SEND") {
+        in >> cmd;
+        if (in.fail() or cmd == "ADR" or not commands.verify(cmd))
+        {
+            _server.reply(client, "ERR unknown command\n");
+            return;
+        }
+        bool queued = enqueue(index, cmd, [this, client, cmd](bool ok) {
+            _server.reply(client, ok ? quote(response(cmd)) + "OK\n" :
+                "ERR command failed\n");
+        });
+        if (not queued)
+        {
+            _server.reply(client, "ERR busy\n");
+        }
+        return;  // replied once sent
+    } else {
+        _server.reply(client, "ERR unknown request\n");
+        return;
+    }
+    out << "OK\n";
+    _server.reply(client, out.str());
+}
+
+// Metrics in the Prometheus text format: the command metrics, and the
+// driver's own counters and queues
+void naiipm::expose(std::ostream &os)
+{
+    _metrics.expose(os, ipmStamp::monotonic());
+    ipmMetrics::family(os, "ipm_bad_data", "gauge",
+        "Bad responses since ipm_ctrl started; it exits at 10 to be "
+        "restarted");
+    os << "ipm_bad_data " << _badData << "\n";
+    ipmMetrics::family(os, "ipm_queue_depth", "gauge",
+        "Commands waiting for the serial port");
+    os << "ipm_queue_depth{priority=\"scheduled\"} " <<
+        _queue.size() - _queue.adhoc() << "\n" <<
+        "ipm_queue_depth{priority=\"adhoc\"} " << _queue.adhoc() << "\n";
+    ipmMetrics::family(os, "ipm_udp_queue_depth", "gauge",
+        "UDP packets waiting to be sent");
+    os << "ipm_udp_queue_depth " << _udp.depth() << "\n";
+    ipmMetrics::family(os, "ipm_udp_packets_total", "counter",
+        "UDP packets sent and dropped");
+    os << "ipm_udp_packets_total{result=\"sent\"} " << _udp.sent() << "\n" <<
+        "ipm_udp_packets_total{result=\"dropped\"} " << _udp.dropped() <<
+        "\n";
+    ipmMetrics::family(os, "ipm_cycles_total", "counter",
+        "Acquisition cycles started");
+    os << "ipm_cycles_total " << _schedule.cycle() << "\n";
+    ipmMetrics::family(os, "ipm_overruns_total", "counter",
+        "Cycles that ran over their period");
+    os << "ipm_overruns_total " << _schedule.overruns() << "\n";
+}
+
+// Text of the iPM's latest response to a command, for one-off commands
+std::string naiipm::response(const std::string &cmd)
+{
+    char text[sizeof(buffer)];  // room for any response
+    int query = -1;
+    for (int q=0; q < ipmSchedule::NQUERIES; q++)
+    {
+        if (cmd == ipmSchedule::command(q))
+        {
+            query = q;
+        }
+    }
+    if (query >= 0)
+    {
+        ipmFields::format(text, sizeof(text), query, getData(cmd),
+            ipmFields::all(query));
+    } else if (cmd == "BITRESULT?") {
+        ipmBitresult bitresult;
+        bitresult.parse((uint16_t *)getData(cmd));
+        bitresult.createUDP(text, 0);
+    } else {
+        snprintf(text, sizeof(text), "%s", buffer);
+    }
+    std::string reply = text;
+    while (not reply.empty() and
+        (reply.back() == '\n' or reply.back() == '\r'))
+    {
+        reply.pop_back();
+    }
+    return reply;
+}
+
+// Start each line of an iPM response with "| " for a SEND reply, so a
+// response such as OFF's "OK" can't pass for the end of the reply
+std::string naiipm::quote(const std::string &text)
+{
+    std::string out = "| ";
+    for (char c : text)
+    {
+        out += c;
+        if (c == '\n')
+        {
+            out += "| ";
+        }
+    }
+    return out + "\n";
+}
+
+// Queue an ad-hoc command (VER?, BITRESULT?, RESET, ...) for an address
+// index, to be sent in free link time at the end of a cycle. done is
+// called once it has been sent. Returns false if the queue is full.
+bool naiipm::enqueue(int index, const std::string &cmd,
+    ipmQueue::callback done)
+{
+    ipmQueue::command c;
+    c.priority = ipmQueue::ADHOC;
+    c.index = index;
+    c.cycle = _schedule.cycle();
+    c.cmd = cmd;
+    c.done = done;
+    return _queue.push(c);
+}
+
+// Send queued commands up to priority lowest: scheduled queries by
+// deadline, as long as the cycle budget governor admits them, then ad-hoc
+// commands while they fit in what's left of the cycle. An ad-hoc command
+// that has waited MAXWAIT cycles is sent anyway, so a busy schedule can't
+// starve it. A scheduled query that fails ends the cycle, and returns
+// false.
+bool naiipm::runQueue(int fd, int lowest)
+{
+    int active = -1;     // index of the currently selected address
+    bool selected = false;
+
+    while (not _queue.empty() and _queue.top().priority <= lowest)
+    {
+        const ipmQueue::command &next = _queue.top();
+        int i = next.index;
+        if (next.priority == ipmQueue::ADHOC)
+        {
+            if (_schedule.remaining() <
+                _schedule.selectCost() + _schedule.cost(ipmSchedule::RECORD)
+                and _schedule.cycle() - next.cycle < MAXWAIT)
+            {
+                break;  // try again next cycle
+            }
+            std::cout << "Sending one-off " << next.cmd << " to address " <<
+                args.Addr(i) << std::endl;
+        } else {
+            ipmSchedule::slot slot = {i, next.query};
+            long remaining = _schedule.remaining();
+            if (not _schedule.admit(slot, i == active, remaining))
+            {
+                char time_buf[100];
+                time_t now = time({});
+                strftime(time_buf, 100, "%Y%m%dT%H%M%S", gmtime(&now));
+                std::cout << time_buf << " Deferred " << next.cmd <<
+                    " for address " << args.Addr(i) << " in cycle " <<
+                    _schedule.cycle() << ": " << remaining / 1000 <<
+                    " ms left in cycle (shed " <<
+                    _schedule.shed(i, slot.query) << " times)" << std::endl;
+                _queue.pop();
+                continue;
+            }
+            _schedule.sent(slot);
+        }
+        ipmQueue::command c = _queue.pop();
+
+        if (i != active)
+        {
+            active = i;
+            selected = setActiveAddress(fd, args.Addr(i));
+        }
+        if (not selected)
+        {
+            c.done(false);
+            continue;  // Skip address for this iteration
+        }
 
-        if (_sock[i] < 0)
+        if (args.Verbose() and c.priority == ipmQueue::SCHEDULED)
         {
-            std::cout << "Socket creation failed" << std::endl;
-            exit(EXIT_FAILURE);
+            std::cout << "Cycle " << _schedule.cycle() << ": " << c.cmd
+                << " address " << args.Addr(i) << std::endl;
+        }
+        auto sendTime = std::chrono::steady_clock::now();
+        bool ok = send_command(fd, c.cmd, c.arg);
+        if (c.query >= 0)
+        {
+            double usec = std::chrono::duration<double, std::micro>(
+                std::chrono::steady_clock::now() - sendTime).count();
+            linkTime &lt = _linkTime[c.query];
+            lt.min = (lt.n == 0) ? usec : std::min(lt.min, usec);
+            lt.max = std::max(lt.max, usec);
+            lt.sum += usec;
+            lt.n++;
+        }
+        c.done(ok);
+        if (not ok and c.priority == ipmQueue::SCHEDULED)
+        {
+            _queue.drop(ipmQueue::SCHEDULED);
+            return false;
         }
-        memset(&_servaddr[i], 0, sizeof(_servaddr[i]));
-        _servaddr[i].sin_family = AF_INET;
-        _servaddr[i].sin_port = htons(args.Addrport(i));
-        _servaddr[i].sin_addr.s_addr = inet_addr(ip);
     }
-
+    return true;
 }
 
-// Send a UDP message to nidas
-void naiipm::send_udp(const char *buf, int i)
+// Dry run: build the schedule from the command line and simulate it
+// against the estimated query times. Does not touch the iPM.
+void naiipm::plan()
 {
-    std::cout << "sending to port " << args.Addrport(i) << " UDP string "
-        << buf;  // string already ends in /r/n so don't add std::endl here.
-    if (sendto(_sock[i], (const char *)buf, strlen(buf), 0,
-            (const struct sockaddr *) &_servaddr[i], sizeof(_servaddr[i])) == -1)
+    setSchedule();
+
+    int addr[8];
+    for (int i=0; i < args.numAddr(); i++)
     {
-        std::cout << "Sending packet to nidas returned error " << errno
-            << std::endl;
-        exit(1);
+        addr[i] = args.Addr(i);
     }
+    ipmPlanner planner;
+    planner.simulate(_schedule);
+    planner.report(linkBaud(), addr);
 }
 
-// Close UDP port
-void naiipm::close_udp(int adr)
+// Write nidas sensor definitions that match the packets this command line
+// sends, one sensor per address. In the default mode each query is its own
+// sample, ids 1 to 3 for MEASURE, STATUS and RECORD as in ipm.xml. In
+// combined mode (-C) each address has a single sample.
+void naiipm::printXml(const char *file)
 {
-    if (adr == -1)
+    setSchedule();
+    setFields();
+
+    std::ofstream xml(file);
+    if (not xml)
+    {
+        std::cout << "Unable to open " << file << std::endl;
+        return;
+    }
+
+    xml << "<!-- iPM sensors generated by ipm_ctrl -->\n";
+    for (int i=0; i < args.numAddr(); i++)
     {
-        for (int i=0; i<args.numAddr(); i++)
+        xml << "    <sensor ID=\"iPM_" << args.Addr(i) << "\" "
+            "class=\"UDPSocketSensor\" devicename=\"usock::" <<
+            args.Addrport(i) << "\" suffix=\"_iPM" << args.Addr(i) <<
+            "\">\n";
+
+        std::set<std::string> seen;  // variable names used in this sensor
+        int frames = 0;
+        int fastest = 0;
+        for (int q=0; q < ipmSchedule::NQUERIES; q++)
+        {
+            int period = _schedule.period(i, q);
+            if (period == 0)
+            {
+                continue;
+            }
+            frames |= 1 << q;
+            if (fastest == 0 || period < fastest)
+            {
+                fastest = period;
+            }
+            if (q == ipmAggregate::FRAME and args.window() > 0)
+            {
+                ipmAggregate::printSample(xml, q + 1, 1 / args.window(),
+                    _fieldMask[i][q], seen);
+            } else if (not args.Combined())
+            {
+                ipmFields::printSample(xml, q + 1,
+                    _schedule.cycleRate() / period, 1 << q, false, seen,
+                    _fieldMask[i], args.SampleTime());
+            }
+        }
+        if (args.Combined() and frames != 0)
         {
-            close(_sock[i]);
+            ipmFields::printSample(xml, 1, _schedule.cycleRate() / fastest,
+                frames, true, seen, _fieldMask[i], args.SampleTime());
         }
-    } else {
-        close(_sock[adr]);
+        xml << "    </sensor>\n";
     }
+    std::cout << "Wrote nidas sensor definitions to " << file << std::endl;
 }
 
-// Set active address
-bool naiipm::setActiveAddress(int fd, int addr)
-{
-    std::string msg = "ADR";
-    std::string msgarg = std::to_string(addr);
-
-    if(not send_command(fd, msg, msgarg)) { return false; }
-
-    return true;
-}
-
-// Set the recordPeriod per measureRate so can call RECORD only every
-// recordFreq times that MEASURE / STATUS are called.
-// measureRate is in hz; recordPeriod in minutes
-// So if measureRate is 1 and recordPeriod is 10 min, only send RECORD command
-// after send 600 MEASURE/STATUS commands.
-void naiipm::setRecordFreq()
-{
-    _recordFreq = (int)(atoi(args.recordPeriod())*60.0) * atoi(args.measureRate());
-}
-
-
-// Determine queries to send and process.
+// Send the queries due this cycle, in the order set by the schedule. Low
+// priority queries that won't fit in what's left of the cycle are deferred
+// by the schedule's governor so MEASURE and STATUS stay on time.
 bool naiipm::loop(int fd)
 {
-    std::string msg;
+    _schedule.startCycle();
+    clock_gettime(CLOCK_REALTIME, &_cycleTime);
 
-    _recordCount++;
-
-    for (int i=0; i < args.numAddr(); i++)
+    // Jitter: change in the interval between cycle starts
+    auto start = _schedule.started();
+    if (_lastStart != std::chrono::steady_clock::time_point())
     {
-
-        // ‘procqueries’ is an integer representation of 3-bit Boolean
-        // field indicating whether query responses [RECORD,MEASURE,STATUS]
-        // should be processed and variables included in a processed data
-        // file.
-        //     d’3 (b’011) indicates that MEASURE+STATUS are processed.
-        //     d’5 (b’101) indicates that RECORD+STATUS are processed.
-        int procq = args.Procqueries(i);
-        std::bitset<4> x('\0' + procq);
-        if (args.Verbose())
+        long interval = std::chrono::duration_cast<std::chrono::microseconds>(
+            start - _lastStart).count();
+        if (_lastInterval > 0)
         {
-            std::cout << ": [" << procq << "] " << '\0' + procq << " : " << x
-                << std::endl;
+            _jitter.add(std::labs(interval - _lastInterval));
         }
-
-        if (setActiveAddress(fd, args.Addr(i)))
+        _lastInterval = interval;
+    }
+    _lastStart = start;
+
+    // Queue the cycle's queries. A query's deadline is the end of its
+    // period, but an address's queries are sent together to save ADR
+    // commands, so they all take the deadline of its most urgent one (the
+    // first due).
+    long cycleTime = (long)(1000000 / _schedule.cycleRate());
+    int last = -1;
+    long deadline = 0;
+    for (auto slot : _schedule.due())
+    {
+        int i = slot.index;
+        int q = slot.query;
+        if (i != last)
         {
-            // Per software requirements, MEASURE? Is queried first, followed
-            // by STATUS?, followed by RECORD?
-            std::bitset<4> m = x;
-            if ((m &= 0b0010) == 2)  // MEASURE command requested
-            {
-                msg = "MEASURE?";
-                if(not send_command(fd, msg)) { return false; }
-                parseData(msg, i);
-            }
-            std::bitset<4> s = x;
-            if ((s &= 0b0001) == 1)  // STATUS command requested
-            {
-                msg = "STATUS?";
-                if(not send_command(fd, msg)) { return false; }
-                parseData(msg, i);
-            }
-            std::bitset<4> r = x;
-            if ((r &= 0b0100) == 4)  // RECORD command requested
+            last = i;
+            deadline = _schedule.period(i, q) * cycleTime;
+        }
+        ipmQueue::command c;
+        c.priority = ipmQueue::SCHEDULED;
+        c.deadline = deadline;
+        c.index = i;
+        c.query = q;
+        c.cycle = _schedule.cycle();
+        c.cmd = ipmSchedule::command(q);
+        c.done = [this, i, q](bool ok) {
+            if (ok)
             {
-                if (_recordCount >= _recordFreq)
-                {
-                    msg = "RECORD?";
-                    if(not send_command(fd, msg)) { return false; }
-                    parseData(msg, i);
-                    _recordCount = 0;
-                }
+                parseData(ipmSchedule::command(q), i);
             }
+        };
+        _queue.push(c);
+    }
+    if (not runQueue(fd, ipmQueue::SCHEDULED))
+    {
+        if (args.Combined())
+        {
+            send_cycle();
+        }
+        flush_udp();
+        _schedule.next();
+        return false;
+    }
+
+    if (_schedule.remaining() < 0)
+    {
+        _schedule.overrun();
+        if (args.Verbose())
+        {
+            std::cout << "Cycle " << _schedule.cycle() << " overran by " <<
+                -_schedule.remaining() / 1000 << " ms (" <<
+                _schedule.overruns() << " overruns)" << std::endl;
         }
     }
 
+    if (args.Combined())
+    {
+        send_cycle();
+    }
+    if (args.capturePort() > 0)
+    {
+        endCaptures();
+    }
+    runQueue(fd, ipmQueue::ADHOC);
+    flush_udp();
+    _schedule.next();
     return true;
 
 }
 
-// rate for STATUS and MEASURE is quicker than RECORD, so use that as the base.
-// Rather than setting a timer to get responses at the exact interval requested,
-// since this is housekeeping data and timing is not critical, set sleep so we
-// get at least one response per requested time period. From test runs on
-// Gigajoules, request for all three commands returns in ~0.2 seconds, so
-// subtract that from requested rate.
+// Sleep until the next cycle is due, one period of the base cycle rate (-m)
+// after this one started, so the cycle rate holds however long the queries
+// took. A cycle whose queries overran doesn't sleep at all.
 void naiipm::sleep()
 {
-    // TBD: Will likely need to adjust this when the iPM is mounted on the
-    // aircraft.
-    _sleeptime = ((1000000 / atoi(args.measureRate())) - 200000);  // usec
-    usleep(_sleeptime);
+    int64_t slept = ipmStamp::monotonic();
+    auto now = std::chrono::steady_clock::now();
+    auto end = _schedule.started() + std::chrono::microseconds(
+        (long)(1000000 / _schedule.cycleRate()));
+    end = std::max(end, now);  // overran
+    _sleeptime = std::chrono::duration_cast<std::chrono::microseconds>(
+        end - now).count();
+
+    // Answer query API requests until it's time for the next cycle
+    while (_server.isOpen())
+    {
+        long left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - std::chrono::steady_clock::now()).count();
+        if (left <= 0)
+        {
+            break;
+        }
+        _server.poll(left);
+        serve();
+    }
+
+    // In real-time mode (-R), wake at the absolute time, so the time taken
+    // to go to sleep doesn't add up
+    if (_realtime.enabled())
+    {
+        // steady_clock is CLOCK_MONOTONIC
+        long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end.time_since_epoch()).count();
+        struct timespec ts = {ns / 1000000000, ns % 1000000000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+            EINTR)
+        {
+        }
+    } else if (not _server.isOpen() and _sleeptime > 0) {
+        usleep(_sleeptime);
+    }
+
+    _trace.add("sleep", "cycle", CYCLETRACK, slept, ipmStamp::monotonic());
+
+    // How late the loop woke, and every 10 minutes a summary
+    _wakeup.add(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - end).count());
+    long report = std::max(1L, std::lround(600 * _schedule.cycleRate()));
+    if (_wakeup.count() % report == 0)
+    {
+        char time_buf[100];
+        time_t t = time({});
+        strftime(time_buf, 100, "%Y%m%dT%H%M%S", gmtime(&t));
+        std::cout << time_buf << " Wake-up latency ";
+        _wakeup.summary(std::cout);
+        std::cout << ", cycle jitter ";
+        _jitter.summary(std::cout);
+        std::cout << std::endl;
+    }
 }
 
 void naiipm::setData(std::string cmd, int len)
@@ -419,15 +1699,24 @@ void naiipm::setData(std::string cmd, int len)
     // free the previous binary data memory space
     // and update the map to point to the new space
     memcpy(_ipm_data[cmd], buffer, len);
+    // Time the iPM sampled, for everything published from this response
+    int64_t t = _stamp.sample(linkBaud());
+    _dataTime = {(time_t)(t / 1000000), (long)(t % 1000000) * 1000};
+    if (args.Verbose())
+    {
+        char time_buf[32];
+        snprintf(time_buf, sizeof(time_buf), "%ld.%06ld",
+            (long)_dataTime.tv_sec, _dataTime.tv_nsec / 1000);
+        std::cout << "Sampled at " << time_buf << " +/- " <<
+            _stamp.uncertainty(linkBaud()) << " us" << std::endl;
+    }
 }
 
 // read response from iPM
 void naiipm::get_response(int fd, int len, bool bin)
 {
-    int n = 0, r = 0;
+    int n = 0;
     char c;
-    int ret;
-    fd_set set;
     buffer[0] = '\0';
     if (args.Verbose())
     {
@@ -436,79 +1725,63 @@ void naiipm::get_response(int fd, int len, bool bin)
 
     while (true)
     {
-        // If iPM never returns expected number of bytes, timeout
-        struct timeval timeout;
-        FD_ZERO(&set);
-        FD_SET(fd, &set);
-
-        // During operation, the iPM timeout should be 100ms. When developing
-        // using the Python emulator, this is too short, so add a second.
-        int tout;
-        if (args.Emulate())
-        {
-            tout = 1;  // Add a second to timeout when developing
-        } else
+        // Read whatever the iPM has sent, along with writing the command
+        // if it hasn't been yet. If the iPM never returns expected number
+        // of bytes, timeout.
+        if (_rxpos == _rxlen)
         {
-            tout = 0;  // Deployment mode - leave timeout at 100ms
-        }
-        timeout.tv_sec = tout;
-        timeout.tv_usec = 100000;  // 100ms timeout
-
-        int rv = select(fd + 1, &set, NULL, NULL, &timeout);
-        if (rv == -1)
-        {
-            perror("select()");
-            break; /* an error occurred */
-        }
-        else if (rv == 0)
-        {
-            if (len != 0)  // expected a response but didn't get one
+            if (not _tx.empty())
             {
-                // timeout
-                trackBadData();
-                std::cout << "timeout" << std::endl; /* a timeout occured */
+                _stamp.write(_tx.size());
             }
-            break;
-        }
-        else
-        {
-            ret = read(fd, &c, 1);
-        }
-
-        if (ret > 0)  // successful read
-        {
-            std::bitset<8> x(c);
-            unsigned int i = (unsigned char)c;
-            if (args.Verbose())
+            int rv = io().transfer(fd, _tx.data(), _tx.size(), _rx,
+                sizeof(_rx), responseTimeout());
+            _tx.clear();
+            if (rv == -1)
             {
-              // If c is not a printable character, for printing purposes
-              // replace it with a null string terminator"
-              char ch = c;
-              if (not std::isprint(static_cast<unsigned char>(c))) {
-                  ch = '\0';
-              } else {
-                  ch = c;
-              }
-              std::cout << n+1 << ": [" << ch << "] " << std::dec << i << ",";
-              std::cout << std::hex << i << " : " << x << std::dec << std::endl;
+                std::cout << "Read from iPM returned error " <<
+                    strerror(errno) << std::endl;
+                break; /* an error occurred */
             }
-            buffer[n] = c;
-            // linefeed is a valid value mid-binary query so only test
-            // if NOT reading binary data
-            if (c == '\n' && not bin) { // found linefeed
+            else if (rv == 0)
+            {
+                if (len != 0)  // expected a response but didn't get one
+                {
+                    // timeout
+                    _metrics.count(_addr, ipmMetrics::TIMEOUTS);
+                    trackBadData();
+                    std::cout << "timeout" << std::endl; /* a timeout occured */
+                }
                 break;
             }
-            n++;
-        } else if (ret != -1)  // read did not return timeout
-        {
-            std::cout << "unknown response " << c << std::endl;
-            return;
-        } else if (ret == -1)  // Resource temporarily unavailable
-        {
-            std::cout << "Read from iPM returned error " << strerror(errno)
-                << std::endl;
+            _stamp.received();
+            _rxlen = rv;
+            _rxpos = 0;
         }
+        c = _rx[_rxpos++];
 
+        std::bitset<8> x(c);
+        unsigned int i = (unsigned char)c;
+        if (args.Verbose())
+        {
+          // If c is not a printable character, for printing purposes
+          // replace it with a null string terminator"
+          char ch = c;
+          if (not std::isprint(static_cast<unsigned char>(c))) {
+              ch = '\0';
+          } else {
+              ch = c;
+          }
+          std::cout << n+1 << ": [" << ch << "] " << std::dec << i << ",";
+          std::cout << std::hex << i << " : " << x << std::dec << std::endl;
+        }
+        buffer[n] = c;
+        // linefeed is a valid value mid-binary query so only test
+        // if NOT reading binary data
+        if (c == '\n' && not bin) { // found linefeed
+            break;
+        }
+        n++;
 
         // if receive len chars without an endline, return anyway
         // (handles binary data)
@@ -520,6 +1793,7 @@ void naiipm::get_response(int fd, int len, bool bin)
     }
 
     buffer[n+1] = '\0'; // terminate the string
+    _stamp.finish();
 
     if (not bin && (n+1 != len))
     {
@@ -538,18 +1812,31 @@ void naiipm::get_response(int fd, int len, bool bin)
                std::cout << "Didn't receive all expected chars: received " <<
                    n+1 << ", expected " << len << " : " << buffer << std::endl;
                // data size error; increment bad data counter
+               _metrics.count(_addr, ipmMetrics::SHORTREADS);
                trackBadData();
            }
        }
     }
 }
 
+// During operation, the iPM timeout should be 100ms. When developing
+// using the Python emulator, this is too short, so add a second.
+long naiipm::responseTimeout()
+{
+    if (args.Emulate())
+    {
+        return 1100000;  // Add a second to timeout when developing
+    }
+    return 100000;  // Deployment mode - leave timeout at 100ms
+}
+
 // If bad data is received (e.g. header error, size error, CRC error, query
 // timeout) then the counter is incremented. If counter reaches 10 errors,
 // application shall wait 5 seconds and then reinit. Log that we shut down for
 // data error reasons.
 void naiipm::trackBadData()
 {
+    _metrics.count(_addr, ipmMetrics::BADDATA);
     _badData++;
     if (_badData == 10)
     {
@@ -560,6 +1847,51 @@ void naiipm::trackBadData()
         exit(1);
     }
 }
+
+// Add the serial times of the exchange just finished to the metrics
+void naiipm::exchanged(int command)
+{
+    int64_t written = _stamp.written();
+    if (io().drained() >= written)
+    {
+        _metrics.add(_addr, command, ipmMetrics::DRAIN,
+            io().drained() - written);
+    }
+    _metrics.add(_addr, command, ipmMetrics::FIRSTBYTE,
+        _stamp.first() - written);
+    _metrics.add(_addr, command, ipmMetrics::TRANSFER,
+        _stamp.last() - _stamp.first());
+    _metrics.busy(_stamp.last() - written, _stamp.last());
+    trace(command);
+}
+
+// Trace a command's exchange: the whole of it, then the write, the wait
+// for it to leave the serial port (epoll only), the wait for the
+// response and reading it
+void naiipm::trace(int command)
+{
+    if (not _trace.isOpen())
+    {
+        return;
+    }
+    const char *name = ipmMetrics::commandName(command);
+    int64_t written = _stamp.written();
+    int64_t waited = written;
+    _trace.add(name, "command", _addr, written, _stamp.last());
+    if (io().wrote() >= written)
+    {
+        _trace.add("write", name, _addr, written, io().wrote());
+        waited = io().wrote();
+        if (io().drained() >= waited)
+        {
+            _trace.add("tcdrain", name, _addr, waited, io().drained());
+            waited = io().drained();
+        }
+    }
+    _trace.add("wait", name, _addr, waited, _stamp.first());
+    _trace.add("read", name, _addr, _stamp.first(), _stamp.last());
+}
+
 // send a single command entered on the command line
 void naiipm::singleCommand(int fd)
 {
@@ -594,25 +1926,27 @@ bool naiipm::send_command(int fd, std::string msg, std::string msgarg)
         std::cout << "Expect response " << expected_response << std::endl;
     }
 
+    // Everything after an ADR command is from that address
+    int command = ipmMetrics::command(msg);
+    if (command == ipmMetrics::ADR and atoi(msgarg.c_str()) >= 0 and
+        atoi(msgarg.c_str()) < 8)
+    {
+        _addr = atoi(msgarg.c_str());
+    }
+
     // Send message to ipm
     if (msgarg != "")
     {
         msg.append(' ' + msgarg);
     }
-    std::string sendmsg = msg + "\n";  // Add linefeed to end of command
-    if (args.Verbose())
-    {
-        std::cout << "Sending message " << sendmsg << std::endl;
-        std::cout << "of length " << sendmsg.length() << std::endl;
-    }
-    write(fd, sendmsg.c_str(), sendmsg.length());
-    if (tcdrain(fd) == -1)  // wait for write to complete
-    {
-        std::cout << errno << std::endl;
-    }
+    // The command is written by the transfer that reads its response. The
+    // exchange it starts runs to the end of the binary data, if any.
+    _tx = msg + "\n";  // Add linefeed to end of command
+    _stamp.start();
     if (args.Verbose())
     {
-        std::cout << "Write completed" << std::endl;
+        std::cout << "Sending message " << _tx << std::endl;
+        std::cout << "of length " << _tx.length() << std::endl;
     }
 
     if (msg == "SERNO?")  // Serial # changes frequently, so just check regex
@@ -652,7 +1986,15 @@ bool naiipm::send_command(int fd, std::string msg, std::string msgarg)
 
         if(buffer != expected_response)
         {
-            // header error so increment bad data counter
+            // header error so increment bad data counter. No response at
+            // all is a timeout, already counted.
+            if (buffer[0] != '\0')
+            {
+                exchanged(command);
+                _metrics.count(_addr, ipmMetrics::HEADERERRORS);
+            } else {
+                trace(command);  // the wait that timed out
+            }
             trackBadData();
             std::cout << "Device command " << msg << " did not return "
                 << "expected response " << expected_response << std::endl;
@@ -678,6 +2020,7 @@ bool naiipm::send_command(int fd, std::string msg, std::string msgarg)
         get_response(fd, binlen, true);  // true indicates reading binary data
         setData(msg, binlen);
     }
+    exchanged(command);
 
     flush(fd);
 
@@ -724,9 +2067,96 @@ bool naiipm::setInteractiveMode(int fd)
     return status;  // will be false if user requested to quit
 }
 
+// Interactive session (-i) with -U: rather than open the serial port,
+// which the acquisition daemon owns, send the -c command or the commands
+// picked from the menu to the daemon as a client of its query API. The
+// daemon sends them to the iPM in free link time between its queries.
+int naiipm::remote()
+{
+    ipmClient client;
+    if (not client.connect(args.SocketPath()))
+    {
+        std::cout << "Unable to connect to ipm_ctrl on " <<
+            args.SocketPath() << std::endl;
+        return 1;
+    }
+
+    const int timeout = 30000;  // msec; a SEND may wait several cycles
+    std::string addr = args.Address();
+    if (atoi(addr.c_str()) == -1)
+    {
+        addr = "0";
+    }
+    std::string reply;
+
+    // Single command from the command line
+    if (strcmp(args.Cmd(), "") != 0)
+    {
+        bool ok = client.request("SEND " + addr + " " + args.Cmd(), reply,
+            timeout);
+        std::cout << reply << (ok ? "" : "\n") << std::flush;
+        return ok ? 0 : 1;
+    }
+
+    // Menu. Query API requests for the current address can be typed too.
+    std::string line;
+    while (true)
+    {
+        commands.printMenu();
+        std::cout << "or LATEST <frame>, HISTORY <frame> <n>, CLOCK, HEALTH, " <<
+            "LATENCY or METRICS" << std::endl;
+        if (not std::getline(std::cin, line))
+        {
+            break;
+        }
+        std::istringstream in(line);
+        std::string cmd, rest;
+        in >> cmd;
+        std::getline(in, rest);
+        if (cmd.empty())
+        {
+            continue;
+        }
+        if (cmd == "q")
+        {
+            break;
+        }
+
+        std::string req;
+        if (cmd == "LATEST" or cmd == "HISTORY" or cmd == "CLOCK")
+        {
+            req = cmd + " " + addr + rest;
+        } else if (cmd == "HEALTH" or cmd == "LATENCY" or
+            cmd == "METRICS") {
+            req = cmd;
+        } else if (not commands.verify(cmd)) {
+            continue;
+        } else if (cmd == "ADR") {
+            // The daemon selects addresses itself; just change the one
+            // commands go to
+            std::cout << "Which address would you like to activate (0-7)?"
+                << std::endl;
+            std::getline(std::cin, addr);
+            continue;
+        } else {
+            req = "SEND " + addr + " " + cmd;
+        }
+
+        bool ok = client.request(req, reply, timeout);
+        std::cout << reply << (ok ? "" : "\n") << std::flush;
+        if (not ok and reply.compare(0, 4, "ERR ") != 0)
+        {
+            return 1;  // lost the daemon
+        }
+    }
+    return 0;
+}
+
 // Flush serial port
 void naiipm::flush(int fd)
 {
+    _rxlen = _rxpos = 0;  // along with anything read ahead
+    _tx.clear();
     if (tcflush(fd, TCIOFLUSH) == -1)
     {
         std::cout << "Flush returned error " << errno << std::endl;
@@ -790,6 +2220,57 @@ void naiipm::parse_binary(std::string cmd)
     }
 }
 
+// Fit the address's iPM clock to UTC with a RECORD response, and log the
+// UTC of a new event record
+void naiipm::clockRecord(int adr, const char *data)
+{
+    int64_t sampled = (int64_t)_dataTime.tv_sec * 1000000 +
+        _dataTime.tv_nsec / 1000;
+    if (not _clock.record(adr, data, sampled))
+    {
+        return;
+    }
+    const char *name = ipmClock::eventName(_clock.evtype(adr));
+    int64_t t;
+    long uncertainty;
+    if (name == NULL or not _clock.utc(adr, _clock.time(adr), t,
+        uncertainty))
+    {
+        return;
+    }
+    char time_buf[100];
+    time_t now = time({});
+    strftime(time_buf, 100, "%Y%m%dT%H%M%S", gmtime(&now));
+    char event_buf[100];
+    time_t sec = t / 1000000;
+    int len = strftime(event_buf, 100, "%Y%m%dT%H%M%S", gmtime(&sec));
+    snprintf(event_buf + len, sizeof(event_buf) - len, ".%03ld",
+        (long)(t % 1000000) / 1000);
+    std::cout << time_buf << " Address " << args.Addr(adr) << " " << name <<
+        " at " << event_buf << " +/- " << uncertainty / 1000 << " ms" <<
+        std::endl;
+}
+
+// Sample time (-s): insert the time the iPM sampled into the frame text in
+// buffer, after the frame name, as eg MEASURE,<unix time>,... Returns the
+// new length.
+int naiipm::stampFrame(int len)
+{
+    char stamp[32];
+    int n = snprintf(stamp, sizeof(stamp), ",%ld.%06ld",
+        (long)_dataTime.tv_sec, _dataTime.tv_nsec / 1000);
+    char *at = buffer;
+    while (at < buffer + len and *at != ',' and *at != '\r' and *at != '\n')
+    {
+        at++;
+    }
+    memmove(at + n, at, buffer + len - at);
+    memcpy(at, stamp, n);
+    len += n;
+    buffer[len] = '\0';
+    return len;
+}
+
 void naiipm::parseData(std::string cmd, int adr)
 {
     if (args.Verbose())
@@ -799,20 +2280,135 @@ void naiipm::parseData(std::string cmd, int adr)
             args.Addr(adr) << "," << args.Procqueries(adr) << "," <<
             args.Addrport(adr) << std::endl;
     }
+
     // retrieve binary data
     char* data = getData(cmd); // data content
 
+    int query = -1;
+    for (int q=0; q < ipmSchedule::NQUERIES; q++)
+    {
+        if (cmd == ipmSchedule::command(q))
+        {
+            query = q;
+        }
+    }
+
+    // Every response goes to shared memory, whatever is sent to nidas
+    if (_shm.isOpen() and query >= 0)
+    {
+        _shm.publish(adr, query, data,
+            std::stoi(commands.response(cmd)->second),
+            (uint64_t)_dataTime.tv_sec * 1000000 + _dataTime.tv_nsec / 1000);
+    }
+
+    // iPM clock to UTC, and the time of new RECORD events
+    if (query == ipmSchedule::RECORD and not args.Interactive())
+    {
+        clockRecord(adr, data);
+    }
+
+    // Latest responses and the ring of recent ones, for burst capture and
+    // the query API
+    if (query >= 0 and not args.Interactive())
+    {
+        double now = _dataTime.tv_sec + _dataTime.tv_nsec / 1e9;
+        memcpy(_latest[adr][query], data,
+            std::stoi(commands.response(cmd)->second));
+        _latestTime[adr][query] = now;
+        _metrics.sampled(args.Addr(adr), query, ipmStamp::monotonic(), now);
+        if (query != ipmSchedule::RECORD and
+            (args.capturePort() > 0 or _server.isOpen()))
+        {
+            _capture.add(adr, query, data, now);
+        }
+    }
+
+    // Burst capture around power events
+    if (args.capturePort() > 0 and query >= 0 and not args.Interactive())
+    {
+        if (captureData(adr, query, data))
+        {
+            return;
+        }
+    }
+
+    // Adaptive MEASURE rate. A running capture owns the address's
+    // schedule, so changes wait until it ends.
+    if (args.Policy() != NULL and query == ipmSchedule::MEASURE and
+        not args.Interactive() and not _capture.active(adr))
+    {
+        adaptRate(adr, data);
+    }
+
+    // Windowed aggregation: MEASURE goes into the address's window and a
+    // packet of statistics is sent when the window is complete. Each
+    // window is published, so the deadband doesn't apply.
+    if (args.window() > 0 and query == ipmAggregate::FRAME and
+        not args.Interactive())
+    {
+        double now = std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (_aggregate.due(adr, now))
+        {
+            char packet[ipmUdp::PKTLEN];
+            int len = _aggregate.format(adr, packet, sizeof(packet),
+                _fieldMask[adr][query]);
+            send_udp(packet, std::min(len, (int)sizeof(packet) - 1), adr);
+        }
+        _aggregate.add(adr, data, now);
+        return;
+    }
+
+    // Change-driven publishing: drop frames where nothing sent moved past
+    // its deadband, unless the heartbeat is due
+    if (args.Deadband() != NULL and query >= 0 and not args.Interactive())
+    {
+        double now = std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (not _deadband.check(adr, query, data, _fieldMask[adr][query],
+            now))
+        {
+            return;
+        }
+    }
+
+    // Binary packets carry the raw data, so there is nothing to decode
+    int command = ipmMetrics::command(cmd);
+    int64_t start = ipmStamp::monotonic();
+    if (args.Binary() and not args.Interactive())
+    {
+        send_binary(cmd, adr);
+        int64_t formatted = ipmStamp::monotonic();
+        _metrics.add(_addr, command, ipmMetrics::FORMAT, formatted - start);
+        _trace.add("format", ipmMetrics::commandName(command), _addr, start,
+            formatted);
+        return;
+    }
+
     // Create some pointers to access data of various lengths
     uint8_t *cp = (uint8_t *)data;
     uint16_t *sp = (uint16_t *)data;
     uint32_t *lp = (uint32_t *)data;
     unsigned char *up = (unsigned char *)data;
+    int len = 0;
+    int64_t parsed = 0;  // when decoding finished, if there was any
+
+    // With field projection, decode and write only the selected fields
+    // straight from the binary data
+    bool projected = query >= 0 and not args.Interactive() and
+        _fieldMask[adr][query] != ipmFields::all(query);
+    if (projected)
+    {
+        len = ipmFields::format(buffer, 255, query, data,
+            _fieldMask[adr][query]);
+    }
 
     // parse data
     if (cmd == "BITRESULT?") {
         ipmBitresult _bitresult;
         _bitresult.parse(sp);
-        _bitresult.createUDP(buffer, args.scaleflag());
+        parsed = ipmStamp::monotonic();
+        len = _bitresult.createUDP(buffer, args.scaleflag());
 
         if (args.Verbose())
         {
@@ -822,9 +2418,10 @@ void naiipm::parseData(std::string cmd, int adr)
 
     }
 
-    if (cmd == "RECORD?") {
+    if (cmd == "RECORD?" and not projected) {
         ipmRecord _record;
         _record.parse(cp, sp, lp);
+        parsed = ipmStamp::monotonic();
 
         // CRC validation doesn't currently work. See notes in src/record.cc
         // Leaving the code here so that this can be investigated more later
@@ -841,27 +2438,60 @@ void naiipm::parseData(std::string cmd, int adr)
                 << " minutes since power-up" << std::endl;
         }
 
-        _record.createUDP(buffer, args.scaleflag());
+        len = _record.createUDP(buffer, args.scaleflag());
     }
 
-    if (cmd == "MEASURE?") {
+    if (cmd == "MEASURE?" and not projected) {
         ipmMeasure _measure;
         _measure.parse(cp, sp);
-        _measure.createUDP(buffer, args.scaleflag());
+        parsed = ipmStamp::monotonic();
+        len = _measure.createUDP(buffer, args.scaleflag());
     }
 
-    if (cmd == "STATUS?") {
+    if (cmd == "STATUS?" and not projected) {
         ipmStatus _status;
         _status.parse(cp, sp);
-        _status.createUDP(buffer, args.scaleflag(), _badData);
+        parsed = ipmStamp::monotonic();
+        len = _status.createUDP(buffer, args.scaleflag(), _badData);
+    }
+
+    // Sample time (-s) after the frame name
+    if (args.SampleTime() and query >= 0 and not args.Interactive())
+    {
+        len = stampFrame(len);
+    }
+
+    // snprintf returns the untruncated length
+    len = std::min(len, 254);
+
+    int64_t formatted = ipmStamp::monotonic();
+    if (parsed != 0)
+    {
+        _metrics.add(_addr, command, ipmMetrics::PARSE, parsed - start);
+        _trace.add("parse", ipmMetrics::commandName(command), _addr, start,
+            parsed);
+        start = parsed;
     }
+    _metrics.add(_addr, command, ipmMetrics::FORMAT, formatted - start);
+    _trace.add("format", ipmMetrics::commandName(command), _addr, start,
+        formatted);
 
     if (args.Interactive())
     {
         std::cout << buffer << std::endl;
+    } else if (args.Combined() and query >= 0)
+    {
+        // Hold the frame, without its line ending, for send_cycle()
+        while (len > 0 and (buffer[len-1] == '\n' or buffer[len-1] == '\r'))
+        {
+            len--;
+        }
+        memcpy(_frame[adr][query], buffer, len);
+        _frame[adr][query][len] = '\0';
+        _fresh[adr] |= 1 << query;
     } else
     {
-        send_udp(buffer, adr);
+        send_udp(buffer, len, adr);
     }
 
 }
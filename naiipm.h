@@ -6,12 +6,31 @@
 #include <map>
 #include <arpa/inet.h>
 #include <iostream>
+#include <ctime>
+#include <stdint.h>
 
 #ifndef NAIIPM_H
 #define NAIIPM_H
 
 #include "src/argparse.h"
 #include "src/cmd.h"
+#include "src/schedule.h"
+#include "src/udp.h"
+#include "src/deadband.h"
+#include "src/aggregate.h"
+#include "src/capture.h"
+#include "src/policy.h"
+#include "src/shm.h"
+#include "src/server.h"
+#include "src/queue.h"
+#include "src/sequence.h"
+#include "src/io.h"
+#include "src/realtime.h"
+#include "src/histogram.h"
+#include "src/stamp.h"
+#include "src/clock.h"
+#include "src/metrics.h"
+#include "src/trace.h"
 
 extern ipmArgparse args;
 
@@ -29,45 +48,172 @@ class naiipm
         void close_port(int fd);
 
         void open_udp(const char *ip);
-        void send_udp(const char *buffer, int adr);
-        void close_udp(int adr);
+        void send_udp(const char *buffer, int len, int adr);
+        void flush_udp();
+        void send_cycle();
+        void send_binary(std::string cmd, int adr);
+        void close_udp();
 
         bool setInteractiveMode(int fd);
         void singleCommand(int fd);
         bool readInput(int fd);
+        int remote();
         bool clear(int fd, int addr);
         bool init(int fd);
+        void run(int fd, std::vector<ipmSequence> &seqs);
         bool loop(int fd);
+        bool enqueue(int index, const std::string &cmd,
+            ipmQueue::callback done);
 
         void setRecordFreq();
+        void setSchedule();
+        void setFields();
+        void setDeadband();
+        void setAggregate();
+        void setCapture();
+        void setPolicy();
+        void setShm();
+        void setServer();
+        void setRealtime();
+        void setTrace();
+        void plan();
+        void printXml(const char *file);
         void sleep();
 
     private:
         char buffer[1000];
 
         void parseData(std::string cmd, int addrIndex);
+        int stampFrame(int len);
+        void clockRecord(int adr, const char *data);
+        void exchanged(int command);
         void parseBitresult(uint16_t *sp);
 
         void get_response(int fd, int len, bool bin);
+        // Timestamps of the last exchange, and the time the iPM sampled
+        ipmStamp _stamp;
+        // Each address's iPM clock (RECORD TIME) to UTC
+        ipmClock _clock;
+        // Command times and error counts, and the iPM address commands are
+        // going to (the last ADR)
+        ipmMetrics _metrics;
+        int _addr;
+        // Trace events (-J), on a track per iPM address and one for the
+        // cycle's UDP sends and sleeps
+        void trace(int command);
+        ipmTrace _trace;
+        static const int CYCLETRACK = 8;
+        // Serial I/O (-I): the command waiting to be written, and bytes
+        // read but not yet used
+        ipmIo& io();
+        ipmIo *_io;
+        std::string _tx;
+        char _rx[256];
+        int _rxlen;
+        int _rxpos;
+        long responseTimeout();
         void flush(int fd);
         virtual bool send_command(int fd, std::string msg, std::string msgarg = "");
         void parse_binary(std::string cmd);
 
         uint_fast32_t get_baud();
+        bool setBaud(int fd, int baud);
+        int linkBaud();
+        int detectBaud(int fd);
+        std::string _detectedBaud;
 
-        int _recordCount;
         int _recordFreq;
-        long _sleeptime;
+        ipmSchedule _schedule;
+        long _sleeptime;  // usec sleep() waits for the next cycle
 
         virtual bool setActiveAddress(int fd, int addr);
         void rmAddr(int i);
+        void addClear(ipmSequence &seq, int fail);
 
         void setData(std::string cmd, int binlen);
         char* getData(std::string msg)
             { return _ipm_data.find(msg)->second; }
 
-        struct sockaddr_in _servaddr[8];
-        int _sock[8];
+        ipmUdp _udp;
+
+        // Combined mode (-C): latest frame text (prefix and fields, no
+        // line ending) from each address and query, and a bit per query
+        // for frames read this cycle.
+        char _frame[8][ipmSchedule::NQUERIES][256];
+        int _fresh[8];
+        struct timespec _cycleTime;  // UTC start of the current cycle
+
+        // Fields sent per address index and query (bit 1 << field); all
+        // fields unless -F selects fewer
+        uint64_t _fieldMask[8][ipmSchedule::NQUERIES];
+
+        ipmDeadband _deadband;
+        ipmAggregate _aggregate;  // MEASURE windows (-W)
+
+        // Burst capture (-t): the ring and its own UDP destination, where
+        // captures are written, and the MEASURE and STATUS periods and
+        // phases to restore when an address's burst ends
+        bool captureData(int adr, int query, const char *data);
+        void startCapture(int adr, double now, const char *reason);
+        void endCaptures();
+        ipmCapture _capture;
+        ipmUdp _captureUdp;
+        const char *_captureDir;
+        int _basePeriod[8][2];
+        int _basePhase[8][2];
+
+        // Adaptive MEASURE rate (-A): the MEASURE period and phase to go
+        // back to when an address is nominal again
+        void adaptRate(int adr, const char *data);
+        bool fitsBudget();
+        ipmPolicy _policy;
+        int _policyPeriod[8];
+        int _policyPhase[8];
+
+        ipmShm _shm;  // latest responses for local readers (-M)
+
+        // Real-time mode (-R), and how late sleep() wakes and how much the
+        // interval between cycle starts varies, with or without it
+        ipmRealtime _realtime;
+        ipmHistogram _wakeup;
+        ipmHistogram _jitter;
+        std::chrono::steady_clock::time_point _lastStart;
+        long _lastInterval;
+
+        // Commands waiting for the serial port: each cycle's scheduled
+        // queries, then ad-hoc commands sent at the end of a cycle when
+        // there is link time left, or once they have waited MAXWAIT cycles
+        bool runQueue(int fd, int lowest);
+        ipmQueue _queue;
+        static const int MAXWAIT = 10;
+
+        // Local query API (-U). Requests are answered while sleep() waits
+        // for the next cycle; SEND commands go on the queue and are
+        // answered once sent.
+        void serve();
+        void request(int client, const std::string &line);
+        std::string response(const std::string &cmd);
+        static std::string quote(const std::string &text);
+        void expose(std::ostream &os);
+        ipmServer _server;
+        // Latest response of each address index and query, and its time
+        char _latest[8][ipmSchedule::NQUERIES][72];
+        double _latestTime[8][ipmSchedule::NQUERIES];
+        // Measured serial link time (usec) of each query
+        struct linkTime
+        {
+            long n;
+            double sum;
+            double min;
+            double max;
+        };
+        linkTime _linkTime[ipmSchedule::NQUERIES];
+
+        // Binary mode (-B): sequence number of the next packet per address
+        // index. The time the iPM sampled the last binary response, which
+        // all modes publish.
+        uint32_t _seq[8];
+        struct timespec _dataTime;
 
         // Map message to expected response
         std::map<std::string, std::string>_ipm_commands;
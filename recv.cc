@@ -0,0 +1,160 @@
+/*************************************************************************
+ * Test receiver for the binary UDP packets sent by ipm_ctrl -B. Listens on
+ * one or more ports, decodes each packet and prints it as the scaled
+ * comma-delimited string ipm_ctrl prints in interactive mode, along with
+ * the packet header. Gaps in sequence numbers are reported as lost packets.
+ *
+ *  2024, Copyright University Corporation for Atmospheric Research
+ *************************************************************************
+*/
+
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "src/packet.h"
+#include "src/measure.h"
+#include "src/status.h"
+#include "src/record.h"
+#include "src/bitresult.h"
+
+// Build the comma-delimited string for a frame
+void format(const ipmPacket::header &h, const char *payload, char *text)
+{
+    // Copy to aligned storage for the frame parsers
+    uint32_t data[64];
+    memcpy(data, payload, std::min((int)h.length, (int)sizeof(data)));
+    uint8_t *cp = (uint8_t *)data;
+    uint16_t *sp = (uint16_t *)data;
+    uint32_t *lp = (uint32_t *)data;
+
+    switch (h.type)
+    {
+        case ipmPacket::MEASURE:
+        {
+            ipmMeasure measure;
+            measure.parse(cp, sp);
+            measure.createUDP(text, 1);
+            break;
+        }
+        case ipmPacket::STATUS:
+        {
+            ipmStatus status;
+            status.parse(cp, sp);
+            status.createUDP(text, 1, 0);
+            break;
+        }
+        case ipmPacket::RECORD:
+        {
+            ipmRecord record;
+            record.parse(cp, sp, lp);
+            record.createUDP(text, 1);
+            break;
+        }
+        case ipmPacket::BITRESULT:
+        {
+            ipmBitresult bitresult;
+            bitresult.parse(sp);
+            bitresult.createUDP(text, 1);
+            break;
+        }
+        default:
+            snprintf(text, 255, "unknown frame type %d\r\n", h.type);
+    }
+}
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2 or argc > 9)
+    {
+        std::cout << "Usage: ipm_recv port [port ...]\n"
+            "\tPrint binary iPM packets (ipm_ctrl -B) received on up to 8\n"
+            "\tUDP ports" << std::endl;
+        return 1;
+    }
+
+    int nsock = argc - 1;
+    int socks[8];
+    int maxfd = 0;
+    for (int i = 0; i < nsock; i++)
+    {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(atoi(argv[i+1]));
+
+        socks[i] = socket(AF_INET, SOCK_DGRAM, 0);
+        if (socks[i] < 0 or
+            bind(socks[i], (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            perror(argv[i+1]);
+            return 1;
+        }
+        maxfd = std::max(maxfd, socks[i]);
+    }
+
+    ipmPacket receiver[8];  // one per port; sequence numbers are per port
+    char buf[2048];
+    char text[256];
+    while (true)
+    {
+        fd_set set;
+        FD_ZERO(&set);
+        for (int i = 0; i < nsock; i++)
+        {
+            FD_SET(socks[i], &set);
+        }
+        if (select(maxfd + 1, &set, NULL, NULL, NULL) < 0)
+        {
+            perror("select()");
+            return 1;
+        }
+
+        for (int i = 0; i < nsock; i++)
+        {
+            if (not FD_ISSET(socks[i], &set))
+            {
+                continue;
+            }
+            int len = recv(socks[i], buf, sizeof(buf), 0);
+            if (len < 0)
+            {
+                continue;
+            }
+
+            ipmPacket::header h;
+            long lost = receiver[i].lost();
+            if (not receiver[i].receive(buf, len, h))
+            {
+                std::cout << "port " << argv[i+1] << ": invalid packet of "
+                    << len << " bytes" << std::endl;
+                continue;
+            }
+            if (receiver[i].lost() != lost)
+            {
+                std::cout << "port " << argv[i+1] << ": lost " <<
+                    receiver[i].lost() - lost << " packets before seq " <<
+                    h.seq << std::endl;
+            }
+
+            char time_buf[100];
+            time_t sec = h.time / 1000000;
+            strftime(time_buf, 100, "%Y%m%dT%H%M%S", gmtime(&sec));
+            format(h, buf + ipmPacket::HEADERLEN, text);
+            std::cout << time_buf << "." << std::setw(3) << std::setfill('0')
+                << (h.time % 1000000) / 1000 << std::setfill(' ') << " port "
+                << argv[i+1] << " addr " << (int)h.addr << " seq " << h.seq
+                << " " << text;  // text ends in \r\n
+        }
+    }
+
+    return 0;
+}
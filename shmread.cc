@@ -0,0 +1,72 @@
+/*************************************************************************
+ * Test reader for the shared memory segment published by ipm_ctrl -M.
+ * Prints the latest response of every frame from every address, decoded
+ * and scaled, then repeats every interval seconds if one is given.
+ *
+ *  2024, Copyright University Corporation for Atmospheric Research
+ *************************************************************************
+*/
+
+#include <unistd.h>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <iomanip>
+
+#include "src/shm.h"
+#include "src/fields.h"
+
+int main(int argc, char * argv[])
+{
+    if (argc < 2 or argc > 3)
+    {
+        std::cout << "Usage: ipm_shm name [interval]\n"
+            "\tPrint the latest iPM responses published by ipm_ctrl -M name,\n"
+            "\tevery interval seconds if given" << std::endl;
+        return 1;
+    }
+
+    ipmShm shm;
+    if (not shm.open(argv[1]))
+    {
+        std::cout << "Unable to open iPM shared memory " << argv[1] <<
+            std::endl;
+        return 1;
+    }
+
+    float interval = (argc == 3) ? atof(argv[2]) : 0;
+    do
+    {
+        for (int i = 0; i < shm.numAddr(); i++)
+        {
+            for (int f = 0; f < ipmShm::NFRAMES; f++)
+            {
+                ipmShm::sample s;
+                if (not shm.read(i, f, s))
+                {
+                    continue;
+                }
+                char time_buf[100];
+                time_t sec = s.time / 1000000;
+                strftime(time_buf, 100, "%Y%m%dT%H%M%S", gmtime(&sec));
+                std::cout << time_buf << "." << std::setw(3) <<
+                    std::setfill('0') << (s.time % 1000000) / 1000 <<
+                    std::setfill(' ') << " addr " << shm.addr(i) << " " <<
+                    ipmFields::prefix(f) << " #" << s.count;
+                for (int k = 0; k < ipmFields::count(f); k++)
+                {
+                    const ipmField &fld = ipmFields::field(f, k);
+                    std::cout << " " << fld.name << "=" <<
+                        ipmFields::value(f, k, s.data) * fld.scale;
+                }
+                std::cout << std::endl;
+            }
+        }
+        if (interval > 0)
+        {
+            usleep((useconds_t)(interval * 1000000));
+        }
+    } while (interval > 0);
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <cmath>
+#include <cstdio>
+#include "aggregate.h"
+
+const int ipmAggregate::FRAME;
+const int ipmAggregate::MAXFIELDS;
+
+ipmAggregate::ipmAggregate()
+{
+    configure(1);
+}
+
+ipmAggregate::~ipmAggregate()
+{
+}
+
+void ipmAggregate::configure(float seconds)
+{
+    _window = seconds;
+    for (int i = 0; i < 8; i++)
+    {
+        _win[i].n = 0;
+        _win[i].start = 0;
+    }
+}
+
+bool ipmAggregate::due(int index, double now)
+{
+    stats &w = _win[index];
+    return w.n > 0 and now >= w.start + _window;
+}
+
+void ipmAggregate::add(int index, const char *data, double now)
+{
+    const unsigned char *up = (const unsigned char *)data;
+    stats &w = _win[index];
+
+    if (w.start == 0)
+    {
+        w.start = now;
+    } else if (w.n == 0 and now >= w.start + _window) {
+        // Skip the windows with no responses
+        w.start += std::floor((now - w.start) / _window) * _window;
+    }
+    for (int k = 0; k < ipmFields::count(FRAME); k++)
+    {
+        const ipmField &f = ipmFields::field(FRAME, k);
+        uint32_t v = 0;
+        for (int b = 0; b < f.size; b++)
+        {
+            v |= (uint32_t)up[f.offset + b] << (8 * b);
+        }
+        if (w.n == 0)
+        {
+            w.min[k] = v;
+            w.max[k] = v;
+            w.sum[k] = 0;
+        }
+        if (v < w.min[k])
+        {
+            w.min[k] = v;
+        }
+        if (v > w.max[k])
+        {
+            w.max[k] = v;
+        }
+        w.sum[k] += v;
+        w.last[k] = v;
+    }
+    w.n++;
+}
+
+int ipmAggregate::format(int index, char *buf, int size, uint64_t mask)
+{
+    stats &w = _win[index];
+    int len = snprintf(buf, size, "MEASUREW,%x", w.n);
+    for (int k = 0; k < ipmFields::count(FRAME) && len < size; k++)
+    {
+        if (not (mask & (1ull << k)))
+        {
+            continue;
+        }
+        int width = ipmFields::field(FRAME, k).width;
+        len += snprintf(buf + len, size - len, ",%0*x,%0*x,%.2f,%0*x",
+            width, w.min[k], width, w.max[k], w.sum[k] / w.n, width,
+            w.last[k]);
+    }
+    if (len < size)
+    {
+        len += snprintf(buf + len, size - len, "\r\n");
+    }
+    w.n = 0;
+    w.start += _window;
+    return len;
+}
+
+void ipmAggregate::printSample(std::ostream &os, int id, float rate,
+    uint64_t mask, std::set<std::string> &seen)
+{
+    std::string format = "MEASUREW,%x";
+    for (int k = 0; k < ipmFields::count(FRAME); k++)
+    {
+        if (mask & (1ull << k))
+        {
+            format += ",%x,%x,%f,%x";
+        }
+    }
+
+    os << "        <sample id=\"" << id << "\" rate=\"" << rate <<
+        "\" scanfFormat=\"" << format << "\">\n";
+    os << "            <variable longname=\"MEASURE responses in window\" "
+        "name=\"MEASURECNT\" units=\"\"/>\n";
+    seen.insert("MEASURECNT");
+    for (int k = 0; k < ipmFields::count(FRAME); k++)
+    {
+        if (not (mask & (1ull << k)))
+        {
+            continue;
+        }
+        const ipmField &f = ipmFields::field(FRAME, k);
+        ipmFields::printVariable(os, f, "WMIN", "Window Minimum ");
+        ipmFields::printVariable(os, f, "WMAX", "Window Maximum ");
+        ipmFields::printVariable(os, f, "WAVG", "Window Mean ");
+        ipmFields::printVariable(os, f);
+        seen.insert(f.name);
+    }
+    os << "        </sample>\n";
+}
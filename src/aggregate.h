@@ -0,0 +1,82 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+#include <set>
+#include <string>
+
+#include "fields.h"
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+/**
+ * Windowed aggregation of MEASURE data. MEASURE can be polled much faster
+ * than it is published: every response is added to a window per address,
+ * and once per window the min, max, mean and last value of each field are
+ * published in one packet
+ *
+ *   MEASUREW,<n>,<FREQ min>,<FREQ max>,<FREQ mean>,<FREQ last>,...
+ *
+ * where n is the number of responses in the window. Values are in counts;
+ * min, max, last and n are hex and the mean is decimal. Statistics are
+ * kept incrementally in fixed arrays, so nothing is allocated per sample.
+ *
+ * Windows are back to back from an address's first response, so they are
+ * exactly one window long and packets come at the rate in the nidas XML.
+ * A window is published when the first response after it arrives, before
+ * that response is added to the next window.
+ */
+class ipmAggregate
+{
+
+public:
+
+    // Frame aggregated; index into ipmFields
+    static const int FRAME = 0;  // MEASURE
+
+    ipmAggregate();
+    ~ipmAggregate();
+
+    /* Set the window length (seconds) and clear all windows */
+    void configure(float seconds);
+    float window()   { return _window; }
+
+    /* True if an address index's window has ended by now (seconds) and
+     * has responses to publish */
+    bool due(int index, double now);
+    /* Add a MEASURE response from an address index at time now (seconds)
+     * to its window. Publish the window first if it's due. */
+    void add(int index, const char *data, double now);
+    /* Write the packet for a completed window with the fields in mask and
+     * start the next window. Returns the length of the string. */
+    int format(int index, char *buf, int size, uint64_t mask);
+    int count(int index)   { return _win[index].n; }
+
+    /* Write the nidas <sample> for the packet. Variables are named for the
+     * field with WMIN, WMAX and WAVG appended, and the field name for the
+     * last value. */
+    static void printSample(std::ostream &os, int id, float rate,
+        uint64_t mask, std::set<std::string> &seen);
+
+private:
+
+    static const int MAXFIELDS = 32;
+
+    struct stats
+    {
+        uint32_t min[MAXFIELDS];
+        uint32_t max[MAXFIELDS];
+        uint32_t last[MAXFIELDS];
+        double sum[MAXFIELDS];
+        int n;
+        double start;   // time the window started, 0 before any response
+    };
+
+    float _window;
+    stats _win[8];
+};
+
+#endif /* AGGREGATE_H */
@@ -19,6 +19,14 @@ ipmArgparse::ipmArgparse():_interactive(false)
     const char *undefAddr = "-1";
     setAddress(undefAddr);
     setCmd("");
+    for (int i = 0; i < 8; i++)
+    {
+        updateAddrRates(i, 0, 0, 0);  // use -m/-r rates by default
+    }
+    for (int q = 0; q < 3; q++)
+    {
+        _latency[q] = 30;  // ms; nominal iPM response latency
+    }
 }
 
 ipmArgparse::~ipmArgparse()
@@ -30,11 +38,14 @@ void ipmArgparse::Usage()
     std::cout <<
         "\nUsage:\n"
         "\t-D device\tiPM connection device (Default:/dev/ttyUSB0)\n"
-        "\t-m measurerate\tSTATUS & MEASURE collection rate (hz)\n"
+        "\t-m measurerate\tSTATUS & MEASURE collection rate (hz). This is\n"
+        "\t\t\t  also the base cycle rate of the query schedule\n"
         "\t-r recordperiod\tperiod of RECORD queries (minutes)\n"
-        "\t-b baudrate\tbaud rate (Default:57600)\n"
+        "\t-b baudrate\tbaud rate, any rate the serial driver supports,\n"
+        "\t\t\t  or auto to pick the fastest rate the iPM answers\n"
+        "\t\t\t  reliably (Default:57600)\n"
         "\t-n num_addr\tnumber of active addresses on iPM\n"
-        "\t-# addr,procqueries,port\n"
+        "\t-# addr,procqueries,port[,measurerate,statusrate,recordperiod]\n"
         "\t\t\t  - addr is the iPM address; a number 0 to n-1\n"
         "\t\t\t  - procqueries is an integer representing a 3-bit\n"
         "\t\t\t  boolean field indicating which query responses\n"
@@ -42,6 +53,9 @@ void ipmArgparse::Usage()
         "\t\t\t     3 (b’011) requests MEASURE+STATUS\n"
         "\t\t\t     5 (b’101) requests RECORD+STATUS\n"
         "\t\t\t  - port which to send the output UDP string\n"
+        "\t\t\t  - optional per-address MEASURE rate (hz), STATUS\n"
+        "\t\t\t  rate (hz) and RECORD period (minutes). 0 uses the\n"
+        "\t\t\t  -m/-r value. Rates can't exceed -m, the cycle rate\n"
         "\t-i \t\trun in interactive mode (optional)\n"
         "\t\t\t  - When in interactive mode only -D and -b are required\n"
         "\t\t\t  - Inclusion of -a and -c will send a single command\n"
@@ -56,6 +70,79 @@ void ipmArgparse::Usage()
         "\t\t\t  when in looping (non-interactive) mode (optional)\n"
         "\t-S \t\tConfigure serial port and exit. Must be run as\n"
         "\t\t\t  root\n"
+        "\t-P \t\tDry run: simulate the query schedule for the given\n"
+        "\t\t\t  addresses, rates and baud rate, print link\n"
+        "\t\t\t  utilization and cycle times, and exit. Does not\n"
+        "\t\t\t  open the iPM device (optional)\n"
+        "\t-L latency\tiPM response latency (ms) used to estimate query\n"
+        "\t\t\t  times; one value, or measure,status,record\n"
+        "\t\t\t  (Default:30)\n"
+        "\t-C \t\tSend one combined UDP packet per address per cycle\n"
+        "\t\t\t  holding every frame read that cycle, instead of one\n"
+        "\t\t\t  packet per query (optional)\n"
+        "\t-B \t\tSend binary UDP packets: a header with sequence\n"
+        "\t\t\t  number, sampling time, address and frame type,\n"
+        "\t\t\t  then the raw iPM data. Can't be used with -C\n"
+        "\t\t\t  (optional)\n"
+        "\t-s \t\tAdd the time the iPM sampled, estimated from the\n"
+        "\t\t\t  serial timing, to each frame after its name, eg\n"
+        "\t\t\t  MEASURE,<unix time>,... (optional)\n"
+        "\t-F xmlfile\tSend only the fields each address's nidas sensor\n"
+        "\t\t\t  in xmlfile reads (%x), dropping the fields it\n"
+        "\t\t\t  skips (%*x). Use -X to write the sensor\n"
+        "\t\t\t  definitions for the smaller packets (optional)\n"
+        "\t-E deadbands\tPublish a frame only when a field moves past its\n"
+        "\t\t\t  deadband, given as NAME=value in scaled units, eg\n"
+        "\t\t\t  FREQ=0.2,VRMSA=1. * sets every field. Fields\n"
+        "\t\t\t  default to 0, any change (optional)\n"
+        "\t-T heartbeat\tWith -E, publish at least every heartbeat\n"
+        "\t\t\t  seconds; 0 disables (Default:10)\n"
+        "\t-W window\tAggregate MEASURE over window seconds and send\n"
+        "\t\t\t  the min, max, mean and last value of each field\n"
+        "\t\t\t  once per window. MEASURE is polled at the address's\n"
+        "\t\t\t  MEASURE rate. Can't be used with -C or -B\n"
+        "\t\t\t  (optional)\n"
+        "\t-A limits\tRaise an address's MEASURE rate while its power\n"
+        "\t\t\t  is degraded, given as NAME=value: rate (hz,\n"
+        "\t\t\t  Default: the cycle rate), thd (%), vmin and vmax\n"
+        "\t\t\t  (V RMS) and hold, the seconds nominal before\n"
+        "\t\t\t  going back to the base rate (Default:10). POWEROK\n"
+        "\t\t\t  0 is always degraded, eg thd=5,vmin=105,vmax=125\n"
+        "\t\t\t  (optional)\n"
+        "\t-t pre,post,port\n"
+        "\t\t\t  On a new trip or caution flag in STATUS or a Power\n"
+        "\t\t\t  Down, Trip or Fail RECORD, poll the address every\n"
+        "\t\t\t  cycle for post seconds, then write the MEASURE and\n"
+        "\t\t\t  STATUS responses from pre seconds before to post\n"
+        "\t\t\t  seconds after the event to a file in /var/log/ads\n"
+        "\t\t\t  and to UDP port (optional)\n"
+        "\t-M name\t\tPublish the latest response of each frame from\n"
+        "\t\t\t  each address to POSIX shared memory name, eg\n"
+        "\t\t\t  /ipm, for local readers such as ipm_shm (optional)\n"
+        "\t-U path\t\tAnswer local queries for the latest and recent\n"
+        "\t\t\t  responses, health and query latency, and send\n"
+        "\t\t\t  one-off iPM commands, on Unix socket path\n"
+        "\t\t\t  (optional). With -i, send the interactive\n"
+        "\t\t\t  commands through the ipm_ctrl answering on\n"
+        "\t\t\t  path instead of opening the serial port\n"
+        "\t-O [addr:]port\tServe metrics for Prometheus on TCP port, as\n"
+        "\t\t\t  GET /metrics, which the -U socket also answers.\n"
+        "\t\t\t  Listens on loopback unless given the IPv4 addr\n"
+        "\t\t\t  to listen on, eg 0.0.0.0 for all (optional)\n"
+        "\t-R priority[,cpu]\n"
+        "\t\t\t  Real-time mode: run at SCHED_FIFO priority (1-99)\n"
+        "\t\t\t  with memory locked, optionally on one CPU, and\n"
+        "\t\t\t  wake at absolute cycle times. Parts not permitted\n"
+        "\t\t\t  without root are skipped (optional)\n"
+        "\t-J file\t\tAppend Chrome trace events of each command's\n"
+        "\t\t\t  phases, UDP sends and sleeps to file, for\n"
+        "\t\t\t  chrome://tracing or Perfetto (optional)\n"
+        "\t-I backend\tSerial I/O backend: uring, epoll or auto, the\n"
+        "\t\t\t  best available. uring falls back to epoll where\n"
+        "\t\t\t  io_uring isn't available (optional; Default:auto)\n"
+        "\t-X xmlfile\tWrite nidas sensor definitions matching the UDP\n"
+        "\t\t\t  packets for the given addresses, rates and -C\n"
+        "\t\t\t  setting to xmlfile, and exit (optional)\n"
         "\n"
         "Examples:\n"
         "\t./ipm_ctrl -i -a 2 -D /dev/ttyUSB0 -c RECORD?\n"
@@ -66,11 +153,19 @@ void ipmArgparse::Usage()
         "address 1 on \n\t    /dev/ttyUSB0 and output hex values\n"
         "\t./ipm_ctrl -i\n"
         "\t    Interactive, Start menu-based control of iPM\n"
+        "\t./ipm_ctrl -i -a 2 -c VER? -U /var/run/ipm.sock\n"
+        "\t    Interactive, Send VER? to iPM address 2 through the\n"
+        "\t    running ipm_ctrl answering on /var/run/ipm.sock\n"
         "\t./ipm_ctrl -m 1 -r 10 -n 2 -0 0,5,30101 -1 2,5,30102"
         " -D /dev/ttyUSB0\n\t    Launch full application with bus "
         "identification at two\n\t     addresses, initialization, "
         "periodic data queries and\n\t    transmission to network "
-        "IP port.\n\n";
+        "IP port.\n"
+        "\t./ipm_ctrl -m 5 -r 10 -n 2 -0 0,7,30101,5,1,10 -1 2,7,30102,1,1,0"
+        " -D /dev/ttyUSB0\n\t    As above, but address 0 sends MEASURE at "
+        "5 hz, STATUS at\n\t    1 hz and RECORD every 10 minutes, and "
+        "address 2 sends\n\t    MEASURE and STATUS at 1 hz and RECORD at "
+        "the -r period.\n\n";
 }
 
 void ipmArgparse::process(int argc, char *argv[])
@@ -89,8 +184,9 @@ void ipmArgparse::process(int argc, char *argv[])
 
     // Options between colons require an argument
     // Options after last colon do not.
-    while((opt = getopt(argc, argv, ":D:m:r:b:n:0:1:2:3:4:5:6:7:a:c:ivHedS"))
-           != -1)
+    while((opt = getopt(argc, argv,
+           ":D:m:r:b:n:0:1:2:3:4:5:6:7:a:c:L:X:F:E:T:W:t:A:M:U:O:I:R:J:"
+           "ivHedSPCBs")) != -1)
     {
         nopt++;
         switch(opt)
@@ -109,6 +205,12 @@ void ipmArgparse::process(int argc, char *argv[])
                 break;
             case 'b':  // Baud rate
                 b = true;
+                if (strcmp(optarg, "auto") != 0 and atoi(optarg) <= 0)
+                {
+                    std::cerr << "Baud rate " << optarg << " is invalid" <<
+                        std::endl;
+                    errflag++;
+                }
                 setBaud(optarg);
                 break;
             case 'n':  // Number of addresses in use on iPM
@@ -169,6 +271,101 @@ void ipmArgparse::process(int argc, char *argv[])
             case 'S': // Configure serial port
                 configureSerialPort();
                 exit(0);
+            case 'P': // Dry run the schedule
+                setDryRun();
+                break;
+            case 'C': // One combined packet per address per cycle
+                setCombined();
+                break;
+            case 'B': // Binary UDP packets
+                setBinary();
+                break;
+            case 's': // Time the iPM sampled in each frame
+                setSampleTime();
+                break;
+            case 'F': // Send only the fields read by a nidas XML file
+                setFieldsFile(optarg);
+                break;
+            case 'E': // Publish only on change
+                setDeadband(optarg);
+                break;
+            case 'T': // Heartbeat period when publishing on change (s)
+                if (atof(optarg) < 0)
+                {
+                    std::cerr << "Heartbeat " << optarg << " is invalid" <<
+                        std::endl;
+                    errflag++;
+                }
+                setHeartbeat(atof(optarg));
+                break;
+            case 'W': // MEASURE aggregation window (s)
+                if (atof(optarg) <= 0)
+                {
+                    std::cerr << "Window " << optarg << " is invalid" <<
+                        std::endl;
+                    errflag++;
+                }
+                setWindow(atof(optarg));
+                break;
+            case 'A': // Adaptive MEASURE rate
+                setPolicy(optarg);
+                break;
+            case 't': // Burst capture around power events
+                if (not setCapture(optarg))
+                {
+                    std::cerr << "Capture " << optarg << " is invalid. "
+                        "Expected pre,post,port" << std::endl;
+                    errflag++;
+                }
+                break;
+            case 'M': // Shared memory publication
+                if (optarg[0] != '/')
+                {
+                    std::cerr << "Shared memory name " << optarg <<
+                        " must start with /" << std::endl;
+                    errflag++;
+                }
+                setShmName(optarg);
+                break;
+            case 'U': // Local query API
+                setSocketPath(optarg);
+                break;
+            case 'O': // Prometheus metrics address and port
+                if (not setMetrics(optarg))
+                {
+                    std::cerr << "Metrics address " << optarg <<
+                        " is invalid" << std::endl;
+                    errflag++;
+                }
+                break;
+            case 'R': // Real-time mode
+                setRealtime(optarg);
+                break;
+            case 'J': // Trace of serial exchanges
+                setTraceFile(optarg);
+                break;
+            case 'I': // Serial I/O backend
+                if (strcmp(optarg, "auto") != 0 and
+                    strcmp(optarg, "uring") != 0 and
+                    strcmp(optarg, "epoll") != 0)
+                {
+                    std::cerr << "I/O backend " << optarg << " is invalid. "
+                        "Expected auto, uring or epoll" << std::endl;
+                    errflag++;
+                }
+                setIoBackend(optarg);
+                break;
+            case 'X': // Write nidas sample definitions
+                setXmlFile(optarg);
+                break;
+            case 'L': // iPM response latency (ms)
+                if (not setLatency(optarg))
+                {
+                    std::cout << optarg << " is not a valid latency" <<
+                        std::endl;
+                    errflag++;
+                }
+                break;
             case ':':
                 std::cerr << "option -" << char(optopt) <<
                     " needs a value" << std::endl;
@@ -195,16 +392,33 @@ void ipmArgparse::process(int argc, char *argv[])
         setScaleFlag(0);  // Turn off scaling
     }
 
+    if (Combined() and Binary())
+    {
+        std::cerr << "-C and -B can't be used together" << std::endl;
+        errflag++;
+    }
+    if (window() > 0 and (Combined() or Binary()))
+    {
+        std::cerr << "-W can't be used with -C or -B" << std::endl;
+        errflag++;
+    }
+
+    // A dry run or XML export doesn't touch the hardware, nor does an
+    // interactive session through a running ipm_ctrl (-i -U), so they can
+    // run as anyone.
+    bool offline = DryRun() or XmlFile() != NULL or
+        (Interactive() and SocketPath() != NULL);
+
     // On error, print the usage statement and exit
-    if (errflag or (geteuid() != 0 and
+    if (errflag or ((geteuid() != 0 or offline) and
         not i and (not nopt or not m or not r or not n)))
     {
         Usage();
         exit(1);
     }
 
-    // If running as root and included -S option, will exit before get here
-    if ((geteuid() == 0)) // Running as root
+    // If running as root and included -S option, will exit before get here.
+    if ((geteuid() == 0) and not offline) // Running as root
     {
         std::cout << "\n**** Running as root. If you are trying to configure "
             "****\n**** serial ports, please use the -S option          ****\n"
@@ -240,14 +454,89 @@ void ipmArgparse::configureSerialPort()
 #endif
 }
 
+// Parse latency as a single value in ms for all queries, or as
+// measure,status,record
+bool ipmArgparse::setLatency(char latency[])
+{
+    std::string s = (std::string)latency;
+    int ncomma = std::count(s.begin(), s.end(), ',');
+    if (ncomma == 0)
+    {
+        for (int q = 0; q < 3; q++)
+        {
+            _latency[q] = atof(latency);
+        }
+        return _latency[0] >= 0;
+    }
+    if (ncomma != 2)
+    {
+        return false;
+    }
+    char *ptr = strtok(latency, ",");
+    for (int q = 0; q < 3; q++)
+    {
+        if (ptr == NULL or atof(ptr) < 0)
+        {
+            return false;
+        }
+        _latency[q] = atof(ptr);
+        ptr = strtok(NULL, ",");
+    }
+    return true;
+}
+
+// Parse the burst capture spec, pre,post,port
+bool ipmArgparse::setCapture(const char spec[])
+{
+    float pre, post;
+    int port;
+    char extra;
+    if (sscanf(spec, "%f,%f,%d%c", &pre, &post, &port, &extra) != 3 or
+        pre < 0 or post <= 0 or port <= 0 or port > 65535)
+    {
+        return false;
+    }
+    _capturePre = pre;
+    _capturePost = post;
+    _capturePort = port;
+    return true;
+}
+
+// Parse the metrics listener, [addr:]port
+bool ipmArgparse::setMetrics(const char spec[])
+{
+    const char *colon = strrchr(spec, ':');
+    int port;
+    char extra;
+    if (sscanf(colon ? colon + 1 : spec, "%d%c", &port, &extra) != 1 or
+        port <= 0 or port > 65535)
+    {
+        return false;
+    }
+    if (colon)
+    {
+        size_t len = colon - spec;
+        if (len == 0 or len >= sizeof(_metricsAddr))
+        {
+            return false;
+        }
+        memcpy(_metricsAddr, spec, len);
+        _metricsAddr[len] = 0;
+    }
+    _metricsPort = port;
+    return true;
+}
+
 // Parse the addrInfo block from the command line
-// Block contains addr,procqueries,port
+// Block contains addr,procqueries,port and optionally
+// measurerate,statusrate,recordperiod
 bool ipmArgparse::parse_addrInfo(int i)
 {
     char *addrinfo = addrInfo(i);
     // Validate address info block with simple comma count
     std::string s = (std::string)addrinfo;
-    if (std::count(s.begin(), s.end(), ',') != 2)
+    int ncomma = std::count(s.begin(), s.end(), ',');
+    if (ncomma != 2 and ncomma != 5)
     {
         return false;
     }
@@ -276,5 +565,28 @@ bool ipmArgparse::parse_addrInfo(int i)
         std::cout << "addrport: " << Addrport(i) << std::endl;
     }
 
+    if (ncomma == 2)
+    {
+        updateAddrRates(i, 0, 0, 0);
+        return true;
+    }
+
+    float rate[3];
+    for (int j = 0; j < 3; j++)
+    {
+        ptr = strtok(NULL, ",");
+        if (ptr == NULL)
+        {
+            return false;
+        }
+        rate[j] = atof(ptr);
+    }
+    updateAddrRates(i, rate[0], rate[1], rate[2]);
+    if (Verbose())
+    {
+        std::cout << "rates: " << rate[0] << " hz, " << rate[1] << " hz, "
+            << rate[2] << " min" << std::endl;
+    }
+
     return true;
 }
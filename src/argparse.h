@@ -63,6 +63,16 @@ class ipmArgparse
         void updateAddrPort(int index, int adrp)
             { _addrport[index] = adrp; }
 
+        // Optional per-address rates; 0 means use the -m/-r default
+        float addrMeasureRate(int index)   { return _addrMeasureRate[index]; }
+        float addrStatusRate(int index)    { return _addrStatusRate[index]; }
+        float addrRecordPeriod(int index)  { return _addrRecordPeriod[index]; }
+        void updateAddrRates(int index, float mrate, float srate,
+            float rperiod)
+            { _addrMeasureRate[index] = mrate;
+              _addrStatusRate[index] = srate;
+              _addrRecordPeriod[index] = rperiod; }
+
         void setAddress(const char address[]) {_address = address; }
         const char* Address()                 { return _address; }
 
@@ -87,6 +97,74 @@ class ipmArgparse
         void setDebug() { _debug = true; }
         bool Debug()    { return _debug; };
 
+        void setDryRun() { _dryrun = true; }
+        bool DryRun()    { return _dryrun; }
+
+        void setCombined() { _combined = true; }
+        bool Combined()    { return _combined; }
+
+        void setBinary() { _binary = true; }
+        bool Binary()    { return _binary; }
+
+        void setSampleTime() { _sampleTime = true; }
+        bool SampleTime()    { return _sampleTime; }
+
+        void setFieldsFile(const char file[]) { _fieldsfile = file; }
+        const char* FieldsFile()              { return _fieldsfile; }
+
+        // Change-driven publishing: field deadbands and heartbeat (s)
+        void setDeadband(const char spec[]) { _deadband = spec; }
+        const char* Deadband()              { return _deadband; }
+        void setHeartbeat(float seconds)    { _heartbeat = seconds; }
+        float heartbeat()                   { return _heartbeat; }
+
+        // MEASURE aggregation window (s); 0 sends every response
+        void setWindow(float seconds)   { _window = seconds; }
+        float window()                  { return _window; }
+
+        // Shared memory segment name for local readers
+        void setShmName(const char name[])   { _shmName = name; }
+        const char* ShmName()                { return _shmName; }
+
+        // Unix socket for the local query API
+        void setSocketPath(const char path[])   { _socketPath = path; }
+        const char* SocketPath()                { return _socketPath; }
+
+        // Address and TCP port for Prometheus scrapes, [addr:]port; port
+        // 0 is off, and the address is loopback unless given
+        bool setMetrics(const char spec[]);
+        const char* metricsAddr()   { return _metricsAddr; }
+        int metricsPort()           { return _metricsPort; }
+
+        // Real-time mode: priority[,cpu]
+        void setRealtime(const char spec[])   { _realtime = spec; }
+        const char* Realtime()                { return _realtime; }
+
+        // Chrome trace event file
+        void setTraceFile(const char file[])   { _traceFile = file; }
+        const char* TraceFile()                { return _traceFile; }
+
+        // Serial I/O backend: auto, uring or epoll
+        void setIoBackend(const char name[])   { _ioBackend = name; }
+        const char* IoBackend()                { return _ioBackend; }
+
+        // Adaptive MEASURE rate limits, NAME=value,...
+        void setPolicy(const char spec[])   { _policy = spec; }
+        const char* Policy()                { return _policy; }
+
+        // Burst capture: pre,post (s) and destination port; port 0 is off
+        bool setCapture(const char spec[]);
+        float capturePre()    { return _capturePre; }
+        float capturePost()   { return _capturePost; }
+        int capturePort()     { return _capturePort; }
+
+        void setXmlFile(const char file[]) { _xmlfile = file; }
+        const char* XmlFile()              { return _xmlfile; }
+
+        // Estimated iPM response latency (ms) for MEASURE, STATUS, RECORD
+        bool setLatency(char latency[]);
+        float latency(int query)   { return _latency[query]; }
+
         void configureSerialPort();
 
         void Usage();
@@ -102,6 +180,9 @@ class ipmArgparse
         int _addr[8];
         int _procqueries[8];
         int _addrport[8];
+        float _addrMeasureRate[8];
+        float _addrStatusRate[8];
+        float _addrRecordPeriod[8];
         const char*  _address;
         const char* _cmd;
         bool _interactive;
@@ -110,6 +191,27 @@ class ipmArgparse
         int _scaleflag;
         bool _emulate;
         bool _debug;
+        bool _dryrun = false;
+        bool _combined = false;
+        bool _binary = false;
+        bool _sampleTime = false;
+        const char* _xmlfile = NULL;
+        const char* _fieldsfile = NULL;
+        const char* _deadband = NULL;
+        float _heartbeat = 10;
+        float _window = 0;
+        const char* _policy = NULL;
+        const char* _shmName = NULL;
+        const char* _socketPath = NULL;
+        char _metricsAddr[16] = "127.0.0.1";
+        int _metricsPort = 0;
+        const char* _ioBackend = "auto";
+        const char* _traceFile = NULL;
+        const char* _realtime = NULL;
+        float _capturePre = 0;
+        float _capturePost = 0;
+        int _capturePort = 0;
+        float _latency[3];
 
 };
 
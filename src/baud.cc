@@ -0,0 +1,118 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+// termios2 lives in the kernel headers, which can't be included together
+// with the libc <termios.h>, so this file uses the kernel definitions only.
+#ifdef __linux__
+    #include <sys/ioctl.h>
+    #include <asm/termbits.h>
+#else
+    #include <termios.h>
+#endif
+#include "baud.h"
+
+const int ipmBaud::candidates[] = {921600, 460800, 230400, 115200, 57600,
+    38400, 19200, 9600};
+const int ipmBaud::ncandidates = sizeof(candidates) / sizeof(candidates[0]);
+
+ipmBaud::ipmBaud()
+{
+}
+
+ipmBaud::~ipmBaud()
+{
+}
+
+uint_fast32_t ipmBaud::speed(int baud)
+{
+    switch (baud) {
+        case 50:      return B50;
+        case 75:      return B75;
+        case 110:     return B110;
+        case 134:     return B134;
+        case 150:     return B150;
+        case 200:     return B200;
+        case 300:     return B300;
+        case 600:     return B600;
+        case 1200:    return B1200;
+        case 1800:    return B1800;
+        case 2400:    return B2400;
+        case 4800:    return B4800;
+        case 9600:    return B9600;
+        case 19200:   return B19200;
+        case 38400:   return B38400;
+        case 57600:   return B57600;
+        case 115200:  return B115200;
+        case 230400:  return B230400;
+#ifdef B460800
+        case 460800:  return B460800;
+#endif
+#ifdef B500000
+        case 500000:  return B500000;
+#endif
+#ifdef B576000
+        case 576000:  return B576000;
+#endif
+#ifdef B921600
+        case 921600:  return B921600;
+#endif
+#ifdef B1000000
+        case 1000000: return B1000000;
+#endif
+#ifdef B1152000
+        case 1152000: return B1152000;
+#endif
+#ifdef B1500000
+        case 1500000: return B1500000;
+#endif
+#ifdef B2000000
+        case 2000000: return B2000000;
+#endif
+#ifdef B2500000
+        case 2500000: return B2500000;
+#endif
+#ifdef B3000000
+        case 3000000: return B3000000;
+#endif
+#ifdef B3500000
+        case 3500000: return B3500000;
+#endif
+#ifdef B4000000
+        case 4000000: return B4000000;
+#endif
+        default:
+            return 0;
+    }
+}
+
+bool ipmBaud::setCustom(int fd, int baud)
+{
+#if defined(__linux__) && defined(TCGETS2)
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) == -1)
+    {
+        return false;
+    }
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    if (ioctl(fd, TCSETS2, &tio) == -1)
+    {
+        return false;
+    }
+    // Drivers that can't hit the rate pick the nearest one they can, so
+    // read it back and allow 2% error, about what a UART tolerates.
+    if (ioctl(fd, TCGETS2, &tio) == -1)
+    {
+        return false;
+    }
+    long err = (long)tio.c_ospeed - baud;
+    return (err < 0 ? -err : err) * 50 <= baud;
+#else
+    std::cout << "Custom baud rates are only supported on linux" <<
+        std::endl;
+    return false;
+#endif
+}
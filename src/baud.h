@@ -0,0 +1,36 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+
+#ifndef BAUD_H
+#define BAUD_H
+
+/**
+ * Baud rate support for the iPM serial port. Standard rates map to termios
+ * speed constants. Other rates are set with a custom divisor through the
+ * Linux termios2 interface, on drivers that support it.
+ */
+class ipmBaud
+{
+
+public:
+
+    ipmBaud();
+    ~ipmBaud();
+
+    /* Return the termios speed constant for a baud rate, or 0 if the rate
+     * has no constant and needs a custom divisor */
+    static uint_fast32_t speed(int baud);
+    /* Set any baud rate on an open port with termios2 (Linux only).
+     * Returns false if the driver rejects the rate. */
+    static bool setCustom(int fd, int baud);
+
+    /* Rates tried by auto-detect, fastest first */
+    static const int candidates[];
+    static const int ncandidates;
+};
+
+#endif /* BAUD_H */
@@ -32,10 +32,11 @@ void ipmBitresult::parse(uint16_t *sp)
     bitresult.TEMP = sp[11];  // Temperature (0.1C)
 }
 
-void ipmBitresult::createUDP(char *buffer, int scaleflag)
+int ipmBitresult::createUDP(char *buffer, int scaleflag)
 {
     if (scaleflag >= 1) {
-        snprintf(buffer, 255, "BITRESULT,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,"
+        return snprintf(buffer, 255,
+             "BITRESULT,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,"
              "%.2f,%.2f,%.2f\r\n", (float) bitresult.bitStatus,
              (float) bitresult.hREFV, (float) bitresult.VREFV,
              (float) bitresult.FIVEV, (float) bitresult.FIVEVA,
@@ -44,7 +45,8 @@ void ipmBitresult::createUDP(char *buffer, int scaleflag)
              bitresult.TEMP * _deci);
              ;
     } else {
-        snprintf(buffer, 255, "BITRESULT,%04x,%04x,%04x,%04x,%04x,%04x,%04x,"
+        return snprintf(buffer, 255,
+             "BITRESULT,%04x,%04x,%04x,%04x,%04x,%04x,%04x,"
              "%04x,%04x,%04x\r\n", bitresult.bitStatus,
              bitresult.hREFV, bitresult.VREFV, bitresult.FIVEV,
              bitresult.FIVEVA, bitresult.RDV, bitresult.ITVA,
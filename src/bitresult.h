@@ -39,8 +39,8 @@ public:
 
     /* Parse response to the BITRESULT command into component variables */
     void parse(uint16_t *sp);
-    /* Build a comma delimited string */
-    void createUDP(char *buffer, int scaleflag);
+    /* Build a comma delimited string. Returns the length of the string. */
+    int createUDP(char *buffer, int scaleflag);
     /* Return temperature scaled to degrees C */
     float getTemperature();
 };
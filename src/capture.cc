@@ -0,0 +1,244 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "capture.h"
+#include "fields.h"
+#include "schedule.h"
+
+const int ipmCapture::RINGLEN;
+const int ipmCapture::DATALEN;
+
+namespace
+{
+    // Value of field k of a frame, from the little-endian iPM data
+    uint32_t value(const char *data, int frame, int k)
+    {
+        const unsigned char *up = (const unsigned char *)data;
+        const ipmField &f = ipmFields::field(frame, k);
+        uint32_t v = 0;
+        for (int b = 0; b < f.size; b++)
+        {
+            v |= (uint32_t)up[f.offset + b] << (8 * b);
+        }
+        return v;
+    }
+
+    // Field indices in ipmFields
+    const int TRIPFLAGS = 2;     // STATUS
+    const int CAUTIONFLAGS = 3;  // STATUS
+    const int EVTYPE = 0;        // RECORD
+    const int TIME = 3;          // RECORD, ms since power-up
+
+    // RECORD event types that trigger a capture
+    const char* eventName(uint32_t evtype)
+    {
+        switch (evtype)
+        {
+            case 2: return "Power Down";
+            case 5: return "Trip";
+            case 6: return "Fail";
+        }
+        return NULL;
+    }
+}
+
+ipmCapture::ipmCapture()
+{
+    configure(5, 5);
+    _captures = 0;
+    _ignored = 0;
+}
+
+ipmCapture::~ipmCapture()
+{
+}
+
+void ipmCapture::configure(float pre, float post)
+{
+    _pre = pre;
+    _post = post;
+    _head = 0;
+    _count = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        _statusValid[i] = false;
+        _recordValid[i] = false;
+        _active[i] = false;
+        _start[i] = 0;
+        _reason[i][0] = '\0';
+    }
+}
+
+float ipmCapture::reach(double rate, double burst)
+{
+    double left = RINGLEN - (rate + burst) * _post;
+    if (rate <= 0)
+    {
+        return left >= 0 ? _pre : 0;
+    }
+    return std::max(0.0, std::min((double)_pre, left / rate));
+}
+
+void ipmCapture::add(int index, int frame, const char *data, double now)
+{
+    int size = (frame == ipmSchedule::MEASURE) ? 34 : 12;
+    entry &e = _ring[(_head + _count) % RINGLEN];
+    if (_count == RINGLEN)
+    {
+        _head = (_head + 1) % RINGLEN;  // overwrite the oldest
+    } else {
+        _count++;
+    }
+    e.time = now;
+    e.index = index;
+    e.frame = frame;
+    memcpy(e.data, data, size);
+}
+
+const char* ipmCapture::trigger(int index, int frame, const char *data)
+{
+    if (frame == ipmSchedule::STATUS)
+    {
+        uint32_t trip = value(data, frame, TRIPFLAGS);
+        uint32_t caution = value(data, frame, CAUTIONFLAGS);
+        uint32_t newTrip = trip & ~_trip[index];
+        uint32_t newCaution = caution & ~_caution[index];
+        bool valid = _statusValid[index];
+        _trip[index] = trip;
+        _caution[index] = caution;
+        _statusValid[index] = true;
+        if (not valid or (newTrip == 0 and newCaution == 0))
+        {
+            return NULL;
+        }
+        snprintf(_reason[index], sizeof(_reason[index]),
+            "TRIPFLAGS %08x CAUTIONFLAGS %08x", trip, caution);
+        return _reason[index];
+    }
+
+    if (frame == ipmSchedule::RECORD)
+    {
+        // RECORD returns the latest event; a new one has a new time
+        uint32_t time = value(data, frame, TIME);
+        bool fresh = _recordValid[index] and time != _recordTime[index];
+        _recordTime[index] = time;
+        _recordValid[index] = true;
+        const char *name = eventName(value(data, frame, EVTYPE));
+        if (not fresh or name == NULL)
+        {
+            return NULL;
+        }
+        snprintf(_reason[index], sizeof(_reason[index]), "EVTYPE %s",
+            name);
+        return _reason[index];
+    }
+    return NULL;
+}
+
+bool ipmCapture::start(int index, double now, const char *reason)
+{
+    if (_active[index])
+    {
+        _ignored++;
+        return false;
+    }
+    if (reason != _reason[index])
+    {
+        snprintf(_reason[index], sizeof(_reason[index]), "%s", reason);
+    }
+    _active[index] = true;
+    _start[index] = now;
+    _captures++;
+    return true;
+}
+
+int ipmCapture::dump(int index, int addr, std::ostream &os, ipmUdp &udp,
+    int dest)
+{
+    char packet[ipmUdp::PKTLEN];
+    char line[256];
+    int plen = 0;
+    int n = 0;
+
+    char start[32];
+    snprintf(start, sizeof(start), "%.6f", _start[index]);
+    os << "# iPM address " << addr << " capture: " << _reason[index] <<
+        " at " << start << ", pre " << _pre << " s, post " << _post << " s"
+        << std::endl;
+
+    for (int j = 0; j < _count; j++)
+    {
+        const entry &e = _ring[(_head + j) % RINGLEN];
+        if (e.index != index or e.time < _start[index] - _pre or
+            e.time > _start[index] + _post)
+        {
+            continue;
+        }
+        int len = snprintf(line, sizeof(line), "CAPTURE,%d,", addr);
+        len += format(e, line + len, sizeof(line) - len);
+        len = std::min(len, (int)sizeof(line) - 1);
+        os.write(line, len - 2) << "\n";  // file lines end in \n only
+
+        // Pack lines into packets; flush before the queue fills
+        if (plen + len > (int)sizeof(packet))
+        {
+            udp.enqueue(packet, plen, dest);
+            plen = 0;
+            if (udp.depth() >= ipmUdp::QUEUELEN / 2)
+            {
+                udp.flush();
+            }
+        }
+        memcpy(packet + plen, line, len);
+        plen += len;
+        n++;
+    }
+    if (plen > 0)
+    {
+        udp.enqueue(packet, plen, dest);
+    }
+    udp.flush();
+
+    _active[index] = false;
+    return n;
+}
+
+int ipmCapture::history(int index, int frame, int n, std::ostream &os)
+{
+    // Find the oldest of the last n, then write forward from it
+    int first = _count;
+    int found = 0;
+    for (int j = _count - 1; j >= 0 and found < n; j--)
+    {
+        const entry &e = _ring[(_head + j) % RINGLEN];
+        if (e.index == index and e.frame == frame)
+        {
+            first = j;
+            found++;
+        }
+    }
+
+    char line[256];
+    for (int j = first; j < _count; j++)
+    {
+        const entry &e = _ring[(_head + j) % RINGLEN];
+        if (e.index == index and e.frame == frame)
+        {
+            int len = std::min(format(e, line, sizeof(line)),
+                (int)sizeof(line) - 1);
+            os.write(line, len - 2) << "\n";
+        }
+    }
+    return found;
+}
+
+int ipmCapture::format(const entry &e, char *buf, int size)
+{
+    int len = snprintf(buf, size, "%.6f,", e.time);
+    return len + ipmFields::format(buf + len, size - len, e.frame, e.data,
+        ipmFields::all(e.frame));
+}
@@ -0,0 +1,117 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+
+#include "udp.h"
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/**
+ * Burst capture around power events. Every MEASURE and STATUS response is
+ * kept in a preallocated ring. A capture is triggered for an address when
+ * STATUS shows TRIPFLAGS or CAUTIONFLAGS bits that weren't set in the
+ * previous STATUS, or when a new RECORD has an EVTYPE of Power Down, Trip or
+ * Fail. Once the post-trigger window has passed, the responses from the
+ * pre-trigger window to the end of the post-trigger window are dumped as
+ *
+ *   CAPTURE,<addr>,<time>,<frame>,<fields>...
+ *
+ * where time is seconds since 1970 and frame and fields are the hex frame
+ * as sent to nidas.
+ */
+class ipmCapture
+{
+
+public:
+
+    // Responses held, across all addresses
+    static const int RINGLEN = 4096;
+
+    ipmCapture();
+    ~ipmCapture();
+
+    /* Set the pre- and post-trigger windows (seconds) and clear the ring */
+    void configure(float pre, float post);
+    float pre()    { return _pre; }
+    float post()   { return _post; }
+    /* Seconds before the trigger that a capture can dump when responses
+     * are added at rate per second, and at burst more per second while
+     * it runs, since the ring must hold them until the post-trigger
+     * window ends. At most pre(). */
+    float reach(double rate, double burst);
+
+    /* Keep a MEASURE or STATUS response from an address index read at now
+     * (seconds since 1970) */
+    void add(int index, int frame, const char *data, double now);
+
+    /* Check a STATUS or RECORD response for a trigger. Returns a
+     * description of the event, or NULL. The first response of each kind
+     * from an address only sets the reference. */
+    const char* trigger(int index, int frame, const char *data);
+
+    /* Start a capture for an address triggered at now. Returns false if
+     * one is already running. */
+    bool start(int index, double now, const char *reason);
+    bool active(int index)   { return _active[index]; }
+    /* Return true when an active capture's post-trigger window is over */
+    bool done(int index, double now)
+        { return _active[index] and now >= _start[index] + _post; }
+    double started(int index)   { return _start[index]; }
+
+    /* Write the responses in an address's capture to os, one per line
+     * after a # comment line naming the event, and queue them to udp
+     * destination dest, packing as many lines per packet as fit. Ends
+     * the capture. Returns the number of responses. */
+    int dump(int index, int addr, std::ostream &os, ipmUdp &udp, int dest);
+
+    /* Write up to n of the latest responses of a frame from an address
+     * index to os, oldest first, as <time>,<frame>,<fields>... lines.
+     * Returns the number written. */
+    int history(int index, int frame, int n, std::ostream &os);
+
+    long captures()   { return _captures; }
+    long ignored()    { return _ignored; }
+
+private:
+
+    static const int DATALEN = 36;  // longest MEASURE/STATUS response
+
+    struct entry
+    {
+        double time;
+        int index;
+        int frame;
+        char data[DATALEN];
+    };
+
+    /* Write <time>,<frame>,<fields>... and \r\n for an entry. Returns
+     * the length. */
+    int format(const entry &e, char *buf, int size);
+
+    float _pre;
+    float _post;
+
+    // Oldest entry at _head
+    entry _ring[RINGLEN];
+    int _head;
+    int _count;
+
+    // Trigger references per address index
+    uint32_t _trip[8];
+    uint32_t _caution[8];
+    bool _statusValid[8];
+    uint32_t _recordTime[8];
+    bool _recordValid[8];
+    char _reason[8][64];
+
+    bool _active[8];
+    double _start[8];
+    long _captures;
+    long _ignored;   // triggers during a running capture
+};
+
+#endif /* CAPTURE_H */
@@ -0,0 +1,122 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include "client.h"
+
+ipmClient::ipmClient()
+{
+    _fd = -1;
+}
+
+ipmClient::~ipmClient()
+{
+    close();
+}
+
+bool ipmClient::connect(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    close();
+    _fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_fd < 0 or
+        ::connect(_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ipmClient::close()
+{
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+        _fd = -1;
+    }
+    _in.clear();
+}
+
+bool ipmClient::request(const std::string &line, std::string &reply,
+    int msec)
+{
+    reply.clear();
+    std::string req = line + "\n";
+    if (_fd < 0 or
+        send(_fd, req.data(), req.size(), MSG_NOSIGNAL) != (int)req.size())
+    {
+        reply = "not connected";
+        return false;
+    }
+
+    auto end = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(msec);
+    size_t start = 0;  // start of the line being looked at
+    while (true)
+    {
+        // The reply ends with an OK or ERR line
+        size_t nl;
+        while ((nl = _in.find('\n', start)) != std::string::npos)
+        {
+            std::string last = _in.substr(start, nl - start);
+            if (last == "OK" or last.compare(0, 4, "ERR ") == 0)
+            {
+                bool ok = (last == "OK");
+                reply = ok ? unquote(_in.substr(0, start)) : last;
+                _in.erase(0, nl + 1);
+                return ok;
+            }
+            start = nl + 1;
+        }
+
+        long left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - std::chrono::steady_clock::now()).count();
+        struct pollfd pfd = {_fd, POLLIN, 0};
+        if (left <= 0 or ::poll(&pfd, 1, left) <= 0)
+        {
+            reply = "no reply";
+            return false;
+        }
+        char buf[1024];
+        int n = recv(_fd, buf, sizeof(buf), 0);
+        if (n <= 0)
+        {
+            close();
+            reply = "connection closed";
+            return false;
+        }
+        _in.append(buf, n);
+    }
+}
+
+std::string ipmClient::unquote(const std::string &text)
+{
+    std::string out;
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t nl = text.find('\n', start);  // every line ends with one
+        if (text.compare(start, 2, "| ") == 0)
+        {
+            start += 2;
+        }
+        out.append(text, start, nl + 1 - start);
+        start = nl + 1;
+    }
+    return out;
+}
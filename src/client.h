@@ -0,0 +1,42 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <string>
+
+#ifndef CLIENT_H
+#define CLIENT_H
+
+/**
+ * Client for the ipm_ctrl query API (see server.h). Used by interactive
+ * sessions (ipm_ctrl -i -U path) to reach the iPM through a running
+ * ipm_ctrl instead of opening the serial port.
+ */
+class ipmClient
+{
+
+public:
+
+    ipmClient();
+    ~ipmClient();
+
+    /* Connect to the socket at path. Returns false on error. */
+    bool connect(const char *path);
+    void close();
+
+    /* Send a request and wait up to msec for the whole reply, which is
+     * returned without its final OK line or the "| " quoting SEND replies.
+     * Returns false, with the ERR line or a description of the failure in
+     * reply, on error. */
+    bool request(const std::string &line, std::string &reply, int msec);
+
+private:
+
+    /* Strip the "| " from the lines of a SEND reply */
+    static std::string unquote(const std::string &text);
+
+    int _fd;
+    std::string _in;   // received and not yet returned
+};
+
+#endif /* CLIENT_H */
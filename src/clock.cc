@@ -0,0 +1,209 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "clock.h"
+
+const int ipmClock::NPOINTS;
+const long ipmClock::MINSPAN;
+const int64_t ipmClock::NONE = INT64_MIN;
+
+namespace
+{
+    // Little-endian value of size bytes at offset in the RECORD data
+    uint32_t value(const char *data, int offset, int size)
+    {
+        const unsigned char *up = (const unsigned char *)data;
+        uint32_t v = 0;
+        for (int b = 0; b < size; b++)
+        {
+            v |= (uint32_t)up[offset + b] << (8 * b);
+        }
+        return v;
+    }
+
+    const double MAXDRIFT = 1e-3;  // anything more is bad data
+}
+
+ipmClock::ipmClock()
+{
+    for (int i = 0; i < 8; i++)
+    {
+        _model[i].seen = false;
+        _model[i].n = 0;
+        _model[i].head = 0;
+        _model[i].drift = 0;
+        _model[i].offLo = _model[i].offHi = NONE;
+    }
+}
+
+ipmClock::~ipmClock()
+{
+}
+
+const char* ipmClock::eventName(int evtype)
+{
+    switch (evtype)
+    {
+        case 1: return "Power Up";
+        case 2: return "Power Down";
+        case 3: return "Off";
+        case 4: return "Reset";
+        case 5: return "Trip";
+        case 6: return "Fail";
+        case 7: return "Output On";
+        case 8: return "Output Off";
+    }
+    return NULL;
+}
+
+bool ipmClock::record(int index, const char *data, int64_t sampled)
+{
+    model &m = _model[index];
+    int evtype = value(data, 0, 1);
+    uint32_t powercnt = value(data, 2, 4);
+    uint32_t time = value(data, 6, 4);
+
+    bool fresh = not m.seen or powercnt != m.powercnt or time != m.time;
+    if (not fresh)
+    {
+        m.polled = sampled;
+        return false;
+    }
+
+    if (m.n > 0 and (powercnt != m.powercnt or
+        time < m.points[(m.head + m.n - 1) % NPOINTS].time))
+    {
+        m.n = 0;  // power cycled
+        m.head = 0;
+    }
+    if (m.n == NPOINTS)
+    {
+        m.head = (m.head + 1) % NPOINTS;
+        m.n--;
+    }
+    point &p = m.points[(m.head + m.n++) % NPOINTS];
+    p.time = time;
+    p.lo = m.seen ? m.polled : NONE;  // the first may be any age
+    p.hi = sampled;
+
+    m.seen = true;
+    m.powercnt = powercnt;
+    m.time = time;
+    m.evtype = evtype;
+    m.polled = sampled;
+    fit(m);
+    return true;
+}
+
+void ipmClock::intersect(const model &m, double drift, int64_t &lo,
+    int64_t &hi)
+{
+    lo = hi = NONE;
+    for (int k = 0; k < m.n; k++)
+    {
+        const point &p = m.points[(m.head + k) % NPOINTS];
+        int64_t at = std::llround(p.time * 1000.0 * (1 + drift));
+        if (p.lo != NONE and (lo == NONE or p.lo - at > lo))
+        {
+            lo = p.lo - at;
+        }
+        if (hi == NONE or p.hi - at < hi)
+        {
+            hi = p.hi - at;
+        }
+    }
+}
+
+void ipmClock::fit(model &m)
+{
+    while (true)
+    {
+        // Drift: the one where the windows overlap most. The overlap is
+        // concave in the drift, so a ternary search finds it.
+        uint32_t span = m.points[(m.head + m.n - 1) % NPOINTS].time -
+            m.points[m.head].time;
+        m.drift = 0;
+        int64_t lo, hi;
+        if (span >= MINSPAN and m.points[m.head].lo != NONE)
+        {
+            double a = -MAXDRIFT, b = MAXDRIFT;
+            for (int k = 0; k < 100; k++)
+            {
+                double d1 = a + (b - a) / 3, d2 = b - (b - a) / 3;
+                intersect(m, d1, lo, hi);
+                int64_t w1 = hi - lo;
+                intersect(m, d2, lo, hi);
+                if (w1 < hi - lo)
+                {
+                    a = d1;
+                } else {
+                    b = d2;
+                }
+            }
+            m.drift = (a + b) / 2;
+        }
+
+        // Offset: the intersection of the windows
+        intersect(m, m.drift, m.offLo, m.offHi);
+        if (m.n == 1 or m.offLo == NONE or m.offLo <= m.offHi)
+        {
+            return;
+        }
+        m.head = (m.head + 1) % NPOINTS;  // inconsistent: drop the oldest
+        m.n--;
+    }
+}
+
+bool ipmClock::utc(int index, uint32_t time, int64_t &t, long &uncertainty)
+{
+    model &m = _model[index];
+    if (m.n == 0 or m.offLo == NONE)
+    {
+        return false;
+    }
+    if (m.offLo > m.offHi)  // one window left that disagrees with itself
+    {
+        return false;
+    }
+    int64_t offset = m.offLo + (m.offHi - m.offLo) / 2;
+    t = offset + std::llround(time * 1000.0 * (1 + m.drift));
+    uncertainty = (m.offHi - m.offLo) / 2;
+    return true;
+}
+
+void ipmClock::print(int index, std::ostream &os)
+{
+    model &m = _model[index];
+    if (not m.seen)
+    {
+        os << "RECORDS=0\n";
+        return;
+    }
+    char text[64];
+    int64_t t;
+    long uncertainty;
+    os << "POWERCNT=" << m.powercnt << "\n";
+    if (utc(index, 0, t, uncertainty))
+    {
+        snprintf(text, sizeof(text), "%.6f", t / 1e6);
+        os << "POWERUP=" << text << "\n" <<
+            "UNCERTAINTY=" << uncertainty << "\n";
+    }
+    snprintf(text, sizeof(text), "%.3f", drift(index));
+    os << "DRIFT=" << text << "\n" << "RECORDS=" << m.n << "\n";
+
+    const char *name = eventName(m.evtype);
+    os << "EVENT=" << (name ? name : "Periodic") << ",";
+    if (utc(index, m.time, t, uncertainty))
+    {
+        snprintf(text, sizeof(text), "%.6f", t / 1e6);
+        os << text;
+    } else {
+        os << "unknown";
+    }
+    os << "\n";
+}
@@ -0,0 +1,96 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+/**
+ * Map from each iPM's clock, the ms since power-up in RECORD TIME, to UTC.
+ *
+ * The iPM saves a record at every event (power up, trip, ...) and every 2
+ * or 10 minutes, and RECORD? returns the latest one. A record that wasn't
+ * there at the previous RECORD? was saved between the two, so its TIME
+ * happened between their sampling times. Each such window bounds the UTC
+ * of power-up, the offset:
+ *
+ *   utc = offset + TIME * (1 + drift)
+ *
+ * The offset is the intersection of the windows, corrected for drift, so
+ * it tightens as records fall at different points between RECORD?
+ * queries. Once the windows span MINSPAN of iPM time, the drift is the
+ * one at which they overlap most. If the windows stop overlapping, the
+ * oldest are dropped. A new POWERCNT, or TIME going backwards, starts
+ * over.
+ */
+class ipmClock
+{
+
+public:
+
+    static const int NPOINTS = 32;     // windows kept per address
+    static const long MINSPAN = 600000;  // ms of iPM time to fit drift
+    static const int64_t NONE;         // no bound
+
+    ipmClock();
+    ~ipmClock();
+
+    /* A RECORD response from address index, sampled at usec UTC. Returns
+     * true if the record is new. */
+    bool record(int index, const char *data, int64_t sampled);
+
+    /* UTC (usec since 1970-01-01) of iPM time (ms since power-up) at
+     * address index, and its uncertainty (usec). Returns false if there
+     * isn't an estimate yet. */
+    bool utc(int index, uint32_t time, int64_t &t, long &uncertainty);
+
+    // Latest record
+    uint32_t powercnt(int index)   { return _model[index].powercnt; }
+    uint32_t time(int index)       { return _model[index].time; }
+    int evtype(int index)          { return _model[index].evtype; }
+    /* Drift in parts per million */
+    double drift(int index)        { return _model[index].drift * 1e6; }
+    /* Windows in the fit */
+    int points(int index)          { return _model[index].n; }
+
+    /* Name of a RECORD event type, or NULL for a periodic record */
+    static const char* eventName(int evtype);
+    /* Print POWERCNT, POWERUP, UNCERTAINTY, DRIFT and RECORDS as
+     * NAME=value lines, and the latest record as EVENT=<type>,<utc> */
+    void print(int index, std::ostream &os);
+
+private:
+
+    struct point
+    {
+        uint32_t time;  // RECORD TIME (ms)
+        int64_t lo;     // UTC window (usec); lo is NONE if not known
+        int64_t hi;
+    };
+
+    struct model
+    {
+        bool seen;          // a RECORD has been read
+        uint32_t powercnt;
+        uint32_t time;      // TIME of the latest record
+        int evtype;
+        int64_t polled;     // sampling time of the latest RECORD?
+        point points[NPOINTS];
+        int head;           // oldest point
+        int n;
+        double drift;
+        int64_t offLo;      // bounds of the offset (usec)
+        int64_t offHi;
+    };
+
+    void fit(model &m);
+    /* Bounds of the offset at a drift */
+    void intersect(const model &m, double drift, int64_t &lo, int64_t &hi);
+
+    model _model[8];
+};
+
+#endif /* CLOCK_H */
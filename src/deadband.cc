@@ -0,0 +1,118 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "deadband.h"
+
+const int ipmDeadband::MAXFIELDS;
+
+ipmDeadband::ipmDeadband()
+{
+    for (int f = 0; f < ipmFields::NFRAMES; f++)
+    {
+        for (int k = 0; k < MAXFIELDS; k++)
+        {
+            _deadband[f][k] = 0;
+        }
+        for (int i = 0; i < 8; i++)
+        {
+            _valid[i][f] = false;
+            _lastTime[i][f] = 0;
+        }
+    }
+    _heartbeat = 10;
+    _published = 0;
+    _suppressed = 0;
+}
+
+ipmDeadband::~ipmDeadband()
+{
+}
+
+bool ipmDeadband::configure(const char *spec, std::string &error)
+{
+    std::stringstream ss(spec);
+    std::string entry;
+    while (std::getline(ss, entry, ','))
+    {
+        size_t eq = entry.find('=');
+        char *end = NULL;
+        float value = 0;
+        if (eq != std::string::npos)
+        {
+            value = strtof(entry.c_str() + eq + 1, &end);
+        }
+        if (eq == std::string::npos || end == NULL || *end != '\0' ||
+            end == entry.c_str() + eq + 1 || value < 0)
+        {
+            error = entry;
+            return false;
+        }
+
+        std::string name = entry.substr(0, eq);
+        bool found = false;
+        for (int f = 0; f < ipmFields::NFRAMES; f++)
+        {
+            for (int k = 0; k < ipmFields::count(f); k++)
+            {
+                // A name shared by frames, eg POWEROK, applies to all
+                if (name == "*" || name == ipmFields::field(f, k).name)
+                {
+                    _deadband[f][k] = value;
+                    found = true;
+                }
+            }
+        }
+        if (not found)
+        {
+            error = entry;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ipmDeadband::check(int index, int frame, const char *data,
+    uint64_t mask, double now)
+{
+    const unsigned char *up = (const unsigned char *)data;
+    uint32_t value[MAXFIELDS];
+    bool publish = not _valid[index][frame] ||
+        (_heartbeat > 0 && now - _lastTime[index][frame] >= _heartbeat);
+
+    for (int k = 0; k < ipmFields::count(frame); k++)
+    {
+        const ipmField &f = ipmFields::field(frame, k);
+        value[k] = 0;
+        for (int b = 0; b < f.size; b++)
+        {
+            value[k] |= (uint32_t)up[f.offset + b] << (8 * b);
+        }
+        if (publish || not (mask & (1ull << k)))
+        {
+            continue;
+        }
+        double change = std::fabs((double)value[k] -
+            (double)_last[index][frame][k]) * f.scale;
+        if (change > _deadband[frame][k])
+        {
+            publish = true;
+        }
+    }
+
+    if (not publish)
+    {
+        _suppressed++;
+        return false;
+    }
+    memcpy(_last[index][frame], value,
+        ipmFields::count(frame) * sizeof(uint32_t));
+    _lastTime[index][frame] = now;
+    _valid[index][frame] = true;
+    _published++;
+    return true;
+}
@@ -0,0 +1,65 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+#include <string>
+
+#include "fields.h"
+
+#ifndef DEADBAND_H
+#define DEADBAND_H
+
+/**
+ * Change-driven publishing. Each field has a deadband in its scaled units.
+ * A frame from an address is published only when a field sent moves past
+ * its deadband from the value last published, or when nothing has been
+ * published for the heartbeat period. Fields default to a deadband of 0,
+ * so any change is published.
+ */
+class ipmDeadband
+{
+
+public:
+
+    ipmDeadband();
+    ~ipmDeadband();
+
+    /* Set deadbands from a comma delimited list of NAME=value, where NAME
+     * is a field name from ipmFields, or * for every field. Later entries
+     * override earlier ones. Returns false and names the bad entry in
+     * error if an entry can't be parsed. */
+    bool configure(const char *spec, std::string &error);
+    float deadband(int frame, int k)   { return _deadband[frame][k]; }
+
+    /* Publish at least every seconds; 0 disables the heartbeat */
+    void setHeartbeat(float seconds)   { _heartbeat = seconds; }
+    float heartbeat()                  { return _heartbeat; }
+
+    /* Return true if a frame of binary data from an address index should
+     * be published, given the fields sent (bit 1 << field) and the time in
+     * seconds. A published frame becomes the reference for later frames. */
+    bool check(int index, int frame, const char *data, uint64_t mask,
+        double now);
+
+    long published()    { return _published; }
+    long suppressed()   { return _suppressed; }
+
+private:
+
+    static const int MAXFIELDS = 64;
+
+    float _deadband[ipmFields::NFRAMES][MAXFIELDS];
+    float _heartbeat;
+
+    // Last published values (counts) and time per address and frame
+    uint32_t _last[8][ipmFields::NFRAMES][MAXFIELDS];
+    double _lastTime[8][ipmFields::NFRAMES];
+    bool _valid[8][ipmFields::NFRAMES];
+
+    long _published;
+    long _suppressed;
+};
+
+#endif /* DEADBAND_H */
@@ -0,0 +1,449 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "fields.h"
+
+namespace
+{
+    // Fields in the order createUDP writes them in hex mode, with their
+    // byte offset and size in the binary response, hex digits written and
+    // scale from counts to units
+    const ipmField measureFields[] = {
+        {"FREQ", "AC Power Frequency", "Hz", "FREQ_IPM.dat",
+            0, 2, 4, 0.1},
+        {"TEMP", "iPM Temperature", "0.1 degC", "",
+            4, 2, 4, 0.1},
+        {"VRMSA", "AC Voltage, RMS Phase A", "V", "VRMS_IPM.dat",
+            6, 2, 4, 0.1},
+        {"VRMSB", "AC Voltage, RMS Phase B", "V", "VRMS_IPM.dat",
+            8, 2, 4, 0.1},
+        {"VRMSC", "AC Voltage, RMS Phase C", "V", "VRMS_IPM.dat",
+            10, 2, 4, 0.1},
+        {"VPKA", "AC Voltage, Peak Phase A", "V", "VPK_IPM.dat",
+            12, 2, 4, 0.1},
+        {"VPKB", "AC Voltage, Peak Phase B", "V", "VPK_IPM.dat",
+            14, 2, 4, 0.1},
+        {"VPKC", "AC Voltage, Peak Phase C", "V", "VPK_IPM.dat",
+            16, 2, 4, 0.1},
+        {"VDCA", "AC Voltage, DC Component Phase A", "V", "VDC_IPM.dat",
+            18, 2, 4, 0.001},
+        {"VDCB", "AC Voltage, DC Component Phase B", "V", "VDC_IPM.dat",
+            20, 2, 4, 0.001},
+        {"VDCC", "AC Voltage, DC Component Phase C", "V", "VDC_IPM.dat",
+            22, 2, 4, 0.001},
+        {"PHA", "AC Phase Angle Phase A", "degree", "PH_IPM.dat",
+            24, 2, 4, 0.1},
+        {"PHB", "AC Phase Angle Phase B", "degree", "PH_IPM.dat",
+            26, 2, 4, 0.1},
+        {"PHC", "AC Phase Angle Phase C", "degree", "PH_IPM.dat",
+            28, 2, 4, 0.1},
+        {"THDA", "AC Voltage THD Phase A", "%", "THD_IPM.dat",
+            30, 1, 2, 0.1},
+        {"THDB", "AC Voltage THD Phase B", "%", "THD_IPM.dat",
+            31, 1, 2, 0.1},
+        {"THDC", "AC Voltage THD Phase C", "%", "THD_IPM.dat",
+            32, 1, 2, 0.1},
+        {"POWEROK", "Power OK", "", "",
+            33, 1, 2, 1},
+    };
+
+    const ipmField statusFields[] = {
+        {"OPSTATE", "Operational State", "", "",
+            0, 1, 2, 1},
+        {"POWEROK", "Power OK", "", "",
+            1, 1, 2, 1},
+        {"TRIPFLAGS", "Power Trip Flags, performance exceeds limits", "", "",
+            2, 4, 4, 1},
+        {"CAUTIONFLAGS", "Power Caution Flags, marginal performance", "", "",
+            6, 4, 4, 1},
+        {"BITSTAT", "Built-in Test Status", "", "",
+            10, 2, 4, 1},
+    };
+
+    const ipmField recordFields[] = {
+        {"EVTYPE", "Event Type", "", "",
+            0, 1, 2, 1},
+        {"OPSTATE", "Operational State", "", "",
+            1, 1, 2, 1},
+        {"POWERCNT", "Power Cycle Count", "", "",
+            2, 4, 8, 1},
+        {"TIME", "Elapsed Time since power-up", "ms", "",
+            6, 4, 8, 1},
+        {"TFLAG", "Power Trip Flags", "", "",
+            10, 4, 8, 1},
+        {"CFLAG", "Power Caution Flags", "", "",
+            14, 4, 8, 1},
+        {"VRMSMINA", "Minimum AC Voltage, RMS Phase A", "V", "VRMS_IPM.dat",
+            18, 2, 4, 0.1},
+        {"VRMSMAXA", "Maximum AC Voltage, RMS Phase A", "V", "VRMS_IPM.dat",
+            20, 2, 4, 0.1},
+        {"VRMSMINB", "Minimum AC Voltage, RMS Phase B", "V", "VRMS_IPM.dat",
+            22, 2, 4, 0.1},
+        {"VRMSMAXB", "Maximum AC Voltage, RMS Phase B", "V", "VRMS_IPM.dat",
+            24, 2, 4, 0.1},
+        {"VRMSMINC", "Minimum AC Voltage, RMS Phase C", "V", "VRMS_IPM.dat",
+            26, 2, 4, 0.1},
+        {"VRMSMAXC", "Maximum AC Voltage, RMS Phase C", "V", "VRMS_IPM.dat",
+            28, 2, 4, 0.1},
+        {"FREQMIN", "Minimum AC Power Frequency", "Hz", "FREQ_IPM.dat",
+            30, 2, 4, 0.1},
+        {"FREQMAX", "Maximum AC Power Frequency", "Hz", "FREQ_IPM.dat",
+            32, 2, 4, 0.1},
+        {"VDCMINA", "Minimum AC Voltage, DC Component Phase A",
+            "V", "VDC_IPM.dat",
+            34, 2, 4, 0.001},
+        {"VDCMAXA", "Maximum AC Voltage, DC Component Phase A",
+            "V", "VDC_IPM.dat",
+            36, 2, 4, 0.001},
+        {"VDCMINB", "Minimum AC Voltage, DC Component Phase B",
+            "V", "VDC_IPM.dat",
+            38, 2, 4, 0.001},
+        {"VDCMAXB", "Maximum AC Voltage, DC Component Phase B",
+            "V", "VDC_IPM.dat",
+            40, 2, 4, 0.001},
+        {"VDCMINC", "Minimum AC Voltage, DC Component Phase C",
+            "V", "VDC_IPM.dat",
+            42, 2, 4, 0.001},
+        {"VDCMAXC", "Maximum AC Voltage, DC Component Phase C",
+            "V", "VDC_IPM.dat",
+            44, 2, 4, 0.001},
+        {"THDMINA", "Minimum AC Voltage THD Phase A", "%", "THD_IPM.dat",
+            46, 1, 2, 0.1},
+        {"THDMAXA", "Maximum AC Voltage THD Phase A", "%", "THD_IPM.dat",
+            47, 1, 2, 0.1},
+        {"THDMINB", "Minimum AC Voltage THD Phase B", "%", "THD_IPM.dat",
+            48, 1, 2, 0.1},
+        {"THDMAXB", "Maximum AC Voltage THD Phase B", "%", "THD_IPM.dat",
+            49, 1, 2, 0.1},
+        {"THDMINC", "Minimum AC Voltage THD Phase C", "%", "THD_IPM.dat",
+            50, 1, 2, 0.1},
+        {"THDMAXC", "Maximum AC Voltage THD Phase C", "%", "THD_IPM.dat",
+            51, 1, 2, 0.1},
+        {"VPKMINA", "Minimum AC Voltage, Peak Phase A", "V", "VPK_IPM.dat",
+            52, 2, 4, 0.1},
+        {"VPKMAXA", "Maximum AC Voltage, Peak Phase A", "V", "VPK_IPM.dat",
+            54, 2, 4, 0.1},
+        {"VPKMINB", "Minimum AC Voltage, Peak Phase B", "V", "VPK_IPM.dat",
+            56, 2, 4, 0.1},
+        {"VPKMAXB", "Maximum AC Voltage, Peak Phase B", "V", "VPK_IPM.dat",
+            58, 2, 4, 0.1},
+        {"VPKMINC", "Minimum AC Voltage, Peak Phase C", "V", "VPK_IPM.dat",
+            60, 2, 4, 0.1},
+        {"VPKMAXC", "Maximum AC Voltage, Peak Phase C", "V", "VPK_IPM.dat",
+            62, 2, 4, 0.1},
+        {"CRC", "Record CRC", "", "",
+            64, 4, 8, 1},
+    };
+
+    const ipmField *tables[] = {measureFields, statusFields, recordFields};
+    const int counts[] = {
+        sizeof(measureFields) / sizeof(ipmField),
+        sizeof(statusFields) / sizeof(ipmField),
+        sizeof(recordFields) / sizeof(ipmField),
+    };
+    const char *prefixes[] = {"MEASURE", "STATUS", "RECORD"};
+
+    const char *calpath = "${TMP_PROJ_DIR}/Configuration/cal_files/"
+        "Instruments/IPM:${PROJ_DIR}/Configuration/cal_files/Instruments/IPM";
+}
+
+const int ipmFields::NFRAMES;
+
+ipmFields::ipmFields()
+{
+}
+
+ipmFields::~ipmFields()
+{
+}
+
+int ipmFields::count(int frame)
+{
+    return counts[frame];
+}
+
+const ipmField& ipmFields::field(int frame, int k)
+{
+    return tables[frame][k];
+}
+
+const char* ipmFields::prefix(int frame)
+{
+    return prefixes[frame];
+}
+
+uint64_t ipmFields::all(int frame)
+{
+    return (count(frame) >= 64) ? ~0ull : (1ull << count(frame)) - 1;
+}
+
+uint32_t ipmFields::value(int frame, int k, const char *data)
+{
+    const unsigned char *up = (const unsigned char *)data;
+    const ipmField &f = field(frame, k);
+    uint32_t v = 0;
+    for (int b = 0; b < f.size; b++)
+    {
+        v |= (uint32_t)up[f.offset + b] << (8 * b);
+    }
+    return v;
+}
+
+int ipmFields::format(char *buf, int size, int frame, const char *data,
+    uint64_t mask)
+{
+    const unsigned char *up = (const unsigned char *)data;
+    int len = snprintf(buf, size, "%s", prefix(frame));
+    for (int k = 0; k < count(frame) && len < size; k++)
+    {
+        if (not (mask & (1ull << k)))
+        {
+            continue;
+        }
+        const ipmField &f = field(frame, k);
+        unsigned long v = 0;
+        for (int b = 0; b < f.size; b++)
+        {
+            v |= (unsigned long)up[f.offset + b] << (8 * b);
+        }
+        len += snprintf(buf + len, size - len, ",%0*lx", f.width, v);
+    }
+    if (len < size)
+    {
+        len += snprintf(buf + len, size - len, "\r\n");
+    }
+    return len;
+}
+
+bool ipmFields::parseFormat(const std::string &format, int &frame,
+    uint64_t &mask)
+{
+    frame = -1;
+    for (int f = 0; f < NFRAMES; f++)
+    {
+        std::string p = std::string(prefix(f)) + ",";
+        if (format.compare(0, p.length(), p) == 0)
+        {
+            frame = f;
+        }
+    }
+    if (frame < 0)
+    {
+        return false;
+    }
+
+    // One conversion per comma-delimited field after the prefix. Fields
+    // past the last conversion aren't read; conversions past the last
+    // field never match anything.
+    std::stringstream ss(format.substr(strlen(prefix(frame)) + 1));
+    std::string conv;
+    mask = 0;
+    if (format.compare(strlen(prefix(frame)), 4, ",%*f") == 0)
+    {
+        std::getline(ss, conv, ',');  // sampling time
+    }
+    for (int k = 0; k < count(frame) && std::getline(ss, conv, ','); k++)
+    {
+        if (conv.compare(0, 2, "%*") != 0)
+        {
+            mask |= 1ull << k;
+        }
+    }
+    return true;
+}
+
+namespace
+{
+    // Value of attribute name in an XML start tag, or ""
+    std::string attribute(const std::string &tag, const std::string &name)
+    {
+        std::string key = " " + name + "=\"";
+        size_t start = tag.find(key);
+        if (start == std::string::npos)
+        {
+            return "";
+        }
+        start += key.length();
+        return tag.substr(start, tag.find('"', start) - start);
+    }
+
+    // Sensor elements of a nidas XML file: start tag and body
+    struct sensor
+    {
+        std::string tag;
+        std::string body;
+    };
+
+    std::vector<sensor> sensors(const std::string &xml)
+    {
+        std::vector<sensor> list;
+        size_t pos = 0;
+        while ((pos = xml.find("<sensor ", pos)) != std::string::npos)
+        {
+            size_t end = xml.find('>', pos);
+            if (end == std::string::npos)
+            {
+                break;
+            }
+            sensor s;
+            s.tag = xml.substr(pos, end - pos);
+            pos = end + 1;
+            if (s.tag.back() != '/')
+            {
+                size_t close = xml.find("</sensor>", pos);
+                if (close == std::string::npos)
+                {
+                    break;
+                }
+                s.body = xml.substr(pos, close - pos);
+                pos = close;
+            }
+            list.push_back(s);
+        }
+        return list;
+    }
+}
+
+int ipmFields::readXml(const char *file, int port, uint64_t *masks)
+{
+    std::ifstream in(file);
+    if (not in)
+    {
+        return -1;
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::vector<sensor> list = sensors(ss.str());
+
+    // The last sensor to read the port wins, so a dsm entry overrides the
+    // catalog entry it refers to
+    const sensor *match = NULL;
+    std::string device = "usock::" + std::to_string(port);
+    for (auto &s : list)
+    {
+        if (attribute(s.tag, "devicename") == device)
+        {
+            match = &s;
+        }
+    }
+    if (match == NULL)
+    {
+        return 0;
+    }
+    std::string body = match->body;
+    std::string idref = attribute(match->tag, "IDREF");
+    if (body.empty() && not idref.empty())
+    {
+        for (auto &s : list)
+        {
+            if (attribute(s.tag, "ID") == idref)
+            {
+                body = s.body;
+            }
+        }
+    }
+
+    int found = 0;
+    size_t pos = 0;
+    while ((pos = body.find("<sample ", pos)) != std::string::npos)
+    {
+        std::string tag = body.substr(pos, body.find('>', pos) - pos);
+        pos += tag.length();
+        int frame;
+        uint64_t mask;
+        if (parseFormat(attribute(tag, "scanfFormat"), frame, mask))
+        {
+            masks[frame] = mask;
+            found |= 1 << frame;
+        }
+    }
+    return found;
+}
+
+void ipmFields::printVariable(std::ostream &os, const ipmField &f,
+    const char *suffix, const char *prefix)
+{
+    os << "            <variable longname=\"" << prefix << f.longname <<
+        "\" name=\"" << f.name << suffix << "\" units=\"" << f.units << "\"";
+    if (f.calfile[0] == '\0')
+    {
+        os << "/>\n";
+        return;
+    }
+    os << ">\n"
+        "                <poly units=\"" << f.units << "\">\n"
+        "                    <calfile file=\"" << f.calfile << "\" path=\"" <<
+        calpath << "\"/>\n"
+        "                </poly>\n"
+        "            </variable>\n";
+}
+
+void ipmFields::printSample(std::ostream &os, int id, float rate, int frames,
+    bool combined, std::set<std::string> &seen, const uint64_t *masks,
+    bool stamped)
+{
+    std::string format;
+    std::set<std::string> read;
+
+    // The cycle header is CYCLE,<unix time>,<mask of frames in the packet>
+    if (combined)
+    {
+        format = "CYCLE,%*f,%x";
+    }
+    for (int f = 0; f < NFRAMES; f++)
+    {
+        if (not (frames & (1 << f)))
+        {
+            continue;
+        }
+        if (not format.empty())
+        {
+            format += ",";
+        }
+        format += prefix(f);
+        if (stamped)
+        {
+            format += ",%*f";
+        }
+        for (int k = 0; k < count(f); k++)
+        {
+            if (not (masks[f] & (1ull << k)))
+            {
+                continue;  // not in the packet
+            }
+            const char *name = field(f, k).name;
+            bool first = not seen.count(name) and read.insert(name).second;
+            format += first ? ",%x" : ",%*x";
+        }
+    }
+
+    os << "        <sample id=\"" << id << "\" rate=\"" << rate <<
+        "\" scanfFormat=\"" << format << "\">\n";
+    if (combined)
+    {
+        os << "            <variable longname=\"Frames updated this cycle, "
+            "procqueries bits\" name=\"CYCLEMASK\" units=\"\"/>\n";
+    }
+    for (int f = 0; f < NFRAMES; f++)
+    {
+        if (not (frames & (1 << f)))
+        {
+            continue;
+        }
+        for (int k = 0; k < count(f); k++)
+        {
+            if (read.count(field(f, k).name) and
+                seen.insert(field(f, k).name).second)
+            {
+                printVariable(os, field(f, k));
+            }
+        }
+    }
+    os << "        </sample>\n";
+}
@@ -0,0 +1,90 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <set>
+
+#ifndef FIELDS_H
+#define FIELDS_H
+
+/**
+ * Description of one field of a hex UDP packet, as nidas sees it
+ */
+struct ipmField
+{
+    const char *name;      // nidas variable name
+    const char *longname;
+    const char *units;
+    const char *calfile;   // calibration file, or "" if not calibrated
+    int offset;            // byte offset in the binary response
+    int size;              // bytes, little-endian
+    int width;             // hex digits written
+    float scale;           // units per count, as createUDP scales it
+};
+
+/**
+ * Table of the fields each query writes to its hex UDP packet, in packet
+ * order, and a generator for the matching nidas sample definitions.
+ * Frames are indexed by ipmSchedule query: MEASURE, STATUS, RECORD.
+ */
+class ipmFields
+{
+
+public:
+
+    ipmFields();
+    ~ipmFields();
+
+    static const int NFRAMES = 3;
+
+    /* Return the number of fields in a frame, not counting the prefix */
+    static int count(int frame);
+    /* Return field k of a frame */
+    static const ipmField& field(int frame, int k);
+    /* Return the packet prefix of a frame, eg "MEASURE" */
+    static const char* prefix(int frame);
+    /* Return a field mask (bit 1 << field) with every field of a frame */
+    static uint64_t all(int frame);
+    /* Return the raw value (counts) of field k from a binary response */
+    static uint32_t value(int frame, int k, const char *data);
+
+    /* Field projection */
+    /* Write the hex packet for a frame straight from the binary response,
+     * decoding and writing only the fields in mask. With every field
+     * selected this is the string createUDP writes in hex mode. Returns
+     * the length of the string. */
+    static int format(char *buf, int size, int frame, const char *data,
+        uint64_t mask);
+    /* Get the frame and field mask of a nidas scanfFormat for a per-query
+     * packet: fields read with %x are selected, and fields skipped with %*x
+     * or past the end of the format are not. A sampling time (-s), skipped
+     * with %*f after the frame name, isn't a field. Returns false if the
+     * format isn't for an iPM frame. */
+    static bool parseFormat(const std::string &format, int &frame,
+        uint64_t &mask);
+    /* Set field masks from the samples of the sensor that reads port in a
+     * nidas XML file. Sensors that refer to a catalog sensor with IDREF use
+     * its samples. Frames not found are left unchanged. Returns a bit
+     * (1 << frame) for each frame found, or -1 if the file can't be read. */
+    static int readXml(const char *file, int port, uint64_t *masks);
+
+    /* Write a nidas <sample> for a packet holding the frames set in
+     * frames (bit 1 << frame). A combined packet starts with the cycle
+     * header written by ipm_ctrl -C. Variable names must be unique within
+     * a sensor, so fields already in seen are skipped and the names read
+     * are added to seen. Only the fields in masks[frame] are in the
+     * packet. With stamped, each frame name is followed by the sampling
+     * time written by ipm_ctrl -s, which is skipped. */
+    static void printSample(std::ostream &os, int id, float rate, int frames,
+        bool combined, std::set<std::string> &seen, const uint64_t *masks,
+        bool stamped = false);
+    /* Write a nidas <variable> for a field. suffix is appended to its name
+     * and prefix is put in front of its long name. */
+    static void printVariable(std::ostream &os, const ipmField &f,
+        const char *suffix = "", const char *prefix = "");
+};
+
+#endif /* FIELDS_H */
@@ -0,0 +1,111 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <cmath>
+#include "histogram.h"
+
+const int ipmHistogram::NBUCKETS;
+
+ipmHistogram::ipmHistogram()
+{
+    reset();
+}
+
+ipmHistogram::~ipmHistogram()
+{
+}
+
+namespace
+{
+    const std::memory_order relaxed = std::memory_order_relaxed;
+
+    // Only the one writer changes a count, so it doesn't need an atomic
+    // read-modify-write
+    template <typename T> void store(std::atomic<T> &a, T v)
+    {
+        a.store(v, relaxed);
+    }
+}
+
+void ipmHistogram::reset()
+{
+    for (int b = 0; b < NBUCKETS; b++)
+    {
+        store<uint64_t>(_bucket[b], 0);
+    }
+    store<uint64_t>(_count, 0);
+    store<uint64_t>(_sum, 0);
+    store<long>(_min, 0);
+    store<long>(_max, 0);
+}
+
+void ipmHistogram::add(long usec)
+{
+    if (usec < 0)
+    {
+        usec = 0;
+    }
+    int b = 0;
+    while (b < NBUCKETS - 1 and usec >= bound(b))
+    {
+        b++;
+    }
+    uint64_t n = count();
+    store(_bucket[b], bucket(b) + 1);
+    store(_min, (n == 0 or usec < min()) ? usec : min());
+    store(_max, (usec > max()) ? usec : max());
+    store(_sum, sum() + usec);
+    store(_count, n + 1);
+}
+
+double ipmHistogram::mean()
+{
+    uint64_t n = count();
+    return n ? (double)sum() / n : 0;
+}
+
+long ipmHistogram::percentile(double p)
+{
+    uint64_t n = count();
+    if (n == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)std::ceil(p / 100 * n);  // nearest rank
+    uint64_t seen = 0;
+    for (int b = 0; b < NBUCKETS - 1; b++)
+    {
+        seen += bucket(b);
+        if (seen >= rank and seen > 0)
+        {
+            return bound(b) < max() ? bound(b) : max();
+        }
+    }
+    return max();
+}
+
+void ipmHistogram::summary(std::ostream &os)
+{
+    os << "n=" << count() << " min=" << min() << " mean=" << (long)mean() <<
+        " p50=" << percentile(50) << " p99=" << percentile(99) << " max=" <<
+        max() << " us";
+}
+
+void ipmHistogram::print(std::ostream &os)
+{
+    for (int b = 0; b < NBUCKETS; b++)
+    {
+        if (bucket(b) == 0)
+        {
+            continue;
+        }
+        if (b == NBUCKETS - 1)
+        {
+            os << ">=" << bound(b - 1);
+        } else {
+            os << "<" << bound(b);
+        }
+        os << " " << bucket(b) << "\n";
+    }
+}
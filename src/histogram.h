@@ -0,0 +1,61 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <atomic>
+#include <iostream>
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+/**
+ * Histogram of times in usec, in power of two buckets: bucket 0 counts
+ * times under 1 us, bucket b times from 2^(b-1) up to 2^b us, and the last
+ * bucket everything from 2^20 us (about 1 s) up. Fixed size, so adding a
+ * time never allocates.
+ *
+ * Lock-free for one writer: the counts are relaxed atomics, so another
+ * thread can read them at any time without stalling add(). A reader may
+ * see a time in the count but not yet in its bucket.
+ */
+class ipmHistogram
+{
+
+public:
+
+    static const int NBUCKETS = 22;
+
+    ipmHistogram();
+    ~ipmHistogram();
+
+    void add(long usec);
+    void reset();
+
+    uint64_t count()   { return _count.load(std::memory_order_relaxed); }
+    long min()         { return _min.load(std::memory_order_relaxed); }
+    long max()         { return _max.load(std::memory_order_relaxed); }
+    uint64_t sum()     { return _sum.load(std::memory_order_relaxed); }
+    double mean();
+    uint64_t bucket(int b)
+        { return _bucket[b].load(std::memory_order_relaxed); }
+    /* Upper bound (usec) of bucket b */
+    static long bound(int b)  { return 1L << b; }
+    /* Upper bound (usec) of the bucket holding percentile p (0-100) */
+    long percentile(double p);
+
+    /* Print count, min, mean, p50, p99 and max on one line */
+    void summary(std::ostream &os);
+    /* Print the non-empty buckets, one per line as <=bound count */
+    void print(std::ostream &os);
+
+private:
+
+    std::atomic<uint64_t> _bucket[NBUCKETS];
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<long> _min;
+    std::atomic<long> _max;
+};
+
+#endif /* HISTOGRAM_H */
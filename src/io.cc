@@ -0,0 +1,372 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "io.h"
+
+// io_uring needs 5.7 kernel headers for the opcodes used (and for
+// IORING_FEAT_FAST_POLL); older build hosts get epoll only
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+#if defined(IORING_FEAT_FAST_POLL) && defined(__NR_io_uring_setup)
+#define IPM_URING 1
+#endif
+
+ipmIo *ipmIo::create(const char *name)
+{
+    if (strcmp(name, "epoll") != 0)
+    {
+        ipmUringIo *io = new ipmUringIo();
+        if (io->open())
+        {
+            return io;
+        }
+        delete io;
+    }
+    return new ipmEpollIo();
+}
+
+ipmIo::ipmIo()
+{
+    _syscalls = 0;
+    _wrote = _drained = 0;
+}
+
+ipmIo::~ipmIo()
+{
+}
+
+int64_t ipmIo::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+ipmEpollIo::ipmEpollIo()
+{
+    _epfd = epoll_create1(EPOLL_CLOEXEC);
+    _fd = -1;
+}
+
+ipmEpollIo::~ipmEpollIo()
+{
+    if (_epfd >= 0)
+    {
+        ::close(_epfd);
+    }
+}
+
+int ipmEpollIo::transfer(int fd, const char *out, int outlen, char *in,
+    int size, long usec)
+{
+    if (outlen > 0)
+    {
+        _syscalls += 2;
+        if (write(fd, out, outlen) != outlen)
+        {
+            return -1;
+        }
+        _wrote = now();
+        tcdrain(fd);  // wait for write to complete
+        _drained = now();
+    }
+
+    struct epoll_event ev;
+    if (fd != _fd)
+    {
+        if (_fd >= 0)
+        {
+            epoll_ctl(_epfd, EPOLL_CTL_DEL, _fd, NULL);
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        _syscalls++;
+        if (epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) < 0 and errno != EEXIST)
+        {
+            return -1;
+        }
+        _fd = fd;
+    }
+
+    int rv;
+    do
+    {
+        _syscalls++;
+        rv = epoll_wait(_epfd, &ev, 1, (int)((usec + 999) / 1000));
+    } while (rv < 0 and errno == EINTR);
+    if (rv <= 0)
+    {
+        return rv;
+    }
+    _syscalls++;
+    int r = read(fd, in, size);
+    if (r < 0 and errno == EAGAIN)
+    {
+        return 0;
+    }
+    return r;
+}
+
+const unsigned ipmUringIo::ENTRIES;
+const int ipmUringIo::MAXTRIES;
+
+ipmUringIo::ipmUringIo()
+{
+    _ringfd = -1;
+    _broken = false;
+    _sq = _cq = _sqes = MAP_FAILED;
+    _sqlen = _cqlen = _sqeslen = 0;
+}
+
+ipmUringIo::~ipmUringIo()
+{
+    close();
+}
+
+void ipmUringIo::close()
+{
+    if (_sqes != MAP_FAILED)
+    {
+        munmap(_sqes, _sqeslen);
+    }
+    if (_cq != MAP_FAILED and _cq != _sq)
+    {
+        munmap(_cq, _cqlen);
+    }
+    if (_sq != MAP_FAILED)
+    {
+        munmap(_sq, _sqlen);
+    }
+    _sq = _cq = _sqes = MAP_FAILED;
+    if (_ringfd >= 0)
+    {
+        ::close(_ringfd);
+        _ringfd = -1;
+    }
+}
+
+#ifdef IPM_URING
+
+bool ipmUringIo::open()
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    _ringfd = syscall(__NR_io_uring_setup, ENTRIES, &p);
+    if (_ringfd < 0)
+    {
+        return false;
+    }
+    // Poll-driven reads of a non-blocking tty need 5.7
+    if (not (p.features & IORING_FEAT_FAST_POLL))
+    {
+        close();
+        return false;
+    }
+
+    _sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    _cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        _sqlen = _cqlen = std::max(_sqlen, _cqlen);
+    }
+    _sq = mmap(NULL, _sqlen, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQ_RING);
+    if (_sq == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        _cq = _sq;
+    } else {
+        _cq = mmap(NULL, _cqlen, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_CQ_RING);
+    }
+    _sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = mmap(NULL, _sqeslen, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, _ringfd, IORING_OFF_SQES);
+    if (_cq == MAP_FAILED or _sqes == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+
+    char *sq = (char *)_sq;
+    char *cq = (char *)_cq;
+    _sqHead = (unsigned *)(sq + p.sq_off.head);
+    _sqTail = (unsigned *)(sq + p.sq_off.tail);
+    _sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    _sqArray = (unsigned *)(sq + p.sq_off.array);
+    _cqHead = (unsigned *)(cq + p.cq_off.head);
+    _cqTail = (unsigned *)(cq + p.cq_off.tail);
+    _cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    _cqes = cq + p.cq_off.cqes;
+    return true;
+}
+
+void *ipmUringIo::sqe(unsigned n)
+{
+    unsigned slot = n & *_sqMask;
+    _sqArray[slot] = slot;
+    struct io_uring_sqe *s = (struct io_uring_sqe *)_sqes + slot;
+    memset(s, 0, sizeof(*s));
+    return s;
+}
+
+int ipmUringIo::transfer(int fd, const char *out, int outlen, char *in,
+    int size, long usec)
+{
+    enum { WRITE = 1, POLL, TIMEOUT, READ };
+
+    if (_broken)
+    {
+        errno = EIO;
+        return -1;
+    }
+
+    // Chain: write -> poll, with the timeout linked to it -> read. If the
+    // poll times out, the read is cancelled too.
+    static_assert(sizeof(_ts) == sizeof(struct __kernel_timespec),
+        "timeout layout");
+    struct __kernel_timespec *ts = (struct __kernel_timespec *)_ts;
+    ts->tv_sec = usec / 1000000;
+    ts->tv_nsec = (usec % 1000000) * 1000;
+    unsigned tail = *_sqTail;  // only this thread submits
+    unsigned n = 0;
+    struct io_uring_sqe *s;
+    if (outlen > 0)
+    {
+        s = (struct io_uring_sqe *)sqe(tail + n++);
+        s->opcode = IORING_OP_WRITE;
+        s->fd = fd;
+        s->addr = (uintptr_t)out;
+        s->len = outlen;
+        s->off = (uint64_t)-1;
+        s->flags = IOSQE_IO_LINK;
+        s->user_data = WRITE;
+    }
+    s = (struct io_uring_sqe *)sqe(tail + n++);
+    s->opcode = IORING_OP_POLL_ADD;
+    s->fd = fd;
+    s->poll_events = POLLIN;
+    s->flags = IOSQE_IO_LINK;
+    s->user_data = POLL;
+    s = (struct io_uring_sqe *)sqe(tail + n++);
+    s->opcode = IORING_OP_LINK_TIMEOUT;
+    s->addr = (uintptr_t)ts;
+    s->len = 1;
+    s->flags = IOSQE_IO_LINK;
+    s->user_data = TIMEOUT;
+    s = (struct io_uring_sqe *)sqe(tail + n++);
+    s->opcode = IORING_OP_READ;
+    s->fd = fd;
+    s->addr = (uintptr_t)in;
+    s->len = size;
+    s->off = (uint64_t)-1;
+    s->user_data = READ;
+    __atomic_store_n(_sqTail, tail + n, __ATOMIC_RELEASE);
+
+    // Submit and wait for every completion, since they refer to the
+    // caller's buffers, even once something has failed
+    unsigned submit = n;
+    unsigned seen = 0;
+    int result = 0;
+    int err = 0;
+    int tries = 0;
+    while (seen < n)
+    {
+        _syscalls++;
+        int r = syscall(__NR_io_uring_enter, _ringfd, submit, n - seen,
+            IORING_ENTER_GETEVENTS, NULL, 0);
+        if (r < 0 and errno != EINTR)
+        {
+            if ((errno == EAGAIN or errno == EBUSY) and ++tries < MAXTRIES)
+            {
+                // Out of memory for now, or completions to reap first
+            } else if (submit > 0) {
+                // Take back what the kernel hasn't, then wait for the rest
+                err = errno;
+                unsigned taken =
+                    __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE) - tail;
+                __atomic_store_n(_sqTail, tail + taken, __ATOMIC_RELEASE);
+                n = taken;
+                submit = 0;
+            } else {
+                // Can't wait for the completions, so close the ring, which
+                // cancels them, and don't use it again
+                err = errno;
+                close();
+                _broken = true;
+                errno = err;
+                return -1;
+            }
+        }
+        if (r > 0)
+        {
+            submit -= std::min((unsigned)r, submit);
+        }
+
+        unsigned head = *_cqHead;
+        unsigned ctail = __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE);
+        for (; head != ctail; head++, seen++)
+        {
+            struct io_uring_cqe *c =
+                (struct io_uring_cqe *)_cqes + (head & *_cqMask);
+            if (c->user_data == WRITE and c->res < 0)
+            {
+                err = -c->res;
+            } else if (c->user_data == READ) {
+                if (c->res >= 0)
+                {
+                    result = c->res;
+                } else if (c->res != -ECANCELED and c->res != -EAGAIN) {
+                    err = -c->res;
+                }
+            }
+        }
+        __atomic_store_n(_cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    if (err != 0)
+    {
+        errno = err;
+        return -1;
+    }
+    return result;
+}
+
+#else
+
+bool ipmUringIo::open()
+{
+    return false;
+}
+
+void *ipmUringIo::sqe(unsigned)
+{
+    return NULL;
+}
+
+int ipmUringIo::transfer(int, const char *, int, char *, int, long)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+#endif
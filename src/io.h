@@ -0,0 +1,133 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+
+#ifndef IO_H
+#define IO_H
+
+/**
+ * Serial I/O backend (ipm_ctrl -I). A command and the wait for its
+ * response are one transfer(): write the command, wait for the iPM to
+ * answer, and read what has arrived in one go rather than a byte at a
+ * time. Backends differ in how many system calls that takes:
+ *
+ *   epoll  write, tcdrain, epoll_wait and read: four calls
+ *   uring  the write, a poll with a timeout linked to it and the read,
+ *          chained in one io_uring submission: one call
+ *
+ * create() falls back to epoll when io_uring isn't available, either in
+ * the kernel headers at build time or the kernel at run time.
+ */
+class ipmIo
+{
+
+public:
+
+    /* Return the backend asked for, "uring", "epoll" or "auto" (the best
+     * available), or epoll if it isn't available. Caller deletes it. */
+    static ipmIo *create(const char *name);
+
+    virtual ~ipmIo();
+
+    /* Write outlen bytes of out, if any, then wait up to usec for fd to
+     * have data and read up to size bytes of it into in. Returns the bytes
+     * read, 0 on timeout, or -1 on error with errno set. */
+    virtual int transfer(int fd, const char *out, int outlen, char *in,
+        int size, long usec) = 0;
+    virtual const char *name() = 0;
+    /* True once the backend has failed in a way it can't recover from;
+     * use another */
+    virtual bool broken()   { return false; }
+
+    /* System calls made by transfer() */
+    uint64_t syscalls()   { return _syscalls; }
+    /* Monotonic time (usec) write() of the last command returned, and
+     * the time it had left the serial port, or 0 if the backend can't
+     * tell */
+    int64_t wrote()       { return _wrote; }
+    int64_t drained()     { return _drained; }
+
+protected:
+
+    ipmIo();
+    static int64_t now();
+    uint64_t _syscalls;
+    int64_t _wrote;
+    int64_t _drained;
+};
+
+/**
+ * epoll backend. The serial port is added to the epoll set the first time
+ * it is used, so a transfer is just the calls listed above.
+ */
+class ipmEpollIo : public ipmIo
+{
+
+public:
+
+    ipmEpollIo();
+    ~ipmEpollIo();
+
+    int transfer(int fd, const char *out, int outlen, char *in, int size,
+        long usec);
+    const char *name()   { return "epoll"; }
+
+private:
+
+    int _epfd;
+    int _fd;   // fd in the epoll set, or -1
+};
+
+/**
+ * io_uring backend, set up with the raw system calls so there is no
+ * liburing dependency.
+ */
+class ipmUringIo : public ipmIo
+{
+
+public:
+
+    ipmUringIo();
+    ~ipmUringIo();
+
+    /* Set up the ring. Returns false if io_uring isn't available. */
+    bool open();
+    int transfer(int fd, const char *out, int outlen, char *in, int size,
+        long usec);
+    const char *name()   { return "uring"; }
+    bool broken()        { return _broken; }
+
+private:
+
+    static const unsigned ENTRIES = 8;
+    // io_uring_enter() calls failing with EAGAIN or EBUSY before giving up
+    static const int MAXTRIES = 10;
+
+    void close();
+    void *sqe(unsigned n);
+
+    int _ringfd;
+    bool _broken;
+    // Timeout of the poll, a struct __kernel_timespec, here rather than
+    // on the stack since the kernel holds on to it until the poll completes
+    long long _ts[2];
+    void *_sq;
+    void *_cq;
+    void *_sqes;
+    size_t _sqlen;
+    size_t _cqlen;
+    size_t _sqeslen;
+    // Ring pointers into the mapped queues
+    unsigned *_sqHead;
+    unsigned *_sqTail;
+    unsigned *_sqMask;
+    unsigned *_sqArray;
+    unsigned *_cqHead;
+    unsigned *_cqTail;
+    unsigned *_cqMask;
+    void *_cqes;
+};
+
+#endif /* IO_H */
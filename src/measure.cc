@@ -41,10 +41,11 @@ void ipmMeasure::parse(uint8_t *cp, uint16_t *sp)
     measure.POWEROK = cp[33];  // PowerOK (1 = power good, 0 = no good)
 }
 
-void ipmMeasure::createUDP(char *buffer, int scaleflag)
+int ipmMeasure::createUDP(char *buffer, int scaleflag)
 {
     if (scaleflag >= 1) {
-        snprintf(buffer, 255, "MEASURE,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,"
+        return snprintf(buffer, 255,
+             "MEASURE,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,"
              "%.2f,%.4f,%.4f,%.4f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%u\r\n",
              measure.FREQ * _deci, measure.TEMP * _deci,
              measure.VRMSA * _deci, measure.VRMSB * _deci,
@@ -56,7 +57,8 @@ void ipmMeasure::createUDP(char *buffer, int scaleflag)
              measure.THDA * _deci, measure.THDB * _deci,
              measure.THDC * _deci, measure.POWEROK);
     } else {
-        snprintf(buffer, 255, "MEASURE,%04x,%04x,%04x,%04x,%04x,%04x,%04x,"
+        return snprintf(buffer, 255,
+             "MEASURE,%04x,%04x,%04x,%04x,%04x,%04x,%04x,"
              "%04x,%04x,%04x,%04x,%04x,%04x,%04x,%02x,%02x,%02x,%02x\r\n",
              measure.FREQ, measure.TEMP,
              measure.VRMSA, measure.VRMSB,
@@ -46,8 +46,9 @@ public:
 
     /* Parse response to the MEASURE command into component variables */
     void parse(uint8_t *cp, uint16_t *sp);
-    /* Build a comma delimited string to send as a UDP packet to nidas */
-    void createUDP(char *buffer, int scaleflag);
+    /* Build a comma delimited string to send as a UDP packet to nidas.
+     * Returns the length of the string. */
+    int createUDP(char *buffer, int scaleflag);
 };
 
 #endif /* MEASURE_H */
@@ -0,0 +1,319 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdlib.h>
+#include <iomanip>
+#include "metrics.h"
+
+const int64_t ipmMetrics::WINDOW;
+
+ipmMetrics::windowed::windowed()
+{
+    _start.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _rate.store(-1, std::memory_order_relaxed);
+}
+
+void ipmMetrics::windowed::add(double value, int64_t now)
+{
+    int64_t start = _start.load(std::memory_order_relaxed);
+    double sum = _sum.load(std::memory_order_relaxed);
+    if (start == 0)
+    {
+        _start.store(now, std::memory_order_relaxed);
+    } else if (now - start >= WINDOW) {
+        _rate.store(sum * 1e6 / (now - start), std::memory_order_relaxed);
+        _start.store(now, std::memory_order_relaxed);
+        sum = 0;
+    }
+    _sum.store(sum + value, std::memory_order_relaxed);
+}
+
+double ipmMetrics::windowed::rate(int64_t now)
+{
+    int64_t start = _start.load(std::memory_order_relaxed);
+    double last = _rate.load(std::memory_order_relaxed);
+    if (start == 0 or now <= start)
+    {
+        return last < 0 ? 0 : last;
+    }
+    if (now - start >= WINDOW or last < 0)
+    {
+        return _sum.load(std::memory_order_relaxed) * 1e6 / (now - start);
+    }
+    return last;
+}
+
+ipmMetrics::ipmMetrics()
+{
+    for (int a = 0; a < 8; a++)
+    {
+        for (int c = 0; c < NCOUNTERS; c++)
+        {
+            _counter[a][c].store(0, std::memory_order_relaxed);
+        }
+        for (int c = 0; c < NCOMMANDS; c++)
+        {
+            _samples[a][c].store(0, std::memory_order_relaxed);
+        }
+        _lastSample[a].store(0, std::memory_order_relaxed);
+    }
+}
+
+ipmMetrics::~ipmMetrics()
+{
+}
+
+int ipmMetrics::command(const std::string &cmd)
+{
+    if (cmd == "MEASURE?")
+    {
+        return MEASURE;
+    } else if (cmd == "STATUS?") {
+        return STATUS;
+    } else if (cmd == "RECORD?") {
+        return RECORD;
+    } else if (cmd == "ADR") {
+        return ADR;
+    }
+    return OTHER;
+}
+
+const char* ipmMetrics::commandName(int command)
+{
+    const char *names[NCOMMANDS] = {"MEASURE", "STATUS", "RECORD", "ADR",
+        "OTHER"};
+    return names[command];
+}
+
+const char* ipmMetrics::phaseName(int phase)
+{
+    const char *names[NPHASES] = {"DRAIN", "FIRSTBYTE", "TRANSFER", "PARSE",
+        "FORMAT"};
+    return names[phase];
+}
+
+const char* ipmMetrics::counterName(int counter)
+{
+    const char *names[NCOUNTERS] = {"TIMEOUTS", "SHORTREADS",
+        "HEADERERRORS", "BADDATA"};
+    return names[counter];
+}
+
+void ipmMetrics::add(int addr, int command, int phase, long usec)
+{
+    if (addr >= 0 and addr < 8)
+    {
+        _phase[addr][command][phase].add(usec);
+    }
+}
+
+void ipmMetrics::count(int addr, int counter)
+{
+    if (addr >= 0 and addr < 8)
+    {
+        // One writer, so no read-modify-write
+        std::atomic<uint64_t> &c = _counter[addr][counter];
+        c.store(c.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+    }
+}
+
+void ipmMetrics::sampled(int addr, int command, int64_t now, double utc)
+{
+    if (addr >= 0 and addr < 8)
+    {
+        std::atomic<uint64_t> &n = _samples[addr][command];
+        n.store(n.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+        _rate[addr][command].add(1, now);
+        _lastSample[addr].store(utc, std::memory_order_relaxed);
+    }
+}
+
+// True if anything has been seen from an address
+bool ipmMetrics::used(int addr)
+{
+    if (lastSample(addr) > 0)
+    {
+        return true;
+    }
+    for (int c = 0; c < NCOUNTERS; c++)
+    {
+        if (counter(addr, c) > 0)
+        {
+            return true;
+        }
+    }
+    for (int c = 0; c < NCOMMANDS; c++)
+    {
+        for (int p = 0; p < NPHASES; p++)
+        {
+            if (_phase[addr][c][p].count() > 0)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ipmMetrics::family(std::ostream &os, const char *name,
+    const char *type, const char *help)
+{
+    os << "# HELP " << name << " " << help << "\n# TYPE " << name << " " <<
+        type << "\n";
+}
+
+void ipmMetrics::quantiles(std::ostream &os, const char *name,
+    const std::string &labels, ipmHistogram &h)
+{
+    const char *q[] = {"0.5", "0.9", "0.99"};
+    std::string sep = labels.empty() ? "" : ",";
+    for (const char *p : q)
+    {
+        os << name << "{" << labels << sep << "quantile=\"" << p << "\"} " <<
+            h.percentile(atof(p) * 100) / 1e6 << "\n";
+    }
+    os << name << "_sum";
+    if (not labels.empty())
+    {
+        os << "{" << labels << "}";
+    }
+    os << " " << h.sum() / 1e6 << "\n" << name << "_count";
+    if (not labels.empty())
+    {
+        os << "{" << labels << "}";
+    }
+    os << " " << h.count() << "\n";
+}
+
+void ipmMetrics::expose(std::ostream &os, int64_t now)
+{
+    std::ios::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+    os << std::fixed << std::setprecision(6);
+
+    family(os, "ipm_samples_total", "counter",
+        "Responses to each query from each iPM address");
+    for (int a = 0; a < 8; a++)
+    {
+        for (int c = MEASURE; c <= RECORD; c++)
+        {
+            if (samples(a, c) > 0)
+            {
+                os << "ipm_samples_total{addr=\"" << a << "\",command=\"" <<
+                    commandName(c) << "\"} " << samples(a, c) << "\n";
+            }
+        }
+    }
+    family(os, "ipm_samples_per_second", "gauge",
+        "Responses per second over the last 10 s");
+    for (int a = 0; a < 8; a++)
+    {
+        for (int c = MEASURE; c <= RECORD; c++)
+        {
+            if (samples(a, c) > 0)
+            {
+                os << "ipm_samples_per_second{addr=\"" << a <<
+                    "\",command=\"" << commandName(c) << "\"} " <<
+                    rate(a, c, now) << "\n";
+            }
+        }
+    }
+    family(os, "ipm_last_sample_timestamp_seconds", "gauge",
+        "UTC the latest response from each iPM address was sampled");
+    for (int a = 0; a < 8; a++)
+    {
+        if (lastSample(a) > 0)
+        {
+            os << "ipm_last_sample_timestamp_seconds{addr=\"" << a << "\"} " <<
+                lastSample(a) << "\n";
+        }
+    }
+    family(os, "ipm_link_utilization", "gauge",
+        "Fraction of the last 10 s the serial link was busy");
+    os << "ipm_link_utilization " << utilization(now) << "\n";
+
+    family(os, "ipm_command_seconds", "summary",
+        "Time of each phase of each command, as bucket upper bounds");
+    for (int a = 0; a < 8; a++)
+    {
+        for (int c = 0; c < NCOMMANDS; c++)
+        {
+            for (int p = 0; p < NPHASES; p++)
+            {
+                if (_phase[a][c][p].count() > 0)
+                {
+                    quantiles(os, "ipm_command_seconds", "addr=\"" +
+                        std::to_string(a) + "\",command=\"" +
+                        commandName(c) + "\",phase=\"" + phaseName(p) +
+                        "\"", _phase[a][c][p]);
+                }
+            }
+        }
+    }
+    family(os, "ipm_errors_total", "counter",
+        "Timeouts, short reads, header errors and bad data per address");
+    for (int a = 0; a < 8; a++)
+    {
+        if (not used(a))
+        {
+            continue;
+        }
+        for (int c = 0; c < NCOUNTERS; c++)
+        {
+            os << "ipm_errors_total{addr=\"" << a << "\",type=\"" <<
+                counterName(c) << "\"} " << counter(a, c) << "\n";
+        }
+    }
+    family(os, "ipm_udp_send_seconds", "summary",
+        "Time to send each cycle's UDP packets");
+    quantiles(os, "ipm_udp_send_seconds", "", _send);
+
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void ipmMetrics::print(std::ostream &os)
+{
+    for (int a = 0; a < 8; a++)
+    {
+        for (int c = 0; c < NCOMMANDS; c++)
+        {
+            for (int p = 0; p < NPHASES; p++)
+            {
+                if (_phase[a][c][p].count() == 0)
+                {
+                    continue;
+                }
+                os << "ADDR" << a << " " << commandName(c) << " " <<
+                    phaseName(p) << " ";
+                _phase[a][c][p].summary(os);
+                os << "\n";
+            }
+        }
+    }
+    for (int a = 0; a < 8; a++)
+    {
+        uint64_t total = 0;
+        for (int c = 0; c < NCOUNTERS; c++)
+        {
+            total += counter(a, c);
+        }
+        if (total == 0)
+        {
+            continue;
+        }
+        os << "ADDR" << a;
+        for (int c = 0; c < NCOUNTERS; c++)
+        {
+            os << " " << counterName(c) << "=" << counter(a, c);
+        }
+        os << "\n";
+    }
+    os << "UDP SEND ";
+    _send.summary(os);
+    os << "\n";
+}
@@ -0,0 +1,122 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include "histogram.h"
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/**
+ * Timing and error counts of every command, per iPM address, kept without
+ * printing anything on the way. Each command's time is split into phases:
+ *
+ *   DRAIN      write to the command leaving the serial port (epoll only)
+ *   FIRSTBYTE  write to the first bytes of the response being read
+ *   TRANSFER   first to last bytes of the response
+ *   PARSE      decoding the iPM data
+ *   FORMAT     writing the packet for nidas
+ *
+ * and the UDP packets of a cycle are sent together, so the time to send
+ * them is one histogram for all addresses. Counters are per address, as
+ * are the responses to each query and their rate over the last WINDOW,
+ * and the time of the latest. The serial link's utilization is its busy
+ * time over the last WINDOW.
+ *
+ * Everything is written by the acquisition thread alone, and is relaxed
+ * atomics, so it can be read from anywhere without locks.
+ */
+class ipmMetrics
+{
+
+public:
+
+    // Commands. MEASURE, STATUS and RECORD match ipmSchedule queries.
+    enum { MEASURE, STATUS, RECORD, ADR, OTHER, NCOMMANDS };
+    enum { DRAIN, FIRSTBYTE, TRANSFER, PARSE, FORMAT, NPHASES };
+    enum { TIMEOUTS, SHORTREADS, HEADERERRORS, BADDATA, NCOUNTERS };
+    // Rates are over this long (usec)
+    static const int64_t WINDOW = 10000000;
+
+    ipmMetrics();
+    ~ipmMetrics();
+
+    /* Command of an iPM command string, eg MEASURE for "MEASURE?" */
+    static int command(const std::string &cmd);
+    static const char* commandName(int command);
+    static const char* phaseName(int phase);
+    static const char* counterName(int counter);
+
+    /* Add a time (usec) for a phase of a command to iPM address addr */
+    void add(int addr, int command, int phase, long usec);
+    void count(int addr, int counter);
+    void sent(long usec)   { _send.add(usec); }
+    /* A response to query command from addr, read at monotonic time now
+     * (usec) and utc (seconds since 1970) */
+    void sampled(int addr, int command, int64_t now, double utc);
+    /* The serial link was busy for usec, up to monotonic time now */
+    void busy(long usec, int64_t now)   { _busy.add(usec / 1e6, now); }
+
+    ipmHistogram& phase(int addr, int command, int phase)
+        { return _phase[addr][command][phase]; }
+    uint64_t counter(int addr, int counter)
+        { return _counter[addr][counter].load(std::memory_order_relaxed); }
+    ipmHistogram& send()   { return _send; }
+    uint64_t samples(int addr, int command)
+        { return _samples[addr][command].load(std::memory_order_relaxed); }
+    double rate(int addr, int command, int64_t now)
+        { return _rate[addr][command].rate(now); }
+    double lastSample(int addr)
+        { return _lastSample[addr].load(std::memory_order_relaxed); }
+    /* Fraction of the time the serial link was busy */
+    double utilization(int64_t now)   { return _busy.rate(now); }
+
+    /* Print a summary line for each phase with times, then the counters of
+     * each address that has any, then the UDP send time */
+    void print(std::ostream &os);
+    /* Print everything in the Prometheus text format, as of monotonic
+     * time now */
+    void expose(std::ostream &os, int64_t now);
+    /* Print the # HELP and # TYPE lines of a metric */
+    static void family(std::ostream &os, const char *name, const char *type,
+        const char *help);
+
+private:
+
+    /**
+     * Sum of the values added in a window, as a rate per second: the last
+     * whole window's, or the current window's so far once it has run past
+     * WINDOW with nothing added, so a rate falls when its adds stop.
+     */
+    class windowed
+    {
+    public:
+        windowed();
+        void add(double value, int64_t now);
+        double rate(int64_t now);
+    private:
+        std::atomic<int64_t> _start;
+        std::atomic<double> _sum;
+        std::atomic<double> _rate;  // last whole window's, -1 if none yet
+    };
+
+    /* Print a histogram as a summary with 0.5, 0.9 and 0.99 quantiles in
+     * seconds; labels go in the braces */
+    static void quantiles(std::ostream &os, const char *name,
+        const std::string &labels, ipmHistogram &h);
+    bool used(int addr);
+
+    ipmHistogram _phase[8][NCOMMANDS][NPHASES];
+    std::atomic<uint64_t> _counter[8][NCOUNTERS];
+    ipmHistogram _send;
+    std::atomic<uint64_t> _samples[8][NCOMMANDS];
+    windowed _rate[8][NCOMMANDS];
+    std::atomic<double> _lastSample[8];
+    windowed _busy;
+};
+
+#endif /* METRICS_H */
@@ -0,0 +1,131 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <cstring>
+#include "packet.h"
+
+const int ipmPacket::HEADERLEN;
+const uint8_t ipmPacket::VERSION;
+
+namespace
+{
+    // Byte at a time so the format doesn't depend on host byte order
+    void put(char *p, uint64_t v, int n)
+    {
+        for (int k = 0; k < n; k++)
+        {
+            p[k] = (char)((v >> (8 * k)) & 0xff);
+        }
+    }
+
+    uint64_t get(const char *p, int n)
+    {
+        uint64_t v = 0;
+        for (int k = 0; k < n; k++)
+        {
+            v |= (uint64_t)(unsigned char)p[k] << (8 * k);
+        }
+        return v;
+    }
+
+    const char *commands[] = {"MEASURE?", "STATUS?", "RECORD?", "BITRESULT?"};
+}
+
+ipmPacket::ipmPacket()
+{
+    for (int a = 0; a < 256; a++)
+    {
+        _seen[a] = false;
+        _next[a] = 0;
+    }
+    _received = 0;
+    _lost = 0;
+    _invalid = 0;
+}
+
+ipmPacket::~ipmPacket()
+{
+}
+
+int ipmPacket::encode(char *buf, int size, const header &h,
+    const char *payload)
+{
+    int len = HEADERLEN + h.length;
+    if (len > size)
+    {
+        return -1;
+    }
+    buf[0] = 'i';
+    buf[1] = 'P';
+    put(buf + 2, h.version, 1);
+    put(buf + 3, h.type, 1);
+    put(buf + 4, h.addr, 1);
+    put(buf + 5, h.flags, 1);
+    put(buf + 6, h.length, 2);
+    put(buf + 8, h.seq, 4);
+    put(buf + 12, h.time, 8);
+    memcpy(buf + HEADERLEN, payload, h.length);
+    return len;
+}
+
+int ipmPacket::decode(const char *buf, int len, header &h)
+{
+    if (len < HEADERLEN || buf[0] != 'i' || buf[1] != 'P')
+    {
+        return -1;
+    }
+    h.version = get(buf + 2, 1);
+    h.type = get(buf + 3, 1);
+    h.addr = get(buf + 4, 1);
+    h.flags = get(buf + 5, 1);
+    h.length = get(buf + 6, 2);
+    h.seq = get(buf + 8, 4);
+    h.time = get(buf + 12, 8);
+    if (h.version != VERSION || HEADERLEN + h.length > len)
+    {
+        return -1;
+    }
+    return HEADERLEN;
+}
+
+int ipmPacket::type(const char *cmd)
+{
+    for (int t = MEASURE; t <= BITRESULT; t++)
+    {
+        if (strcmp(cmd, commands[t]) == 0)
+        {
+            return t;
+        }
+    }
+    return -1;
+}
+
+const char* ipmPacket::command(int type)
+{
+    if (type < MEASURE || type > BITRESULT)
+    {
+        return "";
+    }
+    return commands[type];
+}
+
+bool ipmPacket::receive(const char *buf, int len, header &h)
+{
+    if (decode(buf, len, h) < 0)
+    {
+        _invalid++;
+        return false;
+    }
+    _received++;
+    // Unsigned difference handles sequence number wrap. A packet older
+    // than expected (reordered or a restarted sender) resyncs the count.
+    uint32_t gap = h.seq - _next[h.addr];
+    if (_seen[h.addr] && gap < 0x80000000u)
+    {
+        _lost += gap;
+    }
+    _seen[h.addr] = true;
+    _next[h.addr] = h.seq + 1;
+    return true;
+}
@@ -0,0 +1,85 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+
+#ifndef PACKET_H
+#define PACKET_H
+
+/**
+ * Binary UDP packet format (ipm_ctrl -B), and a receiver for it.
+ *
+ * Every packet is a 20 byte header followed by the raw binary response
+ * from the iPM, unchanged, so the payload layout is the one in the iPM
+ * programming manual. All header fields are little-endian, as is the iPM
+ * data.
+ *
+ *   offset  size  field
+ *        0     2  magic, the characters "iP"
+ *        2     1  version, currently 1
+ *        3     1  frame type: MEASURE, STATUS, RECORD or BITRESULT
+ *        4     1  iPM address
+ *        5     1  flags, reserved (0)
+ *        6     2  payload length (bytes)
+ *        8     4  sequence number, counted per address
+ *       12     8  sampling time, usec since 1970-01-01 UTC
+ *       20     n  payload
+ */
+class ipmPacket
+{
+
+public:
+
+    static const int HEADERLEN = 20;
+    static const uint8_t VERSION = 1;
+
+    // Frame types. MEASURE, STATUS and RECORD match ipmSchedule queries.
+    enum { MEASURE = 0, STATUS = 1, RECORD = 2, BITRESULT = 3 };
+
+    struct header
+    {
+        uint8_t version;
+        uint8_t type;
+        uint8_t addr;
+        uint8_t flags;
+        uint16_t length;  // payload length
+        uint32_t seq;
+        uint64_t time;    // usec since 1970-01-01 UTC
+    };
+
+    ipmPacket();
+    ~ipmPacket();
+
+    /* Write header and payload to buf. Returns the packet length, or -1 if
+     * it won't fit in size bytes. */
+    static int encode(char *buf, int size, const header &h,
+        const char *payload);
+    /* Read the header of a packet. Returns the offset of the payload, or -1
+     * if the packet isn't a complete packet of a known version. */
+    static int decode(const char *buf, int len, header &h);
+
+    /* Return the frame type of an iPM command, or -1 if it has no data */
+    static int type(const char *cmd);
+    /* Return the iPM command of a frame type, eg "MEASURE?" */
+    static const char* command(int type);
+
+    /* Receiver: decode a packet and count packets lost from gaps in the
+     * sequence numbers of each address. Returns false for packets that
+     * don't decode. */
+    bool receive(const char *buf, int len, header &h);
+    long received()   { return _received; }
+    long lost()       { return _lost; }
+    long invalid()    { return _invalid; }
+
+private:
+
+    bool _seen[256];      // a packet has been received from this address
+    uint32_t _next[256];  // expected next sequence number per address
+    long _received;
+    long _lost;
+    long _invalid;
+};
+
+#endif /* PACKET_H */
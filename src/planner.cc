@@ -0,0 +1,128 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <algorithm>
+#include <iomanip>
+#include "planner.h"
+
+ipmPlanner::ipmPlanner()
+{
+    _cycleRate = 0;
+    _numAddr = 0;
+    _cycles = 0;
+    _average = 0;
+    _worst = 0;
+    _utilization = 0;
+    _deferred = 0;
+    _selectCost = 0;
+}
+
+ipmPlanner::~ipmPlanner()
+{
+}
+
+// Step through the schedule a cycle at a time. Each cycle starts with its
+// full period as budget; every slot sent uses its estimated time (plus ADR
+// when the address changes), and the governor sheds low priority slots that
+// won't fit, as it does in naiipm::loop.
+void ipmPlanner::simulate(ipmSchedule schedule)
+{
+    _cycleRate = schedule.cycleRate();
+    _numAddr = schedule.numAddr();
+    for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+    {
+        _cost[q] = schedule.cost(q);
+    }
+    _selectCost = schedule.selectCost();
+    for (int i = 0; i < 8; i++)
+    {
+        for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+        {
+            _sent[i][q] = 0;
+            _period[i][q] = i < _numAddr ? schedule.period(i, q) : 0;
+        }
+    }
+
+    long period = (long)(1000000 / _cycleRate);
+    double busy = 0;
+    _cycles = schedule.hyperperiod();
+    _worst = 0;
+    _deferred = 0;
+
+    for (long c = 0; c < _cycles; c++)
+    {
+        long used = 0;
+        int active = -1;
+        for (auto slot : schedule.due())
+        {
+            if (not schedule.admit(slot, slot.index == active, period - used))
+            {
+                _deferred++;
+                continue;
+            }
+            if (slot.index != active)
+            {
+                active = slot.index;
+                used += _selectCost;
+            }
+            used += _cost[slot.query];
+            schedule.sent(slot);
+            _sent[slot.index][slot.query]++;
+        }
+        busy += used;
+        _worst = std::max(_worst, used);
+        schedule.next();
+    }
+
+    _average = (long)(busy / _cycles);
+    _utilization = busy / ((double)_cycles * period);
+}
+
+void ipmPlanner::report(int baud, const int *addr)
+{
+    long period = (long)(1000000 / _cycleRate);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Dry run: " << baud << " baud, cycle rate " << _cycleRate
+        << " hz (" << period / 1000.0 << " ms), " << _numAddr
+        << " address(es), " << _cycles << " cycles simulated" << std::endl;
+    std::cout << "Estimated times: ";
+    for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+    {
+        std::cout << ipmSchedule::command(q) << " " << _cost[q] / 1000.0
+            << " ms, ";
+    }
+    std::cout << "ADR " << _selectCost / 1000.0 << " ms" << std::endl;
+
+    std::cout << std::setprecision(4);
+    for (int i = 0; i < _numAddr; i++)
+    {
+        std::cout << "Address " << addr[i] << ":";
+        for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+        {
+            if (_period[i][q] > 0)
+            {
+                std::cout << " " << ipmSchedule::command(q) << " "
+                    << rate(i, q) << " hz (requested " << requested(i, q)
+                    << ")";
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << std::setprecision(1);
+    std::cout << "Link utilization " << _utilization * 100 << " %" <<
+        std::endl;
+    std::cout << "Cycle time: average " << _average / 1000.0 <<
+        " ms, worst-case " << _worst / 1000.0 << " ms" << std::endl;
+    std::cout << std::setprecision(2);
+    std::cout << "Fastest cycle rate that fits the worst-case cycle: "
+        << maxCycleRate() << " hz" << std::endl;
+    std::cout << "Deferred low priority queries: " << _deferred << std::endl;
+    if (_utilization > 1)
+    {
+        std::cout << "Link is overloaded: lower the rates, raise the baud "
+            "rate or remove addresses" << std::endl;
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
@@ -0,0 +1,60 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <iostream>
+#include "schedule.h"
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+/**
+ * Serial link capacity planner. Runs a copy of the query schedule over one
+ * hyperperiod using the estimated query and ADR times instead of the iPM,
+ * including the cycle budget governor, and reports link utilization,
+ * achieved rates and the worst-case cycle time.
+ */
+class ipmPlanner
+{
+
+public:
+
+    ipmPlanner();
+    ~ipmPlanner();
+
+    /* Simulate the schedule; no hardware is touched */
+    void simulate(ipmSchedule schedule);
+    /* Print results. addr holds the iPM address of each address index */
+    void report(int baud, const int *addr);
+
+    long cycles()          { return _cycles; }
+    long average()         { return _average; }
+    long worst()           { return _worst; }
+    double utilization()   { return _utilization; }
+    /* Fastest cycle rate (hz) at which the worst-case cycle still fits */
+    float maxCycleRate()   { return _worst > 0 ? 1000000.0 / _worst : 0; }
+    /* Achieved query rate (hz), after any deferrals */
+    float rate(int index, int query)
+        { return _cycles > 0 ? _sent[index][query] * _cycleRate / _cycles
+                             : 0; }
+    float requested(int index, int query)
+        { return _period[index][query] > 0 ?
+            _cycleRate / _period[index][query] : 0; }
+    long deferred()        { return _deferred; }
+
+private:
+
+    float _cycleRate;
+    int _numAddr;
+    long _cycles;
+    long _average;       // usec
+    long _worst;         // usec
+    double _utilization; // fraction of link time busy
+    long _deferred;      // slots shed by the governor
+    long _sent[8][ipmSchedule::NQUERIES];
+    int _period[8][ipmSchedule::NQUERIES];
+    long _cost[ipmSchedule::NQUERIES];
+    long _selectCost;
+};
+
+#endif /* PLANNER_H */
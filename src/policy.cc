@@ -0,0 +1,129 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include "policy.h"
+#include "fields.h"
+
+namespace
+{
+    // MEASURE field indices in ipmFields
+    const int VRMSA = 2;
+    const int THDA = 14;
+    const int POWEROK = 17;
+    const char *phases = "ABC";
+}
+
+ipmPolicy::ipmPolicy()
+{
+    _rate = 0;  // the cycle rate
+    _thd = 0;
+    _vmin = 0;
+    _vmax = 0;
+    _hold = 10;
+    for (int i = 0; i < 8; i++)
+    {
+        _degraded[i] = false;
+        _lastBad[i] = 0;
+        _reason[i][0] = '\0';
+    }
+}
+
+ipmPolicy::~ipmPolicy()
+{
+}
+
+bool ipmPolicy::configure(const char *spec, std::string &error)
+{
+    std::stringstream ss(spec);
+    std::string entry;
+    while (std::getline(ss, entry, ','))
+    {
+        size_t eq = entry.find('=');
+        char *end = NULL;
+        float value = 0;
+        if (eq != std::string::npos)
+        {
+            value = strtof(entry.c_str() + eq + 1, &end);
+        }
+        if (eq == std::string::npos || end == NULL || *end != '\0' ||
+            end == entry.c_str() + eq + 1 || value < 0)
+        {
+            error = entry;
+            return false;
+        }
+
+        std::string name = entry.substr(0, eq);
+        if (name == "rate")
+        {
+            _rate = value;
+        } else if (name == "thd") {
+            _thd = value;
+        } else if (name == "vmin") {
+            _vmin = value;
+        } else if (name == "vmax") {
+            _vmax = value;
+        } else if (name == "hold") {
+            _hold = value;
+        } else {
+            error = entry;
+            return false;
+        }
+    }
+    return true;
+}
+
+int ipmPolicy::evaluate(int index, const char *data, double now)
+{
+    char why[64] = "";
+    if (ipmFields::value(0, POWEROK, data) == 0)
+    {
+        snprintf(why, sizeof(why), "POWEROK 0");
+    }
+    for (int p = 0; p < 3 and why[0] == '\0'; p++)
+    {
+        const ipmField &f = ipmFields::field(0, THDA + p);
+        float thd = ipmFields::value(0, THDA + p, data) * f.scale;
+        if (_thd > 0 and thd > _thd)
+        {
+            snprintf(why, sizeof(why), "THD%c %.1f%% over %g%%", phases[p],
+                thd, _thd);
+        }
+    }
+    for (int p = 0; p < 3 and why[0] == '\0'; p++)
+    {
+        const ipmField &f = ipmFields::field(0, VRMSA + p);
+        uint32_t counts = ipmFields::value(0, VRMSA + p, data);
+        float v = counts * f.scale;
+        if (counts != 0 and ((_vmin > 0 and v < _vmin) or
+            (_vmax > 0 and v > _vmax)))
+        {
+            snprintf(why, sizeof(why), "VRMS%c %.1f V outside %g-%g V",
+                phases[p], v, _vmin, _vmax);
+        }
+    }
+
+    if (why[0] != '\0')
+    {
+        _lastBad[index] = now;
+        if (_degraded[index])
+        {
+            return STEADY;
+        }
+        _degraded[index] = true;
+        snprintf(_reason[index], sizeof(_reason[index]), "%s", why);
+        return RAISE;
+    }
+
+    if (_degraded[index] and now - _lastBad[index] >= _hold)
+    {
+        _degraded[index] = false;
+        snprintf(_reason[index], sizeof(_reason[index]),
+            "nominal for %g s", _hold);
+        return RELAX;
+    }
+    return STEADY;
+}
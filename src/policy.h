@@ -0,0 +1,63 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <iostream>
+#include <string>
+
+#ifndef POLICY_H
+#define POLICY_H
+
+/**
+ * Adaptive MEASURE rate. Each MEASURE response is checked against the
+ * power quality limits: an address is degraded when POWEROK is 0, the THD
+ * of a phase is over the THD limit, or the RMS voltage of a phase is
+ * outside the voltage band. A degraded address is polled at the degraded
+ * rate, and goes back to its base rate once it has been nominal for the
+ * hold time. Phases reading 0 V aren't wired and are ignored.
+ */
+class ipmPolicy
+{
+
+public:
+
+    // Rate changes returned by evaluate()
+    enum { STEADY = 0, RAISE = 1, RELAX = 2 };
+
+    ipmPolicy();
+    ~ipmPolicy();
+
+    /* Set limits from a comma delimited list of NAME=value, where NAME is
+     * rate (degraded MEASURE rate, hz), thd (%), vmin and vmax (V RMS) or
+     * hold (s). A limit of 0 is not checked. Returns false and names the
+     * bad entry in error if an entry can't be parsed. */
+    bool configure(const char *spec, std::string &error);
+    float rate()   { return _rate; }
+    float thd()    { return _thd; }
+    float vmin()   { return _vmin; }
+    float vmax()   { return _vmax; }
+    float hold()   { return _hold; }
+
+    /* Check a MEASURE response from an address index at time now
+     * (seconds). Returns RAISE when the address becomes degraded, RELAX
+     * when it has been nominal for the hold time, and STEADY otherwise. */
+    int evaluate(int index, const char *data, double now);
+    bool degraded(int index)       { return _degraded[index]; }
+    /* Return why the rate of an address last changed */
+    const char* reason(int index)  { return _reason[index]; }
+
+private:
+
+    float _rate;
+    float _thd;
+    float _vmin;
+    float _vmax;
+    float _hold;
+
+    bool _degraded[8];
+    double _lastBad[8];   // time limits were last exceeded
+    char _reason[8][64];
+};
+
+#endif /* POLICY_H */
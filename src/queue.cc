@@ -0,0 +1,71 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <algorithm>
+#include "queue.h"
+
+const int ipmQueue::MAXADHOC;
+
+ipmQueue::ipmQueue()
+{
+    _seq = 0;
+    _adhoc = 0;
+}
+
+ipmQueue::~ipmQueue()
+{
+}
+
+bool ipmQueue::later(const command &a, const command &b)
+{
+    if (a.priority != b.priority)
+    {
+        return a.priority > b.priority;
+    }
+    if (a.deadline != b.deadline)
+    {
+        return a.deadline > b.deadline;
+    }
+    return a.seq > b.seq;
+}
+
+bool ipmQueue::push(command c)
+{
+    if (c.priority == ADHOC)
+    {
+        if (_adhoc == MAXADHOC)
+        {
+            return false;
+        }
+        _adhoc++;
+    }
+    c.seq = _seq++;
+    _heap.push_back(std::move(c));
+    std::push_heap(_heap.begin(), _heap.end(), later);
+    return true;
+}
+
+ipmQueue::command ipmQueue::pop()
+{
+    std::pop_heap(_heap.begin(), _heap.end(), later);
+    command c = std::move(_heap.back());
+    _heap.pop_back();
+    if (c.priority == ADHOC)
+    {
+        _adhoc--;
+    }
+    return c;
+}
+
+void ipmQueue::drop(int priority)
+{
+    _heap.erase(std::remove_if(_heap.begin(), _heap.end(),
+        [priority](const command &c) { return c.priority == priority; }),
+        _heap.end());
+    std::make_heap(_heap.begin(), _heap.end(), later);
+    if (priority == ADHOC)
+    {
+        _adhoc = 0;
+    }
+}
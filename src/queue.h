@@ -0,0 +1,70 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+/**
+ * Prioritized queue of iPM commands waiting for the serial port. Scheduled
+ * queries come first, earliest deadline first; ad-hoc commands (VER?,
+ * BITRESULT?, RESET and so on) come after them in the order they were
+ * queued, and are sent in whatever link time the schedule leaves. Each
+ * command carries a callback, called once it has been sent with whether
+ * the iPM answered as expected.
+ */
+class ipmQueue
+{
+
+public:
+
+    enum { SCHEDULED = 0, ADHOC = 1 };
+    static const int MAXADHOC = 8;
+
+    typedef std::function<void(bool ok)> callback;
+
+    struct command
+    {
+        int priority = ADHOC;
+        long deadline = 0;   // usec after the cycle start; SCHEDULED only
+        int index = 0;       // address index
+        int query = -1;      // ipmSchedule query, or -1 if not scheduled
+        long cycle = 0;      // cycle queued in
+        std::string cmd;
+        std::string arg;     // as for naiipm::send_command()
+        callback done;
+        long seq = 0;        // set by push(), keeps equal commands in order
+    };
+
+    ipmQueue();
+    ~ipmQueue();
+
+    /* Queue a command. Returns false, and drops it, if it's ad-hoc and
+     * MAXADHOC ad-hoc commands are already waiting. */
+    bool push(command c);
+    /* The command to send next */
+    const command& top()   { return _heap.front(); }
+    /* Remove and return the command to send next */
+    command pop();
+    /* Remove every command of a priority, without calling callbacks */
+    void drop(int priority);
+
+    bool empty()   { return _heap.empty(); }
+    int size()     { return (int)_heap.size(); }
+    int adhoc()    { return _adhoc; }
+
+private:
+
+    // Heap order: true if a is sent after b
+    static bool later(const command &a, const command &b);
+
+    std::vector<command> _heap;  // reused every cycle to avoid allocation
+    long _seq;
+    int _adhoc;
+};
+
+#endif /* QUEUE_H */
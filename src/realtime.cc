@@ -0,0 +1,122 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <malloc.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "realtime.h"
+
+const long ipmRealtime::PREFAULT_HEAP;
+const long ipmRealtime::PREFAULT_STACK;
+
+ipmRealtime::ipmRealtime()
+{
+    _priority = 0;
+    _cpu = -1;
+}
+
+ipmRealtime::~ipmRealtime()
+{
+}
+
+bool ipmRealtime::configure(const char *spec)
+{
+    int priority = 0;
+    int cpu = -1;
+    char extra;
+    int n = sscanf(spec, "%d,%d%c", &priority, &cpu, &extra);
+    if (n < 1 or n > 2 or priority < sched_get_priority_min(SCHED_FIFO) or
+        priority > sched_get_priority_max(SCHED_FIFO) or
+        (n == 2 and (cpu < 0 or cpu >= CPU_SETSIZE)))
+    {
+        return false;
+    }
+    _priority = priority;
+    _cpu = cpu;
+    return true;
+}
+
+// Touch a stack frame's worth of pages so later calls don't fault them in
+void ipmRealtime::prefaultStack()
+{
+    volatile char stack[PREFAULT_STACK];
+    volatile char sum = 0;
+    for (long j = 0; j < PREFAULT_STACK; j += 4096)
+    {
+        stack[j] = 0;
+        sum += stack[j];  // read back, so the writes count as used
+    }
+    (void)sum;
+}
+
+int ipmRealtime::apply(std::ostream &os)
+{
+    int skipped = 0;
+
+    struct sched_param sp;
+    memset(&sp, 0, sizeof(sp));
+    sp.sched_priority = _priority;
+    if (sched_setscheduler(0, SCHED_FIFO, &sp) == 0)
+    {
+        os << "Real-time: SCHED_FIFO priority " << _priority << std::endl;
+    } else {
+        os << "Real-time: staying at normal priority, SCHED_FIFO failed: " <<
+            strerror(errno) << std::endl;
+        skipped++;
+    }
+
+    // Locking all future memory with too low a limit would make later
+    // allocations fail, so only lock when there is no limit
+    struct rlimit rl;
+    getrlimit(RLIMIT_MEMLOCK, &rl);
+    if (geteuid() != 0 and rl.rlim_cur != RLIM_INFINITY)
+    {
+        os << "Real-time: memory not locked, RLIMIT_MEMLOCK is " <<
+            rl.rlim_cur / 1024 << " kB" << std::endl;
+        skipped++;
+    } else if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+        os << "Real-time: memory locked" << std::endl;
+    } else {
+        os << "Real-time: memory not locked: " << strerror(errno) <<
+            std::endl;
+        skipped++;
+    }
+
+    // Keep freed memory in the process and off mmap, then fault in the
+    // heap and stack the loop will use
+    mallopt(M_TRIM_THRESHOLD, -1);
+    mallopt(M_MMAP_MAX, 0);
+    char *heap = (char *)malloc(PREFAULT_HEAP);
+    if (heap != NULL)
+    {
+        for (long j = 0; j < PREFAULT_HEAP; j += 4096)
+        {
+            heap[j] = 0;
+        }
+        free(heap);
+    }
+    prefaultStack();
+
+    if (_cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(_cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == 0)
+        {
+            os << "Real-time: running on CPU " << _cpu << std::endl;
+        } else {
+            os << "Real-time: not pinned to CPU " << _cpu << ": " <<
+                strerror(errno) << std::endl;
+            skipped++;
+        }
+    }
+    return skipped;
+}
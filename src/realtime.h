@@ -0,0 +1,46 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <iostream>
+
+#ifndef REALTIME_H
+#define REALTIME_H
+
+/**
+ * Real-time mode (ipm_ctrl -R): SCHED_FIFO priority, memory locked and
+ * prefaulted so the loop doesn't page fault, and optionally pinned to one
+ * CPU. Each part that isn't permitted, as when not running as root, is
+ * reported and skipped; the rest still applies. naiipm::sleep() wakes at
+ * absolute cycle times in this mode.
+ */
+class ipmRealtime
+{
+
+public:
+
+    ipmRealtime();
+    ~ipmRealtime();
+
+    /* Parse priority[,cpu]. Returns false if invalid. */
+    bool configure(const char *spec);
+    bool enabled()   { return _priority > 0; }
+    int priority()   { return _priority; }
+    int cpu()        { return _cpu; }
+
+    /* Apply the settings, reporting each to os. Returns the number that
+     * couldn't be applied. */
+    int apply(std::ostream &os);
+
+private:
+
+    // Heap and stack touched up front so they are resident
+    static const long PREFAULT_HEAP = 8 * 1024 * 1024;
+    static const long PREFAULT_STACK = 256 * 1024;
+    static void prefaultStack();
+
+    int _priority;  // SCHED_FIFO priority, 0 if off
+    int _cpu;       // CPU to run on, -1 for any
+};
+
+#endif /* REALTIME_H */
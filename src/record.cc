@@ -62,10 +62,11 @@ void ipmRecord::parse(uint8_t *cp, uint16_t *sp, uint32_t *lp)
     record.CRC = lp[16];       // CRC-32
 }
 
-void ipmRecord::createUDP(char *buffer, int scaleflag)
+int ipmRecord::createUDP(char *buffer, int scaleflag)
 {
     if (scaleflag >= 1) {
-        snprintf(buffer, 255, "RECORD,%u,%u,%u,%u,%u,%u,%.2f,%.2f,%.2f,"
+        return snprintf(buffer, 255,
+            "RECORD,%u,%u,%u,%u,%u,%u,%.2f,%.2f,%.2f,"
             "%.2f,%.2f,%.2f,%.2f,%.2f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.2f,"
             "%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,"
             "%u\r\n",
@@ -86,7 +87,8 @@ void ipmRecord::createUDP(char *buffer, int scaleflag)
             record.VPKMINC * _deci, record.VPKMAXC * _deci,
             record.CRC);
     } else {
-        snprintf(buffer, 255, "RECORD,%02x,%02x,%08x,%08x,%08x,%08x,%04x,"
+        return snprintf(buffer, 255,
+            "RECORD,%02x,%02x,%08x,%08x,%08x,%08x,%04x,"
             "%04x,%04x,%04x,%04x,%04x,%04x,%04x,%04x,%04x,%04x,%04x,%04x,"
             "%04x,%02x,%02x,%02x,%02x,%02x,%02x,%04x,%04x,%04x,%04x,%04x,"
             "%04x,%08x\r\n",
@@ -61,8 +61,9 @@ public:
 
     /* Parse response to the RECORD command into component variables */
     void parse(uint8_t *cp, uint16_t *sp, uint32_t *lp);
-    /* Build a comma delimited string to send as a UDP packet to nidas */
-    void createUDP(char *buffer, int scaleflag);
+    /* Build a comma delimited string to send as a UDP packet to nidas.
+     * Returns the length of the string. */
+    int createUDP(char *buffer, int scaleflag);
     /* Return time since power-up in minutes */
     float getTimeSincePowerup();
 
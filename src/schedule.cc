@@ -0,0 +1,319 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <algorithm>
+#include <cmath>
+#include "schedule.h"
+
+const long ipmSchedule::MAXWINDOW;
+
+ipmSchedule::ipmSchedule()
+{
+    _due.reserve(8 * NQUERIES);
+    for (int q = 0; q < NQUERIES; q++)
+    {
+        _cost[q] = 0;
+    }
+    _selectCost = 0;
+    configure(1, 0);
+}
+
+ipmSchedule::~ipmSchedule()
+{
+}
+
+void ipmSchedule::configure(float cycleRate, int numAddr)
+{
+    _cycleRate = cycleRate;
+    _numAddr = numAddr;
+    _cycle = 0;
+    _overruns = 0;
+    _start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 8; i++)
+    {
+        for (int q = 0; q < NQUERIES; q++)
+        {
+            _period[i][q] = 0;
+            _phase[i][q] = 0;
+            _pending[i][q] = false;
+            _shed[i][q] = 0;
+            _lastShedCycle[i][q] = -1;
+        }
+    }
+}
+
+void ipmSchedule::setPeriod(int index, int query, int cycles)
+{
+    if (cycles < 0)
+    {
+        cycles = 0;
+    }
+    _period[index][query] = cycles;
+    // Send the first query one full period after startup, as the original
+    // RECORD counter did.
+    _phase[index][query] = (cycles > 0) ? cycles - 1 : 0;
+}
+
+void ipmSchedule::setRate(int index, int query, float hz)
+{
+    if (hz <= 0)
+    {
+        setPeriod(index, query, 0);
+        return;
+    }
+    // A query can't run faster than once per cycle
+    int cycles = (int)std::lround(_cycleRate / hz);
+    setPeriod(index, query, std::max(cycles, 1));
+}
+
+// Rate-monotonic ordering: addresses are ordered by the shortest period
+// among their due queries so the highest rate data goes out first. Queries
+// for an address are kept together so only one ADR is needed per address,
+// and within an address are ordered by period, then MEASURE, STATUS, RECORD.
+// Slots shed by the governor in an earlier cycle stay due until sent.
+const std::vector<ipmSchedule::slot>& ipmSchedule::due()
+{
+    int key[8];
+
+    _due.clear();
+    for (int i = 0; i < _numAddr; i++)
+    {
+        key[i] = 0;
+        for (int q = 0; q < NQUERIES; q++)
+        {
+            int p = _period[i][q];
+            if (isDue(i, q, _cycle) || _pending[i][q])
+            {
+                _due.push_back({i, q});
+                if (key[i] == 0 || p < key[i])
+                {
+                    key[i] = p;
+                }
+            }
+        }
+    }
+
+    std::sort(_due.begin(), _due.end(),
+        [&](const slot &a, const slot &b)
+        {
+            if (a.index != b.index)
+            {
+                if (key[a.index] != key[b.index])
+                    return key[a.index] < key[b.index];
+                return a.index < b.index;
+            }
+            int pa = _period[a.index][a.query];
+            int pb = _period[b.index][b.query];
+            if (pa != pb)
+                return pa < pb;
+            return a.query < b.query;
+        });
+
+    return _due;
+}
+
+long ipmSchedule::remaining()
+{
+    long period = (long)(1000000 / _cycleRate);
+    long elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _start).count();
+    return period - elapsed;
+}
+
+bool ipmSchedule::admit(const slot &s, bool selected, long remaining)
+{
+    long needed = _cost[s.query] + (selected ? 0 : _selectCost);
+    if (not lowPriority(s.query) || needed <= remaining)
+    {
+        return true;
+    }
+
+    _pending[s.index][s.query] = true;
+    _shed[s.index][s.query]++;
+    _lastShedCycle[s.index][s.query] = _cycle;
+    return false;
+}
+
+const char* ipmSchedule::command(int query)
+{
+    switch (query)
+    {
+        case MEASURE:
+            return "MEASURE?";
+        case STATUS:
+            return "STATUS?";
+        case RECORD:
+            return "RECORD?";
+        default:
+            return "";
+    }
+}
+
+long ipmSchedule::transferTime(int bytes, int baud)
+{
+    // 10 bits per byte: start bit, 8 data bits, stop bit
+    return (long)((bytes * 10.0 * 1000000) / baud);
+}
+
+long ipmSchedule::cycleCost(long cycle)
+{
+    long total = 0;
+    for (int i = 0; i < _numAddr; i++)
+    {
+        bool selected = false;
+        for (int q = 0; q < NQUERIES; q++)
+        {
+            if (isDue(i, q, cycle))
+            {
+                total += _cost[q];
+                selected = true;
+            }
+        }
+        if (selected)
+        {
+            total += _selectCost;
+        }
+    }
+    return total;
+}
+
+// Least common multiple of all active periods, capped at MAXWINDOW
+long ipmSchedule::hyperperiod()
+{
+    long w = 1;
+    for (int i = 0; i < _numAddr; i++)
+    {
+        for (int q = 0; q < NQUERIES; q++)
+        {
+            long p = _period[i][q];
+            if (p > 1)
+            {
+                long a = w, b = p;
+                while (b != 0)
+                {
+                    long t = a % b;
+                    a = b;
+                    b = t;
+                }
+                w = w / a * p;
+                if (w >= MAXWINDOW)
+                {
+                    return MAXWINDOW;
+                }
+            }
+        }
+    }
+    return w;
+}
+
+// Greedy phase assignment. Queries that run every cycle set the base load.
+// The remaining queries are placed most expensive first, each at the phase
+// that keeps the peak load of the cycles it lands in lowest. Sending a query
+// to an address that isn't otherwise selected that cycle also costs an ADR.
+// Ties go to the latest phase so the first query still goes out about one
+// period after startup.
+void ipmSchedule::stagger()
+{
+    long w = hyperperiod();
+    std::vector<long> load(w, 0);
+    std::vector<unsigned char> selected(w, 0);  // bit per address index
+    std::vector<slot> slow;
+
+    for (int i = 0; i < _numAddr; i++)
+    {
+        for (int q = 0; q < NQUERIES; q++)
+        {
+            int p = _period[i][q];
+            if (p == 1)
+            {
+                for (long c = 0; c < w; c++)
+                {
+                    load[c] += _cost[q];
+                    if (not (selected[c] & (1 << i)))
+                    {
+                        load[c] += _selectCost;
+                        selected[c] |= (1 << i);
+                    }
+                }
+            }
+            else if (p > 1)
+            {
+                slow.push_back({i, q});
+            }
+        }
+    }
+
+    std::stable_sort(slow.begin(), slow.end(),
+        [&](const slot &a, const slot &b)
+        {
+            if (_cost[a.query] != _cost[b.query])
+                return _cost[a.query] > _cost[b.query];
+            return _period[a.index][a.query] < _period[b.index][b.query];
+        });
+
+    for (auto s : slow)
+    {
+        int p = _period[s.index][s.query];
+        int best = p - 1;
+        long bestPeak = -1;
+        for (int ph = p - 1; ph >= 0; ph--)
+        {
+            long peak = 0;
+            for (long c = ph; c < w; c += p)
+            {
+                long l = load[c] + _cost[s.query];
+                if (not (selected[c] & (1 << s.index)))
+                {
+                    l += _selectCost;
+                }
+                peak = std::max(peak, l);
+            }
+            if (bestPeak < 0 || peak < bestPeak)
+            {
+                bestPeak = peak;
+                best = ph;
+            }
+        }
+        _phase[s.index][s.query] = best;
+        for (long c = best; c < w; c += p)
+        {
+            load[c] += _cost[s.query];
+            if (not (selected[c] & (1 << s.index)))
+            {
+                load[c] += _selectCost;
+                selected[c] |= (1 << s.index);
+            }
+        }
+    }
+}
+
+void ipmSchedule::budget(long &average, long &worst)
+{
+    long w = hyperperiod();
+    double total = 0;
+    worst = 0;
+    for (long c = 0; c < w; c++)
+    {
+        long cost = cycleCost(c);
+        total += cost;
+        worst = std::max(worst, cost);
+    }
+    average = (long)(total / w);
+}
+
+void ipmSchedule::report()
+{
+    long average, worst;
+    budget(average, worst);
+    long period = (long)(1000000 / _cycleRate);
+    std::cout << "Schedule: cycle period " << period / 1000.0 << " ms, "
+        "estimated load average " << average / 1000.0 << " ms, worst-case "
+        << worst / 1000.0 << " ms, worst-case slack "
+        << (period - worst) / 1000.0 << " ms" << std::endl;
+    if (worst > period)
+    {
+        std::cout << "Schedule: worst-case cycle exceeds the cycle period"
+            << std::endl;
+    }
+}
@@ -0,0 +1,132 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <vector>
+#include <chrono>
+#include <iostream>
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+/**
+ * Rate-monotonic query scheduler. Time is divided into cycles at the base
+ * cycle rate (the -m measurerate). Every address/query pair is given its own
+ * period, in cycles, and is due in cycles where (cycle % period) == phase.
+ * The queries due in a cycle are packed into serial link time slots with
+ * the shortest period (highest rate) first. Low rate queries are phase
+ * staggered so they don't all land in the same cycle.
+ */
+class ipmSchedule
+{
+
+public:
+
+    // Queries that can be scheduled, in the order the software
+    // requirements ask for them to be sent within an address.
+    enum { MEASURE = 0, STATUS = 1, RECORD = 2, NQUERIES = 3 };
+
+    struct slot
+    {
+        int index;  // index of address in address info list
+        int query;  // MEASURE, STATUS or RECORD
+    };
+
+    ipmSchedule();
+    ~ipmSchedule();
+
+    /* Set the base cycle rate (hz) and number of addresses; clears periods */
+    void configure(float cycleRate, int numAddr);
+    float cycleRate()   { return _cycleRate; }
+    int numAddr()       { return _numAddr; }
+
+    /* Set query period in cycles; a period of 0 disables the query */
+    void setPeriod(int index, int query, int cycles);
+    /* Set query rate (hz), rounded to a whole number of cycles */
+    void setRate(int index, int query, float hz);
+    int period(int index, int query)   { return _period[index][query]; }
+    /* Override the phase chosen by setPeriod() or stagger() */
+    void setPhase(int index, int query, int phase)
+        { _phase[index][query] = phase; }
+    int phase(int index, int query)    { return _phase[index][query]; }
+
+    /* Return the slots due in the current cycle in transmit order */
+    const std::vector<slot>& due();
+    /* Advance to the next cycle */
+    void next()    { _cycle++; }
+    long cycle()   { return _cycle; }
+
+    /* Return the iPM command string for a query */
+    static const char* command(int query);
+
+    /* Set estimated serial link time (usec) of a query, and of the ADR
+     * command needed to select an address */
+    void setCost(int query, long usec)   { _cost[query] = usec; }
+    void setSelectCost(long usec)        { _selectCost = usec; }
+    long cost(int query)                 { return _cost[query]; }
+    long selectCost()                    { return _selectCost; }
+    /* Return time (usec) to transfer bytes at baud, 8N1 */
+    static long transferTime(int bytes, int baud);
+
+    /* Return estimated serial link time (usec) of the queries due in cycle */
+    long cycleCost(long cycle);
+    /* Choose phases for queries slower than the cycle rate so the
+     * per-cycle load is as flat as possible */
+    void stagger();
+    /* Return cycles before the schedule repeats, capped at MAXWINDOW */
+    long hyperperiod();
+    /* Average and worst-case cycle cost (usec) over one hyperperiod */
+    void budget(long &average, long &worst);
+    /* Print the per-cycle budget */
+    void report();
+
+    /* Cycle budget governor */
+    /* Mark the start of a cycle */
+    void startCycle()   { _start = std::chrono::steady_clock::now(); }
+    std::chrono::steady_clock::time_point started()   { return _start; }
+    /* Return usec left in the current cycle; negative on overrun */
+    long remaining();
+    /* RECORD and any other slow housekeeping query can be deferred so the
+     * MEASURE and STATUS cadence is protected */
+    static bool lowPriority(int query)   { return query == RECORD; }
+    /* Return true if the slot should be sent given usec left in the cycle
+     * and whether its address is already selected. Low priority slots that
+     * don't fit are shed: kept pending and offered again next cycle. */
+    bool admit(const slot &s, bool selected, long remaining);
+    /* Mark a slot as sent */
+    void sent(const slot &s)    { _pending[s.index][s.query] = false; }
+    /* Count a cycle that ran over its period */
+    void overrun()   { _overruns++; }
+    long overruns()  { return _overruns; }
+    long shed(int index, int query)        { return _shed[index][query]; }
+    long lastShedCycle(int index, int query)
+        { return _lastShedCycle[index][query]; }
+
+private:
+
+    // Longest hyperperiod (cycles) examined when staggering or budgeting
+    static const long MAXWINDOW = 100000;
+    bool isDue(int index, int query, long cycle)
+        { int p = _period[index][query];
+          return p > 0 && (cycle % p) == _phase[index][query]; }
+
+    long _cost[NQUERIES];
+    long _selectCost;
+
+    float _cycleRate;
+    int _numAddr;
+    long _cycle;
+
+    int _period[8][NQUERIES];
+    int _phase[8][NQUERIES];
+
+    std::vector<slot> _due;  // reused every cycle to avoid allocation
+
+    std::chrono::steady_clock::time_point _start;
+    bool _pending[8][NQUERIES];      // shed, waiting for a later cycle
+    long _shed[8][NQUERIES];         // number of times shed
+    long _lastShedCycle[8][NQUERIES];
+    long _overruns;
+};
+
+#endif /* SCHEDULE_H */
@@ -0,0 +1,94 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <chrono>
+#include "sequence.h"
+
+ipmSequence::ipmSequence(int addr)
+{
+    _addr = addr;
+    _step = 0;
+    _tries = 0;
+    _wake = 0;
+    _result = 0;
+}
+
+ipmSequence::~ipmSequence()
+{
+}
+
+ipmSequence& ipmSequence::select(int fail, callback done)
+{
+    _steps.push_back({"ADR", 0, 1, fail, done});
+    return *this;
+}
+
+ipmSequence& ipmSequence::send(const std::string &cmd, int fail,
+    callback done)
+{
+    _steps.push_back({cmd, 0, 1, fail, done});
+    return *this;
+}
+
+ipmSequence& ipmSequence::retry(const std::string &cmd, int tries,
+    long wait, int fail, callback done)
+{
+    _steps.push_back({cmd, wait, tries, fail, done});
+    return *this;
+}
+
+ipmSequence& ipmSequence::delay(long usec)
+{
+    _steps.push_back({"", usec, 0, 0, callback()});
+    return *this;
+}
+
+void ipmSequence::start(long now)
+{
+    _step = 0;
+    _tries = 0;
+    _result = 0;
+    advance(now);
+}
+
+void ipmSequence::advance(long now)
+{
+    _wake = now;
+    while (not done() and _steps[_step].cmd.empty())
+    {
+        _wake += _steps[_step].wait;
+        _step++;
+    }
+}
+
+void ipmSequence::resume(bool ok, long now)
+{
+    const step &s = _steps[_step];
+    _tries++;
+    if (not ok and _tries < s.tries)
+    {
+        _wake = now + s.wait;  // try again
+        return;
+    }
+
+    if (s.done)
+    {
+        s.done(ok, _tries);
+    }
+    _tries = 0;
+    if (not ok and s.fail != 0)
+    {
+        _result = s.fail;
+        _step = _steps.size();
+        return;
+    }
+    _step++;
+    advance(now);
+}
+
+long ipmSequence::now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,88 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <functional>
+#include <string>
+#include <vector>
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+/**
+ * Resumable sequence of commands and waits for one iPM address, such as the
+ * initialization naiipm::init() does. A sequence never blocks: whoever runs
+ * it (naiipm::run()) sends the current command, resumes the sequence with
+ * the result, and moves on to another sequence while this one waits. So the
+ * sequences of all addresses share the one serial port, each sending while
+ * the others wait out their delays, on a single thread.
+ *
+ *   ipmSequence seq(addr);
+ *   seq.select().send("OFF").delay(110000).send("RESET");
+ */
+class ipmSequence
+{
+
+public:
+
+    /* Called when a command is done, with whether it succeeded and the
+     * attempts made */
+    typedef std::function<void(bool ok, int tries)> callback;
+
+    struct step
+    {
+        std::string cmd;  // "ADR" selects the address; empty to wait
+        long wait;        // usec to wait, or between tries
+        int tries;        // attempts before the command has failed
+        int fail;         // result if it fails; 0 to carry on
+        callback done;
+    };
+
+    explicit ipmSequence(int addr);
+    ~ipmSequence();
+
+    /* Steps, run in the order added. fail is the result the sequence ends
+     * with if the step fails, or 0 to carry on with the next step. */
+    /* Select the address */
+    ipmSequence& select(int fail = 0, callback done = callback());
+    /* Send a command */
+    ipmSequence& send(const std::string &cmd, int fail = 0,
+        callback done = callback());
+    /* Send a command until it succeeds, up to tries times with wait usec
+     * between. The address is selected before every attempt, which also
+     * clears garbage off the line. */
+    ipmSequence& retry(const std::string &cmd, int tries, long wait,
+        int fail = 0, callback done = callback());
+    /* Wait usec before the next step */
+    ipmSequence& delay(long usec);
+
+    /* Start running at time now */
+    void start(long now);
+    /* The command to send once wake() has passed */
+    const step& current()   { return _steps[_step]; }
+    long wake()             { return _wake; }
+    /* Resume after sending the current command at time now */
+    void resume(bool ok, long now);
+
+    int addr()      { return _addr; }
+    bool done()     { return _step == (int)_steps.size(); }
+    /* 0, or the fail value of the step that ended the sequence */
+    int result()    { return _result; }
+
+    /* usec on the monotonic clock, for start(), wake() and resume() */
+    static long now();
+
+private:
+
+    // Skip to the next command, adding up any waits before it
+    void advance(long now);
+
+    int _addr;
+    std::vector<step> _steps;
+    int _step;
+    int _tries;   // attempts made at the current step
+    long _wake;
+    int _result;
+};
+
+#endif /* SEQUENCE_H */
@@ -0,0 +1,432 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include "server.h"
+
+const int ipmServer::MAXCLIENTS;
+const int ipmServer::LINELEN;
+const int ipmServer::IDLEMS;
+const int ipmServer::MAXOUT;
+
+ipmServer::ipmServer()
+{
+    _listen = -1;
+    _tcp = -1;
+    for (int c = 0; c < MAXCLIENTS; c++)
+    {
+        _fd[c] = -1;
+        _gen[c] = 0;
+        _inlen[c] = 0;
+        _http[c] = false;
+        _remote[c] = false;
+        _active[c] = 0;
+    }
+    _nclients = 0;
+    _last = 0;
+}
+
+ipmServer::~ipmServer()
+{
+    close();
+}
+
+bool ipmServer::open(const char *path)
+{
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    // Only ever remove an old socket, never a file -U was mistyped as
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        if (not S_ISSOCK(st.st_mode))
+        {
+            errno = EEXIST;
+            return false;
+        }
+        unlink(path);
+    }
+
+    _listen = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_listen < 0)
+    {
+        return false;
+    }
+    if (bind(_listen, (struct sockaddr *)&addr, sizeof(addr)) < 0 or
+        listen(_listen, MAXCLIENTS) < 0)
+    {
+        int err = errno;
+        ::close(_listen);
+        _listen = -1;
+        errno = err;
+        return false;
+    }
+    fcntl(_listen, F_SETFL, fcntl(_listen, F_GETFL) | O_NONBLOCK);
+    _path = path;
+    return true;
+}
+
+bool ipmServer::openTcp(const char *ip, int port)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, ip, &addr.sin_addr) != 1)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    addr.sin_port = htons(port);
+
+    _tcp = socket(AF_INET, SOCK_STREAM, 0);
+    if (_tcp < 0)
+    {
+        return false;
+    }
+    int on = 1;
+    setsockopt(_tcp, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(_tcp, (struct sockaddr *)&addr, sizeof(addr)) < 0 or
+        listen(_tcp, MAXCLIENTS) < 0)
+    {
+        int err = errno;
+        ::close(_tcp);
+        _tcp = -1;
+        errno = err;
+        return false;
+    }
+    fcntl(_tcp, F_SETFL, fcntl(_tcp, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void ipmServer::close()
+{
+    for (int c = 0; c < MAXCLIENTS; c++)
+    {
+        if (_fd[c] >= 0)
+        {
+            drop(c);
+        }
+    }
+    if (_listen >= 0)
+    {
+        ::close(_listen);
+        _listen = -1;
+        unlink(_path.c_str());
+    }
+    if (_tcp >= 0)
+    {
+        ::close(_tcp);
+        _tcp = -1;
+    }
+}
+
+void ipmServer::drop(int slot)
+{
+    ::close(_fd[slot]);
+    _fd[slot] = -1;
+    _inlen[slot] = 0;
+    _http[slot] = false;
+    _remote[slot] = false;
+    _out[slot].clear();
+    _gen[slot]++;
+    _nclients--;
+}
+
+int ipmServer::slotOf(int client)
+{
+    int slot = client % MAXCLIENTS;
+    if (client < 0 or _fd[slot] < 0 or _gen[slot] != client / MAXCLIENTS)
+    {
+        return -1;
+    }
+    return slot;
+}
+
+// Accept the connections waiting on a listening socket
+void ipmServer::accept(int listen)
+{
+    int fd;
+    while ((fd = ::accept(listen, NULL, NULL)) >= 0)
+    {
+        int c = 0;
+        while (c < MAXCLIENTS and _fd[c] >= 0)
+        {
+            c++;
+        }
+        if (c == MAXCLIENTS)
+        {
+            const char *busy = "ERR too many clients\n";
+            send(fd, busy, strlen(busy), MSG_NOSIGNAL | MSG_DONTWAIT);
+            ::close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        _fd[c] = fd;
+        _inlen[c] = 0;
+        _remote[c] = listen == _tcp;
+        _active[c] = now();
+        _nclients++;
+    }
+}
+
+bool ipmServer::poll(int msec)
+{
+    struct pollfd fds[MAXCLIENTS + 2];
+    int slots[MAXCLIENTS + 2];
+    int n = 0;
+    fds[n].fd = _listen;  // ignored by poll() if -1
+    fds[n].events = POLLIN;
+    slots[n++] = -1;
+    fds[n].fd = _tcp;
+    fds[n].events = POLLIN;
+    slots[n++] = -1;
+    for (int c = 0; c < MAXCLIENTS; c++)
+    {
+        if (_fd[c] >= 0)
+        {
+            fds[n].fd = _fd[c];
+            fds[n].events = _out[c].empty() ? POLLIN : POLLOUT;
+            slots[n++] = c;
+        }
+    }
+
+    // Requests already buffered don't need to wait
+    for (int c = 0; c < MAXCLIENTS; c++)
+    {
+        if (_fd[c] >= 0 and memchr(_in[c], '\n', _inlen[c]) != NULL)
+        {
+            msec = 0;
+        }
+    }
+
+    if (::poll(fds, n, msec) > 0)
+    {
+        for (int j = 2; j < n; j++)
+        {
+            if (fds[j].revents == 0)
+            {
+                continue;
+            }
+            int c = slots[j];
+            if (not _out[c].empty())
+            {
+                flush(c);  // writable, or failed
+                continue;
+            }
+            if (_http[c])
+            {
+                // Only the request line is used; watch for a close
+                char rest[LINELEN];
+                int r = recv(_fd[c], rest, sizeof(rest), 0);
+                if (r == 0 or (r < 0 and errno != EAGAIN))
+                {
+                    drop(c);
+                }
+                continue;
+            }
+            int r = recv(_fd[c], _in[c] + _inlen[c], LINELEN - _inlen[c],
+                0);
+            if (r <= 0 and not (r < 0 and errno == EAGAIN))
+            {
+                drop(c);  // closed or failed
+                continue;
+            }
+            if (r > 0)
+            {
+                _inlen[c] += r;
+                _active[c] = now();
+            }
+            if (_inlen[c] == LINELEN and
+                memchr(_in[c], '\n', _inlen[c]) == NULL)
+            {
+                if (_remote[c])
+                {
+                    refuse(c);
+                    continue;
+                }
+                reply(c + MAXCLIENTS * _gen[c], "ERR request too long\n");
+                drop(c);
+            }
+        }
+
+        for (int j = 0; j < 2; j++)
+        {
+            if (fds[j].revents & POLLIN)
+            {
+                accept(fds[j].fd);
+            }
+        }
+    }
+
+    // Scrapers, TCP clients and clients not reading their replies don't
+    // get to sit on a slot
+    long long t = now();
+    for (int c = 0; c < MAXCLIENTS; c++)
+    {
+        if (_fd[c] >= 0 and (_http[c] or _remote[c] or
+            not _out[c].empty()) and t - _active[c] > IDLEMS)
+        {
+            drop(c);
+        }
+    }
+
+    for (int c = 0; c < MAXCLIENTS; c++)
+    {
+        if (_fd[c] >= 0 and memchr(_in[c], '\n', _inlen[c]) != NULL)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ipmServer::next(std::string &line)
+{
+    for (int j = 1; j <= MAXCLIENTS; j++)
+    {
+        int c = (_last + j) % MAXCLIENTS;
+        if (_fd[c] < 0)
+        {
+            continue;
+        }
+        char *nl = (char *)memchr(_in[c], '\n', _inlen[c]);
+        if (nl == NULL)
+        {
+            continue;
+        }
+        int len = nl - _in[c];
+        line.assign(_in[c], len);
+        if (len > 0 and line[len - 1] == '\r')
+        {
+            line.erase(len - 1);
+        }
+        _inlen[c] -= len + 1;
+        memmove(_in[c], nl + 1, _inlen[c]);
+        bool get = line.compare(0, 4, "GET ") == 0 and
+            line.find(" HTTP/1.") != std::string::npos;
+        if (get)
+        {
+            _http[c] = true;
+            _inlen[c] = 0;  // headers
+        }
+        _last = c;
+        if (_remote[c] and not get)
+        {
+            refuse(c);
+            continue;
+        }
+        if (_remote[c] and line.compare(0, 13, "GET /metrics ") != 0)
+        {
+            respond(c, "404 Not Found", "Only /metrics is served here\n");
+            continue;
+        }
+        return c + MAXCLIENTS * _gen[c];
+    }
+    return -1;
+}
+
+void ipmServer::reply(int client, const std::string &text)
+{
+    int c = slotOf(client);
+    if (c < 0)
+    {
+        return;
+    }
+    if (_http[c])
+    {
+        if (_out[c].empty())  // one request per connection
+        {
+            bool err = text.compare(0, 3, "ERR") == 0;
+            respond(c, err ? "404 Not Found" : "200 OK", text);
+        }
+        return;
+    }
+    if (_out[c].size() + text.size() > (size_t)MAXOUT)
+    {
+        drop(c);  // not reading its replies
+        return;
+    }
+    bool waiting = not _out[c].empty();
+    _out[c] += text;
+    if (not waiting)
+    {
+        _active[c] = now();  // idle from now if none of it goes
+        flush(c);
+    }
+}
+
+// Answer a TCP client's request for anything but a GET
+void ipmServer::refuse(int slot)
+{
+    _http[slot] = true;
+    _inlen[slot] = 0;
+    respond(slot, "405 Method Not Allowed", "Only GET /metrics is served "
+        "here\n");
+}
+
+void ipmServer::respond(int slot, const char *status,
+    const std::string &text)
+{
+    _out[slot] = std::string("HTTP/1.0 ") + status + "\r\n" +
+        (strncmp(status, "405", 3) == 0 ? "Allow: GET\r\n" : "") +
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(text.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + text;
+    flush(slot);
+}
+
+void ipmServer::flush(int slot)
+{
+    int sent = send(_fd[slot], _out[slot].data(), _out[slot].size(),
+        MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (sent < 0)
+    {
+        if (errno != EAGAIN and errno != EWOULDBLOCK)
+        {
+            drop(slot);
+        }
+        return;
+    }
+    if (sent > 0)
+    {
+        _out[slot].erase(0, sent);
+        _active[slot] = now();
+    }
+    if (_out[slot].empty() and _http[slot])
+    {
+        // Read the rest of the headers, since closing with them unread
+        // would reset the connection and could lose the response
+        char rest[LINELEN];
+        while (recv(_fd[slot], rest, sizeof(rest), MSG_DONTWAIT) > 0)
+        {
+        }
+        drop(slot);
+    }
+}
+
+long long ipmServer::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
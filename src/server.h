@@ -0,0 +1,118 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <string>
+
+#ifndef SERVER_H
+#define SERVER_H
+
+/**
+ * Local query API (ipm_ctrl -U) on a Unix domain stream socket. Clients
+ * send one request per line and get back zero or more lines of reply
+ * followed by a line of OK, or ERR and the reason:
+ *
+ *   LATEST <addr> <frame>        latest response, as <time>,<hex frame>
+ *   HISTORY <addr> <frame> <n>   up to n recent MEASURE or STATUS
+ *                                responses, oldest first
+ *   HEALTH                       acquisition counters, one NAME=value
+ *                                per line
+ *   LATENCY                      measured serial time of each query,
+ *                                and cycle wake-up latency and jitter
+ *   JITTER                       wake-up latency and jitter histograms
+ *   CLOCK <addr>                 iPM clock to UTC fit, and the UTC of the
+ *                                latest RECORD
+ *   METRICS                      time of each phase of each command per
+ *                                address, error counts and UDP send time
+ *   SEND <addr> <command>        send an iPM command in free link time;
+ *                                replies with the iPM response once sent,
+ *                                each line starting "| " so that none
+ *                                can be taken for OK or ERR
+ *   GET /metrics                 metrics in the Prometheus text format,
+ *                                with no OK
+ *
+ * where addr is the iPM address and frame is MEASURE, STATUS or RECORD.
+ * ipmServer only moves lines; naiipm answers the requests. Sockets are
+ * non-blocking: replies that don't fit in the socket are queued and sent
+ * as the client reads them, and a client that takes none of them for
+ * IDLEMS, or lets more than MAXOUT bytes pile up, is disconnected, so
+ * clients never hold up acquisition.
+ *
+ * A client whose first line is an HTTP request line (GET <path> HTTP/1.x)
+ * is a scraper: the rest of what it sends is ignored, and its one reply
+ * goes back as an HTTP response, 404 if it starts with ERR, before it is
+ * disconnected. Scrapers can connect on the Unix socket or on a TCP port
+ * (ipm_ctrl -O). The TCP port only serves GET /metrics: ipmServer answers
+ * anything else there itself, with 405 for other methods and requests or
+ * 404 for other paths, and never passes it on. A scraper or TCP client
+ * that sends or takes nothing for IDLEMS is disconnected, so they can't
+ * hold the client slots.
+ */
+class ipmServer
+{
+
+public:
+
+    static const int MAXCLIENTS = 8;
+    static const int LINELEN = 256;
+    static const int IDLEMS = 10000;
+    static const int MAXOUT = 4 * 1024 * 1024;
+
+    ipmServer();
+    ~ipmServer();
+
+    /* Listen on path, replacing any old socket there. Returns false on
+     * error, or if something other than a socket is there. */
+    bool open(const char *path);
+    /* Also listen on TCP port at the IPv4 address ip. Returns false on
+     * error. */
+    bool openTcp(const char *addr, int port);
+    void close();
+    bool isOpen()   { return _listen >= 0 or _tcp >= 0; }
+
+    /* Wait up to msec for connections and requests and read what has
+     * arrived. Returns true if a request is waiting. */
+    bool poll(int msec);
+    /* Get the next waiting request. Returns the client's id, or -1 if no
+     * request is waiting. */
+    int next(std::string &line);
+    /* Send text to a client, if it's still connected */
+    void reply(int client, const std::string &text);
+
+    int clients()   { return _nclients; }
+
+private:
+
+    void accept(int listen);
+    void drop(int slot);
+    int slotOf(int client);
+    /* Answer a TCP client's request for anything but a GET with 405 */
+    void refuse(int slot);
+    /* Queue an HTTP response to a scraper, then send what fits */
+    void respond(int slot, const char *status, const std::string &text);
+    /* Send more of a client's replies, and disconnect a scraper once its
+     * response is sent */
+    void flush(int slot);
+    /* Monotonic msec */
+    static long long now();
+
+    int _listen;
+    std::string _path;
+    int _tcp;
+
+    // Client sockets, -1 when a slot is free. A client's id is its slot
+    // plus MAXCLIENTS times the slot's generation, so a reply for a client
+    // that left never goes to the next one in its slot.
+    int _fd[MAXCLIENTS];
+    int _gen[MAXCLIENTS];
+    char _in[MAXCLIENTS][LINELEN];
+    int _inlen[MAXCLIENTS];
+    bool _http[MAXCLIENTS];  // has made its HTTP request
+    bool _remote[MAXCLIENTS];  // connected on the TCP port
+    std::string _out[MAXCLIENTS];  // replies still to send
+    long long _active[MAXCLIENTS];  // when it last sent or took anything
+    int _nclients;
+    int _last;   // slot next() returned last, for round robin
+};
+
+#endif /* SERVER_H */
@@ -0,0 +1,150 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "shm.h"
+
+const uint32_t ipmShm::MAGIC;
+const uint32_t ipmShm::VERSION;
+const int ipmShm::NFRAMES;
+const int ipmShm::DATALEN;
+
+ipmShm::ipmShm()
+{
+    _seg = NULL;
+    _name[0] = '\0';
+    _owner = false;
+}
+
+ipmShm::~ipmShm()
+{
+    close();
+}
+
+bool ipmShm::create(const char *name, int numAddr, const int *addr)
+{
+    close();
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (ftruncate(fd, sizeof(segment)) < 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(segment), PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // Readers check the magic number last, so clear it while the layout
+    // is written
+    _seg = (segment *)p;
+    _seg->magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    _seg->version = VERSION;
+    _seg->numAddr = numAddr;
+    for (int i = 0; i < 8; i++)
+    {
+        _seg->addr[i] = (i < numAddr) ? addr[i] : -1;
+        for (int f = 0; f < NFRAMES; f++)
+        {
+            slot &sl = _seg->slots[i][f];
+            sl.seq.store(0, std::memory_order_relaxed);
+            memset(&sl.s, 0, sizeof(sl.s));
+        }
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    _seg->magic = MAGIC;
+
+    snprintf(_name, sizeof(_name), "%s", name);
+    _owner = true;
+    return true;
+}
+
+bool ipmShm::open(const char *name)
+{
+    close();
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void *p = mmap(NULL, sizeof(segment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
+    _seg = (segment *)p;
+    if (_seg->magic != MAGIC or _seg->version != VERSION)
+    {
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+void ipmShm::close()
+{
+    if (_seg == NULL)
+    {
+        return;
+    }
+    munmap(_seg, sizeof(segment));
+    _seg = NULL;
+    if (_owner)
+    {
+        shm_unlink(_name);
+        _owner = false;
+    }
+}
+
+void ipmShm::publish(int index, int frame, const char *data, int length,
+    uint64_t time)
+{
+    slot &sl = _seg->slots[index][frame];
+    uint32_t seq = sl.seq.load(std::memory_order_relaxed);
+    sl.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    length = std::min(length, DATALEN);
+    memcpy(sl.s.data, data, length);
+    sl.s.length = length;
+    sl.s.time = time;
+    sl.s.count++;
+
+    sl.seq.store(seq + 2, std::memory_order_release);
+}
+
+bool ipmShm::read(int index, int frame, sample &s, int tries)
+{
+    slot &sl = _seg->slots[index][frame];
+    for (int t = 0; t < tries; t++)
+    {
+        uint32_t before = sl.seq.load(std::memory_order_acquire);
+        if (before & 1)
+        {
+            continue;  // being written
+        }
+        memcpy(&s, &sl.s, sizeof(s));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sl.seq.load(std::memory_order_relaxed) == before)
+        {
+            return s.count > 0;
+        }
+    }
+    return false;
+}
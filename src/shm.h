@@ -0,0 +1,88 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <atomic>
+#include <iostream>
+
+#ifndef SHM_H
+#define SHM_H
+
+/**
+ * Shared memory publication of the latest iPM responses (ipm_ctrl -M).
+ *
+ * The segment holds one slot per address index and frame (MEASURE, STATUS,
+ * RECORD, as ipmSchedule queries) with the raw binary response, the time
+ * the iPM sampled it and the number of responses published to the slot. Each slot
+ * is guarded by a seqlock: the writer makes the sequence number odd, writes
+ * the slot, then makes it even. Readers never block the writer; a reader
+ * copies the slot and retries if the sequence number was odd or changed
+ * while it copied. Fields are decoded from the copy with ipmFields.
+ */
+class ipmShm
+{
+
+public:
+
+    static const uint32_t MAGIC = 0x6d504969;  // "iPMm"
+    static const uint32_t VERSION = 1;
+    static const int NFRAMES = 3;
+    static const int DATALEN = 72;  // longest response, RECORD, is 68
+
+    // Copy of a slot
+    struct sample
+    {
+        uint64_t time;    // usec since 1970-01-01 UTC
+        uint32_t count;   // responses published to the slot
+        uint32_t length;  // bytes of data
+        char data[DATALEN];
+    };
+
+    struct slot
+    {
+        std::atomic<uint32_t> seq;  // odd while being written
+        sample s;
+    };
+
+    struct segment
+    {
+        uint32_t magic;
+        uint32_t version;
+        int32_t numAddr;
+        int32_t addr[8];     // iPM address of each index
+        slot slots[8][NFRAMES];
+    };
+
+    ipmShm();
+    ~ipmShm();
+
+    /* Create (or recreate) the named segment for the given addresses and
+     * map it for writing. Returns false on error. */
+    bool create(const char *name, int numAddr, const int *addr);
+    /* Map an existing segment read-only. Returns false if it doesn't
+     * exist or isn't an iPM segment of this version. */
+    bool open(const char *name);
+    /* Unmap the segment, and remove it if this process created it */
+    void close();
+    bool isOpen()   { return _seg != NULL; }
+
+    /* Writer: publish a response from an address index */
+    void publish(int index, int frame, const char *data, int length,
+        uint64_t time);
+
+    /* Reader: copy the latest response from an address index. Returns
+     * false if nothing has been published to the slot or a consistent copy
+     * couldn't be made in tries attempts. */
+    bool read(int index, int frame, sample &s, int tries = 100);
+    int numAddr()          { return _seg->numAddr; }
+    int addr(int index)    { return _seg->addr[index]; }
+
+private:
+
+    segment *_seg;
+    char _name[64];
+    bool _owner;
+};
+
+#endif /* SHM_H */
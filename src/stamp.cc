@@ -0,0 +1,98 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <time.h>
+#include <algorithm>
+#include "stamp.h"
+
+ipmStamp::ipmStamp()
+{
+    start();
+    _offset = 0;
+}
+
+ipmStamp::~ipmStamp()
+{
+}
+
+void ipmStamp::start()
+{
+    _write = _first = _last = 0;
+    _len = 0;
+}
+
+void ipmStamp::write(int len)
+{
+    _write = monotonic();
+    _len = len;
+}
+
+void ipmStamp::received()
+{
+    _last = monotonic();
+    if (_first == 0)
+    {
+        _first = _last;
+    }
+}
+
+void ipmStamp::finish()
+{
+    // A response read ahead with an earlier one arrived by the last read
+    // at the latest
+    int64_t now = monotonic();
+    if (_last == 0)
+    {
+        _first = _last = now;
+    }
+    if (_write == 0)
+    {
+        _write = _first;
+    }
+    _offset = realtime() - now;
+}
+
+void ipmStamp::window(int baud, int64_t &from, int64_t &to)
+{
+    // 10 bits a byte: start, 8 data and stop
+    long byte = 10000000L / (baud > 0 ? baud : 1);
+    from = std::min(_write + _len * byte, _first);
+    to = std::max(_first - byte, _write);
+    if (to < from)
+    {
+        from = to = (from + to) / 2;  // the read was quicker than the link
+    }
+}
+
+int64_t ipmStamp::sample(int baud)
+{
+    if (_last == 0)
+    {
+        return realtime();  // no exchange
+    }
+    int64_t from, to;
+    window(baud, from, to);
+    return utc(from + (to - from) / 2);
+}
+
+long ipmStamp::uncertainty(int baud)
+{
+    int64_t from, to;
+    window(baud, from, to);
+    return (to - from) / 2;
+}
+
+int64_t ipmStamp::monotonic()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t ipmStamp::realtime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -0,0 +1,70 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+
+#ifndef STAMP_H
+#define STAMP_H
+
+/**
+ * Timestamps of one serial exchange, and the time the iPM sampled.
+ *
+ * The monotonic time is taken when the command is written, when the first
+ * bytes of the response are read and when the last are, and UTC once, with
+ * the last, so an exchange costs four clock reads. The other UTC times
+ * are worked out from the monotonic ones.
+ *
+ * The iPM samples sometime after the whole command has reached it and
+ * before it starts to answer, so the sampling time is estimated as the
+ * middle of that window: from the write plus the time to send the command
+ * to the first byte less the time to send one byte. The uncertainty is
+ * half the window.
+ */
+class ipmStamp
+{
+
+public:
+
+    ipmStamp();
+    ~ipmStamp();
+
+    /* Start a new exchange */
+    void start();
+    /* The command, len bytes, is being written */
+    void write(int len);
+    /* Response bytes have been read */
+    void received();
+    /* The whole response has been read */
+    void finish();
+
+    // Monotonic times (usec) of the exchange, 0 if not taken
+    int64_t written()    { return _write; }
+    int64_t first()      { return _first; }
+    int64_t last()       { return _last; }
+
+    /* UTC (usec since 1970-01-01) of a monotonic time of this exchange */
+    int64_t utc(int64_t mono)   { return mono + _offset; }
+
+    /* Estimated UTC (usec since 1970-01-01) at which the iPM sampled, for
+     * a link running at baud, or now if there has been no exchange */
+    int64_t sample(int baud);
+    /* Uncertainty (usec) of sample() */
+    long uncertainty(int baud);
+
+    static int64_t monotonic();
+    static int64_t realtime();
+
+private:
+
+    /* The window, in monotonic usec, in which the iPM sampled */
+    void window(int baud, int64_t &from, int64_t &to);
+
+    int64_t _write;
+    int64_t _first;
+    int64_t _last;
+    int _len;          // command length (bytes)
+    int64_t _offset;   // UTC less monotonic time, at the last byte
+};
+
+#endif /* STAMP_H */
@@ -25,14 +25,14 @@ void ipmStatus::parse(uint8_t *cp, uint16_t *sp)
     status.BITSTAT = sp[5];   // bitStatus
 }
 
-void ipmStatus::createUDP(char *buffer, int scaleflag, int badData)
+int ipmStatus::createUDP(char *buffer, int scaleflag, int badData)
 {
     if (scaleflag >= 1) {
-        snprintf(buffer, 255, "STATUS,%u,%u,%u,%u,%u,%d\r\n",
+        return snprintf(buffer, 255, "STATUS,%u,%u,%u,%u,%u,%d\r\n",
             status.OPSTATE, status.POWEROK, status.TRIPFLAGS,
             status.CAUTIONFLAGS, status.BITSTAT, badData);
     } else {
-        snprintf(buffer, 255, "STATUS,%02x,%02x,%04x,%04x,%04x\r\n",
+        return snprintf(buffer, 255, "STATUS,%02x,%02x,%04x,%04x,%04x\r\n",
             status.OPSTATE, status.POWEROK, status.TRIPFLAGS,
             status.CAUTIONFLAGS, status.BITSTAT);
     }
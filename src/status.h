@@ -30,8 +30,9 @@ public:
 
     /* Parse response to the STATUS command into component variables */
     void parse(uint8_t *cp, uint16_t *sp);
-    /* Build a comma delimited string to send as a UDP packet to nidas */
-    void createUDP(char *buffer, int scaleflag, int badData);
+    /* Build a comma delimited string to send as a UDP packet to nidas.
+     * Returns the length of the string. */
+    int createUDP(char *buffer, int scaleflag, int badData);
 };
 
 #endif /* STATUS_H */
@@ -0,0 +1,160 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include "trace.h"
+
+const int ipmTrace::NEVENTS;
+const int ipmTrace::FLUSHMS;
+
+ipmTrace::ipmTrace()
+{
+    _fd = -1;
+    _pid = 0;
+    _events = NULL;
+    _head.store(0, std::memory_order_relaxed);
+    _tail.store(0, std::memory_order_relaxed);
+    _dropped.store(0, std::memory_order_relaxed);
+    _stop = false;
+}
+
+ipmTrace::~ipmTrace()
+{
+    close();
+    delete[] _events;
+}
+
+bool ipmTrace::open(const char *path, const char *process)
+{
+    _fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (_fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(_fd, &st) == 0 and st.st_size == 0)
+    {
+        write(_fd, "[\n", 2);
+    }
+    _pid = getpid();
+    if (_events == NULL)
+    {
+        _events = new event[NEVENTS];
+    }
+    _stop = false;
+    push({'P', process, "", 0, 0, 0});
+    _thread = std::thread(&ipmTrace::run, this);
+    return true;
+}
+
+void ipmTrace::close()
+{
+    if (_fd < 0)
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+    _thread.join();
+    ::close(_fd);
+    _fd = -1;
+}
+
+void ipmTrace::name(int track, const char *name)
+{
+    if (_fd >= 0)
+    {
+        push({'T', name, "", track, 0, 0});
+    }
+}
+
+void ipmTrace::add(const char *name, const char *category, int track,
+    int64_t begin, int64_t end)
+{
+    if (_fd >= 0)
+    {
+        push({'X', name, category, track, begin, std::max(begin, end)});
+    }
+}
+
+void ipmTrace::push(const event &e)
+{
+    uint64_t head = _head.load(std::memory_order_relaxed);
+    uint64_t used = head - _tail.load(std::memory_order_acquire);
+    if (used >= (uint64_t)NEVENTS)
+    {
+        _dropped.store(dropped() + 1, std::memory_order_relaxed);
+        return;
+    }
+    _events[head % NEVENTS] = e;
+    _head.store(head + 1, std::memory_order_release);
+    if (used + 1 == NEVENTS / 2)
+    {
+        _wake.notify_one();  // rather than wait for the next flush
+    }
+}
+
+// Flush thread
+void ipmTrace::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (not _stop)
+    {
+        _wake.wait_for(lock, std::chrono::milliseconds(FLUSHMS));
+        lock.unlock();
+        flush();
+        lock.lock();
+    }
+    lock.unlock();
+    flush();  // anything added since
+}
+
+void ipmTrace::flush()
+{
+    char buf[65536];
+    const int EVENTLEN = 512;  // longest event, with room to spare
+    int len = 0;
+    uint64_t tail = _tail.load(std::memory_order_relaxed);
+    uint64_t head = _head.load(std::memory_order_acquire);
+    for (; tail != head; tail++)
+    {
+        len += format(_events[tail % NEVENTS], buf + len, EVENTLEN);
+        _tail.store(tail + 1, std::memory_order_release);
+        if (len > (int)sizeof(buf) - EVENTLEN)
+        {
+            write(_fd, buf, len);
+            len = 0;
+        }
+    }
+    if (len > 0)
+    {
+        write(_fd, buf, len);
+    }
+}
+
+int ipmTrace::format(const event &e, char *buf, int size)
+{
+    int len;
+    if (e.type == 'X')
+    {
+        len = snprintf(buf, size, "{\"name\":\"%s\",\"cat\":\"%s\","
+            "\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d},\n",
+            e.name, e.category, (long long)e.begin,
+            (long long)(e.end - e.begin), _pid, e.track);
+    } else {
+        len = snprintf(buf, size, "{\"name\":\"%s\",\"ph\":\"M\","
+            "\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+            e.type == 'P' ? "process_name" : "thread_name", _pid, e.track,
+            e.name);
+    }
+    return std::min(len, size - 1);  // snprintf returns the untruncated length
+}
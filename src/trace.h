@@ -0,0 +1,89 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Trace of where each cycle's time goes (ipm_ctrl -J), as Chrome trace
+ * events that chrome://tracing and Perfetto load. Each event is a span
+ * of monotonic time in usec on a track: the process is the device, and
+ * its tracks (threads, to the viewers) are the iPM addresses and the
+ * cycle.
+ *
+ * add() only fills a slot in a preallocated ring, so the acquisition
+ * thread never allocates, formats or writes. A flush thread appends the
+ * events to the file every FLUSHMS, or sooner once the ring is half full.
+ * If the ring fills anyway, events are dropped and counted.
+ *
+ * The file is a JSON array that is never closed: every event is followed
+ * by a comma, which the viewers allow, so ipm_ctrl for several devices
+ * can append to one file and be seen on one timeline.
+ */
+class ipmTrace
+{
+
+public:
+
+    static const int NEVENTS = 16384;
+    static const int FLUSHMS = 1000;
+
+    ipmTrace();
+    ~ipmTrace();
+
+    /* Append to path, naming the process. Returns false on error. */
+    bool open(const char *path, const char *process);
+    /* Write the events left and stop the flush thread */
+    void close();
+    bool isOpen()   { return _fd >= 0; }
+
+    /* Name a track. Names and categories must last as long as the trace,
+     * since only the pointers are kept. */
+    void name(int track, const char *name);
+    /* Add a span from begin to end (monotonic usec) */
+    void add(const char *name, const char *category, int track,
+        int64_t begin, int64_t end);
+
+    long dropped()   { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+
+    struct event
+    {
+        char type;   // X span, T track name, P process name
+        const char *name;
+        const char *category;
+        int track;
+        int64_t begin;
+        int64_t end;
+    };
+
+    void push(const event &e);
+    void run();
+    void flush();
+    /* Write an event's JSON and a comma. Returns the length. */
+    int format(const event &e, char *buf, int size);
+
+    int _fd;
+    int _pid;
+    event *_events;
+    // Events are added at _head and written from _tail. Only add() moves
+    // _head and only the flush thread moves _tail.
+    std::atomic<uint64_t> _head;
+    std::atomic<uint64_t> _tail;
+    std::atomic<long> _dropped;
+
+    std::thread _thread;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    bool _stop;
+};
+
+#endif /* TRACE_H */
@@ -0,0 +1,165 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include "udp.h"
+
+const int ipmUdp::PKTLEN;
+const int ipmUdp::QUEUELEN;
+
+ipmUdp::ipmUdp()
+{
+    _sock = -1;
+    _ndest = 0;
+    _head = 0;
+    _count = 0;
+    _sent = 0;
+    _dropped = 0;
+    _errors = 0;
+    _backpressure = false;
+    _droppedAtStart = 0;
+}
+
+ipmUdp::~ipmUdp()
+{
+    close();
+}
+
+// One socket serves every address; each packet carries its own destination.
+bool ipmUdp::open(const char *ip, const int *ports, int n)
+{
+    //  AF_INET for IPv4/ AF_INET6 for IPv6
+    //  SOCK_STREAM for TCP / SOCK_DGRAM for UDP
+    _sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (_sock < 0)
+    {
+        return false;
+    }
+    int flags = fcntl(_sock, F_GETFL, 0);
+    fcntl(_sock, F_SETFL, flags | O_NONBLOCK);
+
+    _ndest = n;
+    for (int i = 0; i < n; i++)
+    {
+        memset(&_dest[i], 0, sizeof(_dest[i]));
+        _dest[i].sin_family = AF_INET;
+        _dest[i].sin_port = htons(ports[i]);
+        _dest[i].sin_addr.s_addr = inet_addr(ip);
+    }
+    return true;
+}
+
+void ipmUdp::close()
+{
+    if (_sock >= 0)
+    {
+        ::close(_sock);
+        _sock = -1;
+    }
+}
+
+void ipmUdp::dropOldest()
+{
+    _head = (_head + 1) % QUEUELEN;
+    _count--;
+    _dropped++;
+}
+
+void ipmUdp::enqueue(const char *buf, int len, int index)
+{
+    if (len > PKTLEN)
+    {
+        len = PKTLEN;
+    }
+    if (_count == QUEUELEN)
+    {
+        dropOldest();
+    }
+    packet &p = _queue[(_head + _count) % QUEUELEN];
+    memcpy(p.data, buf, len);
+    p.len = len;
+    p.index = index;
+    _count++;
+}
+
+int ipmUdp::flush()
+{
+    int total = 0;
+
+    while (_count > 0 && _sock >= 0)
+    {
+        // Send the contiguous run of packets starting at the oldest
+        int n = std::min(_count, QUEUELEN - _head);
+        int rv;
+#ifdef __linux__
+        for (int k = 0; k < n; k++)
+        {
+            packet &p = _queue[_head + k];
+            _iov[k].iov_base = p.data;
+            _iov[k].iov_len = p.len;
+            memset(&_msgs[k].msg_hdr, 0, sizeof(_msgs[k].msg_hdr));
+            _msgs[k].msg_hdr.msg_name = &_dest[p.index];
+            _msgs[k].msg_hdr.msg_namelen = sizeof(_dest[p.index]);
+            _msgs[k].msg_hdr.msg_iov = &_iov[k];
+            _msgs[k].msg_hdr.msg_iovlen = 1;
+        }
+        rv = sendmmsg(_sock, _msgs, n, MSG_DONTWAIT);
+#else
+        rv = 0;
+        for (int k = 0; k < n; k++)
+        {
+            packet &p = _queue[_head + k];
+            if (sendto(_sock, p.data, p.len, 0,
+                (const struct sockaddr *) &_dest[p.index],
+                sizeof(_dest[p.index])) == -1)
+            {
+                if (rv == 0)
+                {
+                    rv = -1;
+                }
+                break;
+            }
+            rv++;
+        }
+#endif
+        if (rv > 0)
+        {
+            _head = (_head + rv) % QUEUELEN;
+            _count -= rv;
+            _sent += rv;
+            total += rv;
+            continue;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+        {
+            // Socket buffer full; keep the queue and try again next cycle
+            break;
+        }
+        // Any other error belongs to the oldest packet; drop it and go on
+        _errors++;
+        dropOldest();
+    }
+
+    // Log when we start and stop dropping, not every packet dropped
+    if (not _backpressure && _count > 0)
+    {
+        _backpressure = true;
+        _droppedAtStart = _dropped;
+        std::cout << "UDP send backed up; " << _count << " packet(s) "
+            "queued, oldest are dropped when full" << std::endl;
+    }
+    else if (_backpressure && _count == 0)
+    {
+        _backpressure = false;
+        std::cout << "UDP send recovered after dropping " <<
+            _dropped - _droppedAtStart << " packet(s)" << std::endl;
+    }
+
+    return total;
+}
@@ -0,0 +1,79 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <iostream>
+
+#ifndef UDP_H
+#define UDP_H
+
+/**
+ * Bounded queue of UDP packets to nidas. Packets produced during a cycle,
+ * across addresses and queries, are queued and sent together with
+ * sendmmsg on one non-blocking socket. When the network can't keep up the
+ * oldest packets are dropped, so sending never stalls or stops the serial
+ * loop.
+ */
+class ipmUdp
+{
+
+public:
+
+    // Longest packet and number of packets held
+    static const int PKTLEN = 1024;
+    static const int QUEUELEN = 64;
+
+    ipmUdp();
+    ~ipmUdp();
+
+    /* Open the socket and set the destination port of each address index */
+    bool open(const char *ip, const int *ports, int n);
+    void close();
+
+    /* Queue a packet for an address index, dropping the oldest packet if
+     * the queue is full */
+    void enqueue(const char *buf, int len, int index);
+    /* Send as much of the queue as the socket will take without blocking.
+     * Returns the number of packets sent. */
+    int flush();
+
+    int depth()      { return _count; }
+    long sent()      { return _sent; }
+    long dropped()   { return _dropped; }
+    long errors()    { return _errors; }
+
+private:
+
+    struct packet
+    {
+        char data[PKTLEN];
+        int len;
+        int index;   // address index; selects destination port
+    };
+
+    void dropOldest();
+
+    int _sock;
+    int _ndest;
+    struct sockaddr_in _dest[8];
+
+    // Ring buffer, oldest packet at _head
+    packet _queue[QUEUELEN];
+    int _head;
+    int _count;
+
+#ifdef __linux__
+    struct mmsghdr _msgs[QUEUELEN];
+    struct iovec _iov[QUEUELEN];
+#endif
+
+    long _sent;
+    long _dropped;
+    long _errors;
+    bool _backpressure;   // currently unable to send everything queued
+    long _droppedAtStart; // drops when backpressure started
+};
+
+#endif /* UDP_H */
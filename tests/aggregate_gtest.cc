@@ -0,0 +1,81 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <sstream>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/aggregate.cc"
+
+/********************************************************************
+ ** Test min, max, mean and last over a window
+ ********************************************************************
+*/
+TEST(AggregateTest, Window)
+{
+    ipmAggregate agg;
+    agg.configure(1);
+
+    unsigned char measure[34] = {88, 2};  // FREQ 600 counts
+    EXPECT_FALSE(agg.due(0, 10));
+    agg.add(0, (char *)measure, 10);
+    measure[0] = 92;                      // 604
+    agg.add(0, (char *)measure, 10.5);
+    measure[0] = 90;                      // 602
+    agg.add(1, (char *)measure, 10.5);    // other address
+    EXPECT_FALSE(agg.due(0, 10.9));
+
+    // The response at the end of the window is in the next one
+    EXPECT_TRUE(agg.due(0, 11));
+    EXPECT_EQ(agg.count(0), 2);
+    EXPECT_EQ(agg.count(1), 1);
+    char buf[1024];
+    int len = agg.format(0, buf, sizeof(buf), 1);  // FREQ only
+    EXPECT_STREQ(buf, "MEASUREW,2,0258,025c,602.00,025c\r\n");
+    EXPECT_EQ(len, (int)strlen(buf));
+    EXPECT_EQ(agg.count(0), 0);
+    agg.add(0, (char *)measure, 11);
+
+    // Windows stay one second long, from 11 to 12
+    measure[0] = 80;                      // 592
+    agg.add(0, (char *)measure, 11.2);
+    EXPECT_FALSE(agg.due(0, 11.9));
+    EXPECT_TRUE(agg.due(0, 12));
+    agg.format(0, buf, sizeof(buf), 1);
+    EXPECT_STREQ(buf, "MEASUREW,2,0250,025a,597.00,0250\r\n");
+
+    // and skip ahead over a gap in the responses
+    agg.add(0, (char *)measure, 14.5);
+    EXPECT_EQ(agg._win[0].start, 14);
+    EXPECT_FALSE(agg.due(0, 14.9));
+    EXPECT_TRUE(agg.due(0, 15));
+
+    // Every field fits in one packet
+    len = agg.format(1, buf, sizeof(buf), ipmFields::all(0));
+    EXPECT_EQ(len, (int)strlen(buf));
+    EXPECT_EQ(std::string(buf + len - 2), "\r\n");
+}
+
+/********************************************************************
+ ** Test the nidas sample for the aggregated packet
+ ********************************************************************
+*/
+TEST(AggregateTest, PrintSample)
+{
+    std::stringstream xml;
+    std::set<std::string> seen;
+    ipmAggregate::printSample(xml, 1, 1, 1, seen);
+    std::string out = xml.str();
+    EXPECT_EQ(out.substr(0, out.find('\n')),
+        "        <sample id=\"1\" rate=\"1\" "
+        "scanfFormat=\"MEASUREW,%x,%x,%x,%f,%x\">");
+    EXPECT_NE(out.find("name=\"MEASURECNT\""), std::string::npos);
+    EXPECT_NE(out.find("longname=\"Window Minimum AC Power Frequency\" "
+        "name=\"FREQWMIN\""), std::string::npos);
+    EXPECT_NE(out.find("name=\"FREQWMAX\""), std::string::npos);
+    EXPECT_NE(out.find("name=\"FREQWAVG\""), std::string::npos);
+    EXPECT_NE(out.find("name=\"FREQ\""), std::string::npos);
+    EXPECT_EQ(out.find("VRMSA"), std::string::npos);  // not in mask
+    EXPECT_EQ(seen.count("FREQ"), 1u);
+}
@@ -50,6 +50,31 @@ TEST_F(ArgTest, ParseAddrInfo)
     EXPECT_EQ(_args.Addrport(0), 30101);
 }
 
+TEST_F(ArgTest, ParseAddrInfoRates)
+{
+    // Parse an addrInfo block with per-address rates
+    char addrinfo[24];
+    strcpy(addrinfo, "1,7,30102,5,1,10");
+    _args.setAddrInfo(1, addrinfo);
+    bool stat = _args.parse_addrInfo(1);
+    EXPECT_EQ(stat, 1);
+    EXPECT_EQ(_args.Addr(1), 1);
+    EXPECT_EQ(_args.Procqueries(1), 7);
+    EXPECT_EQ(_args.Addrport(1), 30102);
+    EXPECT_EQ(_args.addrMeasureRate(1), 5);
+    EXPECT_EQ(_args.addrStatusRate(1), 1);
+    EXPECT_EQ(_args.addrRecordPeriod(1), 10);
+
+    // Without rates, defaults are restored
+    strcpy(addrinfo, "1,7,30102");
+    _args.setAddrInfo(1, addrinfo);
+    stat = _args.parse_addrInfo(1);
+    EXPECT_EQ(stat, 1);
+    EXPECT_EQ(_args.addrMeasureRate(1), 0);
+    EXPECT_EQ(_args.addrStatusRate(1), 0);
+    EXPECT_EQ(_args.addrRecordPeriod(1), 0);
+}
+
 /********************************************************************
  ** Test storing and retrieving command line args.  ipm_ctrl accepts
  ** the following command line arguments:
@@ -168,3 +193,20 @@ TEST_F(ArgTest, SetGetEmulate)
     _args.setEmulate();
     EXPECT_EQ(_args.Emulate(), true);
 }
+
+TEST_F(ArgTest, SetGetMetrics)
+{
+    // Loopback unless an address is given
+    EXPECT_TRUE(_args.setMetrics("9100"));
+    EXPECT_STREQ(_args.metricsAddr(), "127.0.0.1");
+    EXPECT_EQ(_args.metricsPort(), 9100);
+    EXPECT_TRUE(_args.setMetrics("0.0.0.0:9101"));
+    EXPECT_STREQ(_args.metricsAddr(), "0.0.0.0");
+    EXPECT_EQ(_args.metricsPort(), 9101);
+
+    EXPECT_FALSE(_args.setMetrics("0"));
+    EXPECT_FALSE(_args.setMetrics(":9100"));
+    EXPECT_FALSE(_args.setMetrics("10.0.0.1:"));
+    EXPECT_FALSE(_args.setMetrics("10.0.0.1:9100x"));
+    EXPECT_EQ(_args.metricsPort(), 9101);
+}
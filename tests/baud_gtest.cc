@@ -0,0 +1,53 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/baud.cc"
+
+/********************************************************************
+ ** Test mapping baud rates to termios speed constants
+ ********************************************************************
+*/
+TEST(BaudTest, Speed)
+{
+    EXPECT_EQ(ipmBaud::speed(9600), (uint_fast32_t)B9600);
+    EXPECT_EQ(ipmBaud::speed(57600), (uint_fast32_t)B57600);
+    EXPECT_EQ(ipmBaud::speed(115200), (uint_fast32_t)B115200);
+    EXPECT_EQ(ipmBaud::speed(230400), (uint_fast32_t)B230400);
+
+    // Non-standard rates need a custom divisor
+    EXPECT_EQ(ipmBaud::speed(250000), 0u);
+    EXPECT_EQ(ipmBaud::speed(0), 0u);
+}
+
+TEST(BaudTest, Candidates)
+{
+    // Auto-detect tries the fastest rate first and includes the iPM
+    // default rate
+    bool found = false;
+    for (int k = 0; k < ipmBaud::ncandidates; k++)
+    {
+        if (k > 0)
+        {
+            EXPECT_LT(ipmBaud::candidates[k], ipmBaud::candidates[k-1]);
+        }
+        if (ipmBaud::candidates[k] == 57600)
+        {
+            found = true;
+        }
+    }
+    EXPECT_TRUE(found);
+}
+
+TEST(BaudTest, SetCustomNotTty)
+{
+    // A pipe is not a serial port
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    EXPECT_FALSE(ipmBaud::setCustom(fds[0], 250000));
+    close(fds[0]);
+    close(fds[1]);
+}
@@ -0,0 +1,110 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <sstream>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/capture.cc"
+
+/********************************************************************
+ ** Test triggers from STATUS flags and RECORD events
+ ********************************************************************
+*/
+TEST(CaptureTest, Trigger)
+{
+    ipmCapture cap;
+    unsigned char status[12] = {2, 1};
+
+    // The first STATUS only sets the reference, even with flags set
+    status[2] = 0x01;  // TRIPFLAGS
+    EXPECT_EQ(cap.trigger(0, 1, (char *)status), nullptr);
+    EXPECT_EQ(cap.trigger(0, 1, (char *)status), nullptr);
+
+    // A new caution bit triggers; the same bits again don't
+    status[6] = 0x10;  // CAUTIONFLAGS
+    EXPECT_STREQ(cap.trigger(0, 1, (char *)status),
+        "TRIPFLAGS 00000001 CAUTIONFLAGS 00000010");
+    EXPECT_EQ(cap.trigger(0, 1, (char *)status), nullptr);
+
+    // Cleared bits don't, but a bit set again does
+    status[2] = 0;
+    EXPECT_EQ(cap.trigger(0, 1, (char *)status), nullptr);
+    status[2] = 0x01;
+    EXPECT_NE(cap.trigger(0, 1, (char *)status), nullptr);
+
+    // A new Trip RECORD triggers; the same record again doesn't
+    unsigned char record[68] = {5, 2};
+    record[6] = 1;  // TIME
+    EXPECT_EQ(cap.trigger(0, 2, (char *)record), nullptr);
+    record[6] = 2;
+    EXPECT_STREQ(cap.trigger(0, 2, (char *)record), "EVTYPE Trip");
+    EXPECT_EQ(cap.trigger(0, 2, (char *)record), nullptr);
+    record[0] = 3;  // not a trigger event type
+    record[6] = 3;
+    EXPECT_EQ(cap.trigger(0, 2, (char *)record), nullptr);
+}
+
+/********************************************************************
+ ** Test how much of the pre-trigger window the ring can hold
+ ********************************************************************
+*/
+TEST(CaptureTest, Reach)
+{
+    ipmCapture cap;
+    cap.configure(5, 5);
+    EXPECT_FLOAT_EQ(cap.reach(100, 0), 5);
+    EXPECT_FLOAT_EQ(cap.reach(0, 0), 5);
+    // 4096 responses, less 5 s at 800 a second for the post window
+    EXPECT_FLOAT_EQ(cap.reach(400, 400), 0.24);
+    EXPECT_FLOAT_EQ(cap.reach(400, 500), 0);
+    EXPECT_FLOAT_EQ(cap.reach(0, 1000), 0);
+}
+
+/********************************************************************
+ ** Test the ring and the window written for a capture
+ ********************************************************************
+*/
+TEST(CaptureTest, Dump)
+{
+    ipmCapture cap;
+    cap.configure(1, 0.5);
+    unsigned char measure[34] = {88, 2};
+    unsigned char status[12] = {2, 1};
+
+    // Fill past the end of the ring
+    for (int j = 0; j < ipmCapture::RINGLEN + 10; j++)
+    {
+        cap.add(0, 0, (char *)measure, 90 + j * 0.001);
+    }
+    EXPECT_EQ(cap._count, ipmCapture::RINGLEN);
+
+    cap.add(0, 0, (char *)measure, 98.9);  // before the pre window
+    cap.add(0, 0, (char *)measure, 99.1);
+    cap.add(1, 0, (char *)measure, 99.2);  // other address
+    cap.add(0, 1, (char *)status, 99.5);
+    EXPECT_TRUE(cap.start(0, 100, "test"));
+    EXPECT_FALSE(cap.start(0, 100.1, "again"));
+    EXPECT_EQ(cap.ignored(), 1);
+    cap.add(0, 0, (char *)measure, 100.4);
+    EXPECT_FALSE(cap.done(0, 100.4));
+    cap.add(0, 0, (char *)measure, 100.6);  // after the post window
+    EXPECT_TRUE(cap.done(0, 100.6));
+
+    std::stringstream file;
+    ipmUdp udp;  // not open, so packets are queued and counted as errors
+    EXPECT_EQ(cap.dump(0, 3, file, udp, 0), 3);
+    EXPECT_FALSE(cap.active(0));
+
+    std::string line;
+    std::getline(file, line);
+    EXPECT_EQ(line, "# iPM address 3 capture: test at 100.000000, pre 1 s, "
+        "post 0.5 s");
+    std::getline(file, line);
+    EXPECT_EQ(line.substr(0, 35), "CAPTURE,3,99.100000,MEASURE,0258,00");
+    std::getline(file, line);
+    EXPECT_EQ(line, "CAPTURE,3,99.500000,STATUS,02,01,0000,0000,0000");
+    std::getline(file, line);
+    EXPECT_EQ(line.substr(0, 20), "CAPTURE,3,100.400000");
+}
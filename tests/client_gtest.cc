@@ -0,0 +1,59 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <string>
+#include <unistd.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/client.cc"
+#include "../src/server.h"
+
+/********************************************************************
+ ** Test requests to an ipmServer and the replies
+ ********************************************************************
+*/
+TEST(ClientTest, Request)
+{
+    std::string path = "/tmp/ipm_client_gtest_" + std::to_string(getpid());
+    ipmClient client;
+    EXPECT_FALSE(client.connect(path.c_str()));
+
+    ipmServer server;
+    ASSERT_TRUE(server.open(path.c_str()));
+    ASSERT_TRUE(client.connect(path.c_str()));
+    server.poll(10);  // accept
+    ASSERT_EQ(server.clients(), 1);
+
+    // The reply is waiting before the request is made, so request()
+    // doesn't need the server to run alongside it
+    std::string line, reply;
+    server.reply(0, "MEASURE? n=3\nSTATUS? n=3\nOK\n");
+    EXPECT_TRUE(client.request("LATENCY", reply, 100));
+    EXPECT_EQ(reply, "MEASURE? n=3\nSTATUS? n=3\n");
+    EXPECT_TRUE(server.poll(10));
+    EXPECT_EQ(server.next(line), 0);
+    EXPECT_EQ(line, "LATENCY");
+
+    // Errors, and lines after the end of one reply kept for the next
+    server.reply(0, "ERR unknown request\nOK\n");
+    EXPECT_FALSE(client.request("BOGUS", reply, 100));
+    EXPECT_EQ(reply, "ERR unknown request");
+    EXPECT_TRUE(client.request("HEALTH", reply, 100));
+    EXPECT_EQ(reply, "");
+
+    // An iPM response of OK doesn't end a SEND reply early
+    server.reply(0, "| OK\nOK\n| VER A022(L)\n| 2018-11-13\nOK\n");
+    EXPECT_TRUE(client.request("SEND 2 OFF", reply, 100));
+    EXPECT_EQ(reply, "OK\n");
+    EXPECT_TRUE(client.request("SEND 2 VER?", reply, 100));
+    EXPECT_EQ(reply, "VER A022(L)\n2018-11-13\n");
+
+    // No reply, and the server going away
+    EXPECT_FALSE(client.request("SEND 2 VER?", reply, 10));
+    EXPECT_EQ(reply, "no reply");
+    server.close();
+    EXPECT_FALSE(client.request("HEALTH", reply, 100));
+    EXPECT_NE(reply, "no reply");
+}
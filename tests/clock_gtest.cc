@@ -0,0 +1,123 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <sstream>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/clock.cc"
+
+namespace
+{
+    // RECORD data with an event type, power up count and TIME
+    void makeRecord(char *data, int evtype, uint32_t powercnt,
+        uint32_t time)
+    {
+        memset(data, 0, 68);
+        data[0] = evtype;
+        for (int b = 0; b < 4; b++)
+        {
+            data[2 + b] = (powercnt >> (8 * b)) & 0xff;
+            data[6 + b] = (time >> (8 * b)) & 0xff;
+        }
+    }
+
+    // An iPM that powered up at POWERUP (usec UTC) and saves a record
+    // every 2 minutes of its time, polled every 7 s
+    const int64_t POWERUP = 1718215502104233LL;
+
+    void poll(ipmClock &c, double drift, int64_t from, int64_t to)
+    {
+        char data[68];
+        for (int64_t now = from; now < to; now += 7000000)
+        {
+            // Latest record saved by now
+            double elapsed = (now - POWERUP) / (1 + drift) / 1000;  // ms
+            uint32_t time = (uint32_t)(elapsed / 120000) * 120000;
+            makeRecord(data, 0, 3, time);
+            c.record(0, data, now);
+        }
+    }
+}
+
+/********************************************************************
+ ** Test the fit of RECORD TIME to UTC
+ ********************************************************************
+*/
+TEST(ClockTest, NoEstimate)
+{
+    ipmClock c;
+    int64_t t;
+    long uncertainty;
+    EXPECT_FALSE(c.utc(0, 0, t, uncertainty));
+
+    // The first record seen may be any age, so it's only an upper bound
+    char data[68];
+    makeRecord(data, 0, 3, 120000);
+    EXPECT_TRUE(c.record(0, data, POWERUP + 125000000));
+    EXPECT_FALSE(c.record(0, data, POWERUP + 132000000));
+    EXPECT_FALSE(c.utc(0, 0, t, uncertainty));
+    EXPECT_EQ(c.points(0), 1);
+
+    std::ostringstream os;
+    c.print(0, os);
+    EXPECT_EQ(os.str(), "POWERCNT=3\nDRIFT=0.000\nRECORDS=1\n"
+        "EVENT=Periodic,unknown\n");
+}
+
+TEST(ClockTest, Offset)
+{
+    ipmClock c;
+    poll(c, 0, POWERUP + 100000000, POWERUP + 3000000000LL);
+
+    int64_t t;
+    long uncertainty;
+    ASSERT_TRUE(c.utc(0, 0, t, uncertainty));
+    EXPECT_LE(uncertainty, 1000000);  // records fall 1 s later each poll
+    EXPECT_LE(std::llabs(t - POWERUP), uncertainty);
+    EXPECT_EQ(c.powercnt(0), 3u);
+    EXPECT_EQ(c.points(0), 25);  // one a record, 100 to 3000 s
+}
+
+TEST(ClockTest, Drift)
+{
+    ipmClock c;
+    double drift = 50e-6;
+    poll(c, drift, POWERUP + 100000000, POWERUP + 4000000000LL);
+
+    // The truth is always inside the window
+    int64_t t;
+    long uncertainty;
+    ASSERT_TRUE(c.utc(0, c.time(0), t, uncertainty));
+    int64_t truth = POWERUP + std::llround(c.time(0) * 1000.0 * (1 + drift));
+    EXPECT_LE(std::llabs(t - truth), uncertainty + 1);
+    EXPECT_LT(uncertainty, 3500000);
+    EXPECT_NE(c.drift(0), 0);
+}
+
+TEST(ClockTest, PowerCycle)
+{
+    ipmClock c;
+    poll(c, 0, POWERUP + 100000000, POWERUP + 1000000000LL);
+    EXPECT_GT(c.points(0), 1);
+
+    // A new power up count starts over, with the last RECORD? still the
+    // lower bound
+    char data[68];
+    makeRecord(data, 1, 4, 50);
+    EXPECT_TRUE(c.record(0, data, POWERUP + 1005000000LL));
+    EXPECT_EQ(c.points(0), 1);
+    EXPECT_EQ(c.powercnt(0), 4u);
+    EXPECT_STREQ(ipmClock::eventName(c.evtype(0)), "Power Up");
+
+    int64_t t;
+    long uncertainty;
+    ASSERT_TRUE(c.utc(0, 50, t, uncertainty));
+    EXPECT_EQ(uncertainty, 4500000);  // polled at 996 s and 1005 s
+
+    std::ostringstream os;
+    c.print(0, os);
+    EXPECT_NE(os.str().find("EVENT=Power Up,1718216502.604233\n"),
+        std::string::npos);
+}
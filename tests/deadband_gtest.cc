@@ -0,0 +1,73 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/deadband.cc"
+
+/********************************************************************
+ ** Test parsing deadbands
+ ********************************************************************
+*/
+TEST(DeadbandTest, Configure)
+{
+    ipmDeadband db;
+    std::string error;
+    char spec[] = "*=1,FREQ=0.2,POWEROK=0";
+    EXPECT_TRUE(db.configure(spec, error));
+    EXPECT_FLOAT_EQ(db.deadband(0, 0), 0.2);   // FREQ
+    EXPECT_FLOAT_EQ(db.deadband(0, 2), 1);     // VRMSA
+    EXPECT_FLOAT_EQ(db.deadband(0, 17), 0);    // MEASURE POWEROK
+    EXPECT_FLOAT_EQ(db.deadband(1, 1), 0);     // STATUS POWEROK
+
+    EXPECT_FALSE(db.configure("NOSUCH=1", error));
+    EXPECT_EQ(error, "NOSUCH=1");
+    EXPECT_FALSE(db.configure("FREQ", error));
+    EXPECT_FALSE(db.configure("FREQ=x", error));
+    EXPECT_FALSE(db.configure("FREQ=-1", error));
+}
+
+/********************************************************************
+ ** Test change-driven publishing
+ ********************************************************************
+*/
+TEST(DeadbandTest, Check)
+{
+    ipmDeadband db;
+    std::string error;
+    EXPECT_TRUE(db.configure("FREQ=0.2", error));
+    db.setHeartbeat(10);
+
+    unsigned char measure[34] = {88, 2};  // FREQ 60.0 Hz
+    uint64_t all = ipmFields::all(0);
+
+    // The first frame is always published
+    EXPECT_TRUE(db.check(0, 0, (char *)measure, all, 0));
+    EXPECT_FALSE(db.check(0, 0, (char *)measure, all, 1));
+
+    // Within the deadband, relative to the last frame published
+    measure[0] = 90;  // 60.2 Hz
+    EXPECT_FALSE(db.check(0, 0, (char *)measure, all, 2));
+    measure[0] = 91;  // 60.3 Hz
+    EXPECT_TRUE(db.check(0, 0, (char *)measure, all, 3));
+
+    // Any change to a field with no deadband
+    measure[33] = 1;  // POWEROK
+    EXPECT_TRUE(db.check(0, 0, (char *)measure, all, 4));
+
+    // Unless the field isn't sent
+    measure[33] = 0;
+    EXPECT_FALSE(db.check(0, 0, (char *)measure, all & ~(1ull << 17), 5));
+
+    // Addresses are independent
+    EXPECT_TRUE(db.check(1, 0, (char *)measure, all, 5));
+
+    // Heartbeat
+    EXPECT_FALSE(db.check(0, 0, (char *)measure, all & ~(1ull << 17), 13.9));
+    EXPECT_TRUE(db.check(0, 0, (char *)measure, all & ~(1ull << 17), 14));
+
+    EXPECT_EQ(db.published(), 5);
+    EXPECT_EQ(db.suppressed(), 4);
+}
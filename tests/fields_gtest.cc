@@ -0,0 +1,172 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <sstream>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/fields.cc"
+
+/********************************************************************
+ ** Test the field table against the hex UDP packet layout
+ ********************************************************************
+*/
+TEST(FieldsTest, Count)
+{
+    EXPECT_EQ(ipmFields::count(0), 18);  // MEASURE
+    EXPECT_EQ(ipmFields::count(1), 5);   // STATUS
+    EXPECT_EQ(ipmFields::count(2), 33);  // RECORD
+
+    EXPECT_STREQ(ipmFields::prefix(2), "RECORD");
+    EXPECT_STREQ(ipmFields::field(0, 0).name, "FREQ");
+    EXPECT_STREQ(ipmFields::field(2, 32).name, "CRC");
+}
+
+/********************************************************************
+ ** Test nidas sample generation
+ ********************************************************************
+*/
+TEST(FieldsTest, PrintSample)
+{
+    std::ostringstream os;
+    std::set<std::string> seen;
+    uint64_t masks[3] = {ipmFields::all(0), ipmFields::all(1),
+        ipmFields::all(2)};
+    ipmFields::printSample(os, 2, 1, 1 << 1, false, seen, masks);
+    std::string xml = os.str();
+    EXPECT_NE(xml.find("<sample id=\"2\" rate=\"1\" "
+        "scanfFormat=\"STATUS,%x,%x,%x,%x,%x\">"), std::string::npos);
+    EXPECT_NE(xml.find("name=\"TRIPFLAGS\""), std::string::npos);
+    EXPECT_EQ(xml.find("CYCLEMASK"), std::string::npos);
+    EXPECT_EQ(seen.size(), 5u);
+
+    // A later sample in the same sensor skips names already used
+    os.str("");
+    ipmFields::printSample(os, 3, 1, 1 << 2, false, seen, masks);
+    xml = os.str();
+    EXPECT_NE(xml.find("scanfFormat=\"RECORD,%x,%*x,%x,"), std::string::npos);
+    EXPECT_EQ(xml.find("name=\"OPSTATE\""), std::string::npos);
+}
+
+TEST(FieldsTest, PrintCombinedSample)
+{
+    std::ostringstream os;
+    std::set<std::string> seen;
+    uint64_t masks[3] = {ipmFields::all(0), ipmFields::all(1),
+        ipmFields::all(2)};
+    // MEASURE and STATUS; POWEROK is read from MEASURE only
+    ipmFields::printSample(os, 1, 5, (1 << 0) | (1 << 1), true, seen, masks);
+    std::string xml = os.str();
+    EXPECT_NE(xml.find("scanfFormat=\"CYCLE,%*f,%x,MEASURE,%x,"),
+        std::string::npos);
+    EXPECT_NE(xml.find(",%x,STATUS,%x,%*x,%x,%x,%x\">"), std::string::npos);
+    EXPECT_NE(xml.find("name=\"CYCLEMASK\""), std::string::npos);
+
+    size_t first = xml.find("name=\"POWEROK\"");
+    EXPECT_NE(first, std::string::npos);
+    EXPECT_EQ(xml.find("name=\"POWEROK\"", first + 1), std::string::npos);
+
+    // Calibrated fields carry their cal file
+    EXPECT_NE(xml.find("<calfile file=\"VRMS_IPM.dat\""), std::string::npos);
+}
+
+TEST(FieldsTest, PrintProjectedSample)
+{
+    std::ostringstream os;
+    std::set<std::string> seen;
+    uint64_t masks[3] = {0x20005, 0, 0};  // FREQ, VRMSA, POWEROK
+    ipmFields::printSample(os, 1, 1, 1 << 0, false, seen, masks);
+    std::string xml = os.str();
+    EXPECT_NE(xml.find("scanfFormat=\"MEASURE,%x,%x,%x\">"),
+        std::string::npos);
+    EXPECT_EQ(xml.find("name=\"TEMP\""), std::string::npos);
+    EXPECT_EQ(seen.size(), 3u);
+}
+
+TEST(FieldsTest, PrintStampedSample)
+{
+    std::ostringstream os;
+    std::set<std::string> seen;
+    uint64_t masks[3] = {0x20005, ipmFields::all(1), 0};
+    ipmFields::printSample(os, 1, 1, 1 << 0, false, seen, masks, true);
+    EXPECT_NE(os.str().find("scanfFormat=\"MEASURE,%*f,%x,%x,%x\">"),
+        std::string::npos);
+    os.str("");
+    ipmFields::printSample(os, 1, 5, (1 << 0) | (1 << 1), true, seen, masks,
+        true);
+    EXPECT_NE(os.str().find("scanfFormat=\"CYCLE,%*f,%x,MEASURE,%*f,%*x,"
+        "%*x,%*x,STATUS,%*f,%x,"), std::string::npos);
+}
+
+/********************************************************************
+ ** Test field projection
+ ********************************************************************
+*/
+TEST(FieldsTest, Format)
+{
+    unsigned char measure[] = {88, 2, 0, 0, 5, 2, 139, 4, 139, 4, 0, 0, 4,
+        6, 252, 5, 0, 0, 28, 0, 28, 0, 9, 0, 201, 13, 200, 6, 7, 7, 27, 27,
+        1, 1};
+    char buf[256];
+
+    // Every field matches ipmMeasure::createUDP in hex mode
+    int len = ipmFields::format(buf, 255, 0, (char *)measure,
+        ipmFields::all(0));
+    EXPECT_STREQ(buf, "MEASURE,0258,0205,048b,048b,0000,0604,05fc,0000,001c,"
+        "001c,0009,0dc9,06c8,0707,1b,1b,01,01\r\n");
+    EXPECT_EQ(len, (int)strlen(buf));
+
+    len = ipmFields::format(buf, 255, 0, (char *)measure, 0x20005);
+    EXPECT_STREQ(buf, "MEASURE,0258,048b,01\r\n");
+
+    // 32 bit fields
+    unsigned char status[] = {2, 1, 0x44, 0x33, 0x22, 0x11, 0, 0, 0, 0, 7,
+        0};
+    ipmFields::format(buf, 255, 1, (char *)status, ipmFields::all(1));
+    EXPECT_STREQ(buf, "STATUS,02,01,11223344,0000,0007\r\n");
+}
+
+TEST(FieldsTest, ParseFormat)
+{
+    int frame;
+    uint64_t mask;
+    EXPECT_TRUE(ipmFields::parseFormat("STATUS,%x,%*x,%x,%x,%*x", frame,
+        mask));
+    EXPECT_EQ(frame, 1);
+    EXPECT_EQ(mask, 0xdu);
+
+    // Fields without a conversion aren't read, extra conversions are
+    // ignored
+    EXPECT_TRUE(ipmFields::parseFormat("STATUS,%x,%*x,%x", frame, mask));
+    EXPECT_EQ(mask, 0x5u);
+    EXPECT_TRUE(ipmFields::parseFormat("STATUS,%x,%*x,%x,%x,%*x,%*x", frame,
+        mask));
+    EXPECT_EQ(mask, 0xdu);
+
+    // The sampling time (-s) isn't a field
+    EXPECT_TRUE(ipmFields::parseFormat("STATUS,%*f,%x,%*x,%x", frame, mask));
+    EXPECT_EQ(mask, 0x5u);
+
+    // Not an iPM frame
+    EXPECT_FALSE(ipmFields::parseFormat("CYCLE,%*f,%x", frame, mask));
+}
+
+TEST(FieldsTest, ReadXml)
+{
+    uint64_t masks[3] = {ipmFields::all(0), ipmFields::all(1),
+        ipmFields::all(2)};
+
+    // The dsm entry for port 30224 refers to the iPM_3phase catalog sensor
+    EXPECT_EQ(ipmFields::readXml("../ipm.xml", 30224, masks), 7);
+    // MEASURE reads every field but TEMP
+    EXPECT_EQ(masks[0], ipmFields::all(0) & ~2ull);
+    EXPECT_EQ(masks[1], 0xdu);
+
+    // No sensor reads the port
+    uint64_t none[3] = {1, 1, 1};
+    EXPECT_EQ(ipmFields::readXml("../ipm.xml", 1, none), 0);
+    EXPECT_EQ(none[0], 1u);
+
+    EXPECT_EQ(ipmFields::readXml("nonexistent.xml", 30224, masks), -1);
+}
@@ -0,0 +1,46 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <sstream>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/histogram.cc"
+
+/********************************************************************
+ ** Test buckets, summary and percentiles
+ ********************************************************************
+*/
+TEST(HistogramTest, Buckets)
+{
+    ipmHistogram h;
+    std::ostringstream empty;
+    h.summary(empty);
+    EXPECT_EQ(empty.str(), "n=0 min=0 mean=0 p50=0 p99=0 max=0 us");
+
+    h.add(0);
+    h.add(3);     // 2-4 us
+    h.add(3);
+    h.add(100);   // 64-128 us
+    h.add(5000000);
+    h.add(-5);    // counted as 0
+    EXPECT_EQ(h.count(), 6u);
+    EXPECT_EQ(h.bucket(0), 2u);
+    EXPECT_EQ(h.bucket(2), 2u);
+    EXPECT_EQ(h.bucket(7), 1u);
+    EXPECT_EQ(h.bucket(ipmHistogram::NBUCKETS - 1), 1u);
+    EXPECT_EQ(h.min(), 0);
+    EXPECT_EQ(h.max(), 5000000);
+    EXPECT_EQ(h.percentile(50), 4);
+    EXPECT_EQ(h.percentile(70), 128);
+    EXPECT_EQ(h.percentile(99), 5000000);
+
+    std::ostringstream out;
+    h.print(out);
+    EXPECT_EQ(out.str(), "<1 2\n<4 2\n<128 1\n>=1048576 1\n");
+
+    h.reset();
+    EXPECT_EQ(h.count(), 0u);
+    EXPECT_EQ(h.max(), 0);
+}
@@ -0,0 +1,99 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <string>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/io.cc"
+
+// A pty stands in for the iPM: the test's end is the raw slave side
+class IoTest : public ::testing::TestWithParam<const char *> {
+public:
+    int _port;    // as naiipm opens it
+    int _ipm;
+
+    void SetUp()
+    {
+        _port = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        ASSERT_GE(_port, 0);
+        grantpt(_port);
+        unlockpt(_port);
+        _ipm = open(ptsname(_port), O_RDWR | O_NOCTTY);
+        ASSERT_GE(_ipm, 0);
+        struct termios t;
+        tcgetattr(_ipm, &t);
+        cfmakeraw(&t);
+        tcsetattr(_ipm, TCSANOW, &t);
+    }
+
+    void TearDown()
+    {
+        close(_ipm);
+        close(_port);
+    }
+};
+
+/********************************************************************
+ ** Test a command and its response through each backend
+ ********************************************************************
+*/
+TEST_P(IoTest, Transfer)
+{
+    ipmIo *io = ipmIo::create(GetParam());
+    ASSERT_NE(io, nullptr);
+    if (strcmp(GetParam(), "epoll") == 0)
+    {
+        EXPECT_STREQ(io->name(), "epoll");
+    }
+
+    // Response already waiting
+    char in[64];
+    write(_ipm, "34\n", 3);
+    int n = io->transfer(_port, "MEASURE?\n", 9, in, sizeof(in), 100000);
+    EXPECT_EQ(std::string(in, n > 0 ? n : 0), "34\n");
+    char cmd[64];
+    n = read(_ipm, cmd, sizeof(cmd));
+    EXPECT_EQ(std::string(cmd, n > 0 ? n : 0), "MEASURE?\n");
+    EXPECT_GT(io->syscalls(), 0u);
+    if (strcmp(io->name(), "epoll") == 0)
+    {
+        EXPECT_GT(io->drained(), 0);  // only epoll waits for the write
+        EXPECT_GT(io->wrote(), 0);
+        EXPECT_GE(io->drained(), io->wrote());
+    } else {
+        EXPECT_EQ(io->drained(), 0);
+    }
+
+    // Timeout, with and without a command
+    EXPECT_EQ(io->transfer(_port, NULL, 0, in, sizeof(in), 20000), 0);
+    EXPECT_EQ(io->transfer(_port, "ADR 2\n", 6, in, sizeof(in), 20000), 0);
+    n = read(_ipm, cmd, sizeof(cmd));
+    EXPECT_EQ(std::string(cmd, n > 0 ? n : 0), "ADR 2\n");
+
+    delete io;
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, IoTest,
+    ::testing::Values("epoll", "uring"));
+
+/********************************************************************
+ ** Test the io_uring backend takes one system call per transfer
+ ********************************************************************
+*/
+TEST_F(IoTest, UringSyscalls)
+{
+    ipmUringIo io;
+    if (not io.open())
+    {
+        GTEST_SKIP() << "io_uring not available";
+    }
+    char in[64];
+    write(_ipm, "VER A022(L) 2018-11-13\n", 23);
+    EXPECT_EQ(io.transfer(_port, "VER?\n", 5, in, sizeof(in), 100000), 23);
+    EXPECT_EQ(io.syscalls(), 1u);
+}
@@ -0,0 +1,108 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <sstream>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/metrics.cc"
+
+/********************************************************************
+ ** Test command times and counters
+ ********************************************************************
+*/
+TEST(MetricsTest, Commands)
+{
+    EXPECT_EQ(ipmMetrics::command("MEASURE?"), ipmMetrics::MEASURE);
+    EXPECT_EQ(ipmMetrics::command("RECORD?"), ipmMetrics::RECORD);
+    EXPECT_EQ(ipmMetrics::command("ADR"), ipmMetrics::ADR);
+    EXPECT_EQ(ipmMetrics::command("VER?"), ipmMetrics::OTHER);
+    EXPECT_STREQ(ipmMetrics::commandName(ipmMetrics::STATUS), "STATUS");
+    EXPECT_STREQ(ipmMetrics::phaseName(ipmMetrics::FIRSTBYTE),
+        "FIRSTBYTE");
+    EXPECT_STREQ(ipmMetrics::counterName(ipmMetrics::SHORTREADS),
+        "SHORTREADS");
+}
+
+TEST(MetricsTest, Print)
+{
+    ipmMetrics m;
+    std::ostringstream os;
+    m.print(os);
+    EXPECT_EQ(os.str(), "UDP SEND n=0 min=0 mean=0 p50=0 p99=0 max=0 us\n");
+
+    m.add(2, ipmMetrics::MEASURE, ipmMetrics::FIRSTBYTE, 3000);
+    m.add(2, ipmMetrics::MEASURE, ipmMetrics::FIRSTBYTE, 5000);
+    m.add(9, ipmMetrics::MEASURE, ipmMetrics::FIRSTBYTE, 5000);  // ignored
+    m.count(2, ipmMetrics::TIMEOUTS);
+    m.count(2, ipmMetrics::BADDATA);
+    m.count(-1, ipmMetrics::BADDATA);
+    m.sent(40);
+    EXPECT_EQ(m.phase(2, ipmMetrics::MEASURE, ipmMetrics::FIRSTBYTE).count(),
+        2u);
+    EXPECT_EQ(m.counter(2, ipmMetrics::TIMEOUTS), 1u);
+    EXPECT_EQ(m.counter(2, ipmMetrics::HEADERERRORS), 0u);
+
+    os.str("");
+    m.print(os);
+    EXPECT_EQ(os.str(), "ADDR2 MEASURE FIRSTBYTE n=2 min=3000 mean=4000 "
+        "p50=4096 p99=5000 max=5000 us\n"
+        "ADDR2 TIMEOUTS=1 SHORTREADS=0 HEADERERRORS=0 BADDATA=1\n"
+        "UDP SEND n=1 min=40 mean=40 p50=40 p99=40 max=40 us\n");
+}
+
+TEST(MetricsTest, Rates)
+{
+    ipmMetrics m;
+    int64_t t0 = 1000000;
+    EXPECT_EQ(m.rate(2, ipmMetrics::MEASURE, t0), 0);
+
+    // 5 hz for 10 s, then the rate holds until the window is overdue
+    for (int j = 0; j <= 50; j++)
+    {
+        m.sampled(2, ipmMetrics::MEASURE, t0 + j * 200000, 1718215503.0 + j);
+    }
+    EXPECT_EQ(m.samples(2, ipmMetrics::MEASURE), 51u);
+    EXPECT_EQ(m.lastSample(2), 1718215553.0);
+    EXPECT_DOUBLE_EQ(m.rate(2, ipmMetrics::MEASURE, t0 + 10000000), 5);
+    EXPECT_DOUBLE_EQ(m.rate(2, ipmMetrics::MEASURE, t0 + 15000000), 5);
+    EXPECT_DOUBLE_EQ(m.rate(2, ipmMetrics::MEASURE, t0 + 30000000), 0.05);
+    m.sampled(9, ipmMetrics::MEASURE, t0, 1);  // ignored
+
+    // Busy 100 ms of every 400
+    for (int j = 0; j <= 25; j++)
+    {
+        m.busy(100000, t0 + j * 400000);
+    }
+    EXPECT_DOUBLE_EQ(m.utilization(t0 + 10000000), 0.25);
+}
+
+TEST(MetricsTest, Expose)
+{
+    ipmMetrics m;
+    m.sampled(2, ipmMetrics::STATUS, 1000000, 1718215503.25);
+    m.add(2, ipmMetrics::STATUS, ipmMetrics::FIRSTBYTE, 3000);
+    m.count(2, ipmMetrics::TIMEOUTS);
+    std::ostringstream os;
+    m.expose(os, 3000000);
+    std::string text = os.str();
+    EXPECT_NE(text.find("# TYPE ipm_samples_total counter\n"
+        "ipm_samples_total{addr=\"2\",command=\"STATUS\"} 1\n"),
+        std::string::npos);
+    EXPECT_NE(text.find("ipm_samples_per_second{addr=\"2\","
+        "command=\"STATUS\"} 0.500000\n"), std::string::npos);
+    EXPECT_NE(text.find("ipm_last_sample_timestamp_seconds{addr=\"2\"} "
+        "1718215503.250000\n"), std::string::npos);
+    EXPECT_NE(text.find("ipm_link_utilization 0.000000\n"),
+        std::string::npos);
+    EXPECT_NE(text.find("ipm_command_seconds{addr=\"2\",command=\"STATUS\","
+        "phase=\"FIRSTBYTE\",quantile=\"0.99\"} 0.003000\n"
+        "ipm_command_seconds_sum{addr=\"2\",command=\"STATUS\","
+        "phase=\"FIRSTBYTE\"} 0.003000\n"), std::string::npos);
+    EXPECT_NE(text.find("ipm_errors_total{addr=\"2\",type=\"TIMEOUTS\"} 1\n"
+        "ipm_errors_total{addr=\"2\",type=\"SHORTREADS\"} 0\n"),
+        std::string::npos);
+    EXPECT_EQ(text.find("addr=\"0\""), std::string::npos);
+    EXPECT_NE(text.find("ipm_udp_send_seconds_count 0\n"), std::string::npos);
+}
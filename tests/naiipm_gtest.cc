@@ -4,6 +4,7 @@
 */
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include <sys/un.h>
 // sytem header includes must be before private public def
 #define private public  // so can test private functions
 
@@ -12,6 +13,7 @@
 #include "../src/cmd.cc"
 
 using ::testing::Return;
+using ::testing::_;
 
 class MockNaiipm : public naiipm {
 public:
@@ -66,6 +68,66 @@ TEST_F(IpmTest, ipmSendBadCommand)
     EXPECT_EQ(testing::internal::GetCapturedStdout(),
         "Command BADCOMMAND is invalid. Please enter a valid command\n");
 }
+/********************************************************************
+ ** Test a command and its response through a pty, with the binary data
+ ** arriving in the same read as the length
+ ********************************************************************
+*/
+TEST_F(IpmTest, ipmSendReceive)
+{
+    int port = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+    ASSERT_GE(port, 0);
+    grantpt(port);
+    unlockpt(port);
+    int dev = open(ptsname(port), O_RDWR | O_NOCTTY);
+    ASSERT_GE(dev, 0);
+    struct termios t;
+    tcgetattr(dev, &t);
+    cfmakeraw(&t);
+    tcsetattr(dev, TCSANOW, &t);
+
+    const char status[] = "12\n\x02\x01\x04\x00\x00\x00\x08\x00\x00\x00"
+        "\x00\x00";
+    write(dev, status, 15);
+    EXPECT_TRUE(ipm.send_command(port, "STATUS?"));
+    EXPECT_EQ(memcmp(ipm.getData("STATUS?"), status + 3, 12), 0);
+    char cmd[64];
+    int n = read(dev, cmd, sizeof(cmd));
+    EXPECT_EQ(std::string(cmd, n > 0 ? n : 0), "STATUS?\n");
+    EXPECT_EQ(ipm._rxpos, ipm._rxlen);
+
+    // The exchange is timestamped, and the iPM sampled between the write
+    // and the response
+    EXPECT_GT(ipm._stamp.written(), 0);
+    EXPECT_GE(ipm._stamp.first(), ipm._stamp.written());
+    EXPECT_GE(ipm._stamp.last(), ipm._stamp.first());
+    int64_t sampled = (int64_t)ipm._dataTime.tv_sec * 1000000 +
+        ipm._dataTime.tv_nsec / 1000;
+    EXPECT_GE(sampled, ipm._stamp.utc(ipm._stamp.written()));
+    EXPECT_LE(sampled, ipm._stamp.utc(ipm._stamp.first()));
+    EXPECT_EQ(ipm._metrics.phase(0, ipmMetrics::STATUS,
+        ipmMetrics::FIRSTBYTE).count(), 1u);
+    EXPECT_EQ(ipm._metrics.phase(0, ipmMetrics::STATUS,
+        ipmMetrics::TRANSFER).count(), 1u);
+
+    // Counted against the address selected. No response is a timeout,
+    // not a header error, and a wrong one is.
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(ipm.send_command(port, "ADR", "3"));
+    EXPECT_FALSE(ipm.send_command(port, "STATUS?"));
+    write(dev, "BAD\n", 4);
+    EXPECT_FALSE(ipm.send_command(port, "STATUS?"));
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(ipm._metrics.counter(3, ipmMetrics::TIMEOUTS), 1u);
+    EXPECT_EQ(ipm._metrics.counter(3, ipmMetrics::HEADERERRORS), 1u);
+    EXPECT_EQ(ipm._metrics.counter(3, ipmMetrics::BADDATA), 3u);
+    EXPECT_EQ(ipm._metrics.counter(0, ipmMetrics::BADDATA), 0u);
+    ipm._badData = 0;
+
+    close(dev);
+    close(port);
+}
+
 /********************************************************************
  ** Test clear function (using mock)
  ********************************************************************
@@ -94,6 +156,52 @@ TEST_F(IpmTest, ipmClear)
     EXPECT_EQ(testing::internal::GetCapturedStdout(),
         "Took 0 ADR commands to clear iPM on init\n");
 }
+/********************************************************************
+ ** Test that addresses are initialized together (using mock)
+ ********************************************************************
+*/
+TEST_F(IpmTest, ipmInit)
+{
+    MockNaiipm mipm;
+    mipm.open_udp("192.168.84.2");
+
+    char addrinfo[2][12] = {"0,5,30101", "2,5,30102"};
+    args.setNumAddr("2");
+    for (int i=0; i < 2; i++)
+    {
+        args.setAddrInfo(i, addrinfo[i]);
+        args.parse_addrInfo(i);
+    }
+
+    std::string sent;
+    int active = -1;
+    EXPECT_CALL(mipm, setActiveAddress)
+        .WillRepeatedly([&](int, int addr) {
+            sent += "ADR" + std::to_string(addr) + " ";
+            active = addr;
+            return true;
+        });
+    EXPECT_CALL(mipm, send_command)
+        .WillRepeatedly([&](int, std::string msg, std::string) {
+            sent += msg + " ";
+            // OFF fails at address 2, so it is removed
+            return not (msg == "OFF" and active == 2);
+        });
+
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(mipm.init(-1));
+    std::string out = testing::internal::GetCapturedStdout();
+
+    // Address 2 goes while address 0 waits after OFF
+    EXPECT_EQ(sent, "ADR0 ADR0 VER? OFF ADR2 ADR2 VER? OFF "
+        "ADR0 RESET SERNO? VER? TEST BITRESULT? ");
+    EXPECT_NE(out.find("Removing address 2"), std::string::npos);
+    EXPECT_EQ(args.numAddr(), 1);
+    EXPECT_EQ(args.Addr(0), 0);
+
+    mipm.close_udp();
+}
+
 /********************************************************************
  ** Test setting interactive mode
  ********************************************************************
@@ -242,7 +350,673 @@ TEST_F(IpmTest, ipmParseDataScale)
     EXPECT_EQ(testing::internal::GetCapturedStdout(),
         "sending to port 30101 UDP string RECORD,0,2,99,74007691,0,0,20.90,117.90,20.90,117.90,0.00,0.00,58.10,60.00,0.0000,0.0940,0.0000,0.0850,0.0000,0.0210,2.60,11.30,2.60,11.30,0.10,0.10,154.00,162.60,154.00,161.90,0.00,2.40,142351123\r\n");
 
-    ipm.close_udp(atoi(args.Address()));
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmCombinedPacket)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,7,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    args.setRate("1");  // hz
+    args.setPeriod("10");  // minutes
+    args.setCombined();
+
+    testing::internal::CaptureStdout();
+    ipm.setSchedule();
+    testing::internal::GetCapturedStdout();
+    ipm._cycleTime = {1700000000, 250000000};
+
+    // Frames are held until the end of the cycle
+    testing::internal::CaptureStdout();
+    ipm.parseData("MEASURE?", 0);
+    ipm.parseData("STATUS?", 0);
+    EXPECT_EQ(ipm._fresh[0], 3);
+    ipm.send_cycle();
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+        "sending to port 30101 UDP string CYCLE,1700000000.250000,3,"
+        "MEASURE,0258,0205,048b,048b,0000,0604,05fc,0000,001c,001c,0009,"
+        "0dc9,06c8,0707,1b,1b,01,01,STATUS,02,01,0000,0000,0000\r\n");
+    EXPECT_EQ(ipm._fresh[0], 0);
+
+    // Frames not read this cycle repeat their last values
+    testing::internal::CaptureStdout();
+    ipm.parseData("RECORD?", 0);
+    ipm.send_cycle();
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("CYCLE,1700000000.250000,4,MEASURE,0258,"),
+        std::string::npos);
+    EXPECT_NE(out.find(",STATUS,02,01,0000,0000,0000,RECORD,00,02,"),
+        std::string::npos);
+
+    // Nothing read, nothing sent
+    testing::internal::CaptureStdout();
+    ipm.send_cycle();
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+
+    args._combined = false;
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmFieldProjection)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,7,30224");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    args.setFieldsFile("../ipm.xml");
+
+    testing::internal::CaptureStdout();
+    ipm.setFields();
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "Address 0 port 30224 "
+        "fields sent: MEASURE 17/18 STATUS 3/5 RECORD 28/33\n");
+
+    // Only the fields the iPM_3phase sensor reads are sent
+    testing::internal::CaptureStdout();
+    ipm.parseData("STATUS?", 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+        "sending to port 30224 UDP string STATUS,02,0000,0000\r\n");
+
+    args.setFieldsFile(NULL);
+    for (int q=0; q < ipmSchedule::NQUERIES; q++)
+    {
+        ipm._fieldMask[0][q] = ipmFields::all(q);
+    }
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmDeadband)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,5,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    args.setDeadband("*=0");
+    args.setHeartbeat(0);
+
+    testing::internal::CaptureStdout();
+    ipm.setDeadband();
+    ipm.parseData("STATUS?", 0);
+    ipm.parseData("STATUS?", 0);  // unchanged, so not sent
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+        "Publishing on change: deadbands *=0, heartbeat 0 s\n"
+        "sending to port 30101 UDP string STATUS,02,01,0000,0000,0000\r\n");
+    EXPECT_EQ(ipm._deadband.suppressed(), 1);
+
+    args.setDeadband(NULL);
+    args.setHeartbeat(10);
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmAggregate)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,3,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    args.setWindow(1e-6);
+
+    testing::internal::CaptureStdout();
+    ipm.setAggregate();
+    ipm.parseData("MEASURE?", 0);  // starts the window
+    usleep(10);
+    ipm.parseData("MEASURE?", 0);  // completes it, and starts the next
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(out.substr(0, 85), "Aggregating MEASURE over 1e-06 s windows\n"
+        "sending to port 30101 UDP string MEASUREW,1,");
+    EXPECT_EQ(ipm._aggregate.count(0), 1);
+
+    args.setWindow(0);
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmCapture)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,3,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    char spec[] = "1,0.001,30201";
+    EXPECT_TRUE(args.setCapture(spec));
+    ipm._schedule.configure(10, 1);
+    ipm._schedule.setRate(0, ipmSchedule::MEASURE, 1);
+    ipm._schedule.setRate(0, ipmSchedule::STATUS, 1);
+
+    testing::internal::CaptureStdout();
+    ipm.setCapture();
+    ipm.parseData("STATUS?", 0);
+    ipm._statusdata[2] = 4;  // new trip flag
+    ipm.parseData("STATUS?", 0);
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Capture triggered for address 0: TRIPFLAGS "
+        "00000004 CAUTIONFLAGS 00000000"), std::string::npos);
+    EXPECT_EQ(out.find("Warning"), std::string::npos);
+
+    // Polled every cycle during the burst; responses not due on the normal
+    // schedule aren't published
+    EXPECT_TRUE(ipm._capture.active(0));
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 1);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::STATUS), 1);
+    ipm._schedule.next();
+    testing::internal::CaptureStdout();
+    ipm.parseData("MEASURE?", 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "");
+
+    // Written and the schedule restored once the window has passed
+    ipm._captureDir = "/tmp";
+    usleep(2000);
+    testing::internal::CaptureStdout();
+    ipm.endCaptures();
+    out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Capture for address 0: 3 responses sent to port "
+        "30201 and written to /tmp/ipm_capture_0_"), std::string::npos);
+    EXPECT_FALSE(ipm._capture.active(0));
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 10);
+    EXPECT_EQ(ipm._schedule.phase(0, ipmSchedule::MEASURE), 9);
+    std::remove(out.substr(out.find("/tmp"), out.find(".csv") -
+        out.find("/tmp") + 4).c_str());
+
+    // A pre window the ring can't hold at these rates is warned about:
+    // 2 responses a second, and 18 more during a capture
+    char longspec[] = "3000,5,30201";
+    EXPECT_TRUE(args.setCapture(longspec));
+    testing::internal::CaptureStdout();
+    ipm.setCapture();
+    EXPECT_NE(testing::internal::GetCapturedStdout().find("Warning: the "
+        "capture ring of 4096 responses holds only 1998 s before an event"),
+        std::string::npos);
+
+    args._capturePort = 0;
+    ipm._statusdata[2] = 0;
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmAdaptiveRate)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,2,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    args.setPolicy("rate=10,thd=5,hold=0");
+    ipm._schedule.configure(10, 1);
+    ipm._schedule.setRate(0, ipmSchedule::MEASURE, 1);
+    for (int q = 0; q < ipmSchedule::NQUERIES; q++)
+    {
+        ipm._schedule.setCost(q, 10000);
+    }
+    ipm._schedule.setSelectCost(10000);
+
+    testing::internal::CaptureStdout();
+    ipm.setPolicy();
+    ipm.parseData("MEASURE?", 0);
+    ipm._measuredata[30] = 60;  // THDA 6%
+    ipm.parseData("MEASURE?", 0);
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Address 0 MEASURE rate 1 -> 10 hz: THDA 6.0% over "
+        "5%"), std::string::npos);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 1);
+
+    ipm._measuredata[30] = 27;
+    testing::internal::CaptureStdout();
+    ipm.parseData("MEASURE?", 0);
+    out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Address 0 MEASURE rate 10 -> 1 hz: nominal for 0 s"),
+        std::string::npos);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 10);
+    EXPECT_EQ(ipm._schedule.phase(0, ipmSchedule::MEASURE), 9);
+
+    // The raise is limited to what fits in the cycle: 120 ms per MEASURE
+    // with 100 ms cycles leaves room for MEASURE every other cycle
+    ipm._schedule.setCost(ipmSchedule::MEASURE, 60000);
+    ipm._schedule.setSelectCost(60000);
+    ipm._measuredata[30] = 60;
+    testing::internal::CaptureStdout();
+    ipm.parseData("MEASURE?", 0);
+    out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Address 0 MEASURE rate 1 -> 5 hz"), std::string::npos);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 2);
+
+    // Nothing to raise when MEASURE already goes every cycle
+    ipm._measuredata[30] = 27;
+    testing::internal::CaptureStdout();
+    ipm.parseData("MEASURE?", 0);
+    ipm._schedule.setRate(0, ipmSchedule::MEASURE, 10);
+    ipm._measuredata[30] = 60;
+    ipm.parseData("MEASURE?", 0);
+    out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Address 0 MEASURE rate stays 10 hz, already at its "
+        "maximum: THDA 6.0% over 5%"), std::string::npos);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 1);
+
+    // The budget is the whole cycle period: 300 ms per MEASURE fits every
+    // 500 ms cycle
+    ipm._measuredata[30] = 27;
+    testing::internal::CaptureStdout();
+    ipm.parseData("MEASURE?", 0);
+    ipm._schedule.configure(2, 1);
+    ipm._schedule.setRate(0, ipmSchedule::MEASURE, 0.5);
+    ipm._schedule.setCost(ipmSchedule::MEASURE, 150000);
+    ipm._schedule.setSelectCost(150000);
+    ipm.setPolicy();
+    ipm._measuredata[30] = 60;
+    ipm.parseData("MEASURE?", 0);
+    out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Address 0 MEASURE rate 0.5 -> 2 hz"),
+        std::string::npos);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 1);
+
+    args.setPolicy(NULL);
+    ipm._measuredata[30] = 27;
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmShm)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "4,3,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    std::string name = "/ipm_naiipm_gtest_" + std::to_string(getpid());
+    args.setShmName(name.c_str());
+
+    testing::internal::CaptureStdout();
+    ipm.setShm();
+    ipm.parseData("STATUS?", 0);
+    testing::internal::GetCapturedStdout();
+
+    ipmShm reader;
+    ASSERT_TRUE(reader.open(name.c_str()));
+    EXPECT_EQ(reader.addr(0), 4);
+    ipmShm::sample s;
+    ASSERT_TRUE(reader.read(0, ipmSchedule::STATUS, s));
+    EXPECT_EQ(s.length, 12u);
+    EXPECT_EQ(memcmp(s.data, ipm._statusdata, 12), 0);
+    EXPECT_FALSE(reader.read(0, ipmSchedule::MEASURE, s));
+
+    reader.close();
+    ipm._shm.close();
+    args.setShmName(NULL);
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmTrace)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "2,3,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    args.setDevice("/dev/ttyS0");
+    std::string path = "/tmp/ipm_naiipm_gtest_" + std::to_string(getpid()) +
+        ".json";
+    unlink(path.c_str());
+    args.setTraceFile(path.c_str());
+
+    testing::internal::CaptureStdout();
+    ipm.setTrace();
+    ipm._addr = 2;  // as after ADR 2
+    ipm.parseData("STATUS?", 0);
+    ipm.flush_udp();
+    testing::internal::GetCapturedStdout();
+    ipm._trace.close();
+
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    std::string text = ss.str();
+    EXPECT_NE(text.find("\"args\":{\"name\":\"/dev/ttyS0\"}"),
+        std::string::npos);
+    EXPECT_NE(text.find("\"tid\":2,\"args\":{\"name\":\"ADDR 2\"}"),
+        std::string::npos);
+    EXPECT_NE(text.find("{\"name\":\"format\",\"cat\":\"STATUS\","),
+        std::string::npos);
+    EXPECT_NE(text.find("{\"name\":\"send\",\"cat\":\"udp\","),
+        std::string::npos);
+
+    unlink(path.c_str());
+    args.setTraceFile(NULL);
+    args.setDevice(NULL);
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmQueryApi)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "2,3,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setScaleFlag(0);
+    std::string path = "/tmp/ipm_naiipm_gtest_" + std::to_string(getpid());
+    args.setSocketPath(path.c_str());
+
+    testing::internal::CaptureStdout();
+    ipm.setServer();
+    ipm._addr = 2;  // as after ADR 2
+    ipm.parseData("STATUS?", 0);
+    ipm.parseData("STATUS?", 0);
+    testing::internal::GetCapturedStdout();
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    ipm._server.poll(10);  // accept
+    auto ask = [&](const char *req) {
+        send(fd, req, strlen(req), 0);
+        ipm._server.poll(10);
+        ipm.serve();
+        char buf[8192];
+        int n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        return std::string(buf, n > 0 ? n : 0);
+    };
+
+    std::string reply = ask("LATEST 2 STATUS\n");
+    EXPECT_EQ(reply.substr(reply.find(',')),
+        ",STATUS,02,01,0000,0000,0000\nOK\n");
+    EXPECT_EQ(ask("LATEST 2 MEASURE\n"), "ERR no data\n");
+    EXPECT_EQ(ask("LATEST 1 STATUS\n"), "ERR unknown address\n");
+    reply = ask("HISTORY 2 STATUS 5\n");
+    EXPECT_EQ(std::count(reply.begin(), reply.end(), '\n'), 3);
+    EXPECT_NE(ask("HEALTH\n").find("UDPSENT=0\nUDPDROPPED=0\n"),
+        std::string::npos);
+    EXPECT_EQ(ask("LATENCY\n").substr(0, 53),
+        "MEASURE? n=0 min=0.0 mean=0.0 max=0.0 ms\nSTATUS? n=0 ");
+    EXPECT_EQ(ask("CLOCK 2\n"), "RECORDS=0\nOK\n");
+    EXPECT_NE(ask("METRICS\n").find("ADDR2 STATUS FORMAT n=2 "),
+        std::string::npos);
+    reply = ask("GET /metrics\n");
+    EXPECT_NE(reply.find("ipm_samples_total{addr=\"2\",command=\"STATUS\"} "
+        "2\n"), std::string::npos);
+    EXPECT_NE(reply.find("ipm_last_sample_timestamp_seconds{addr=\"2\"} "),
+        std::string::npos);
+    EXPECT_NE(reply.find("ipm_queue_depth{priority=\"adhoc\"} 0\n"),
+        std::string::npos);
+    EXPECT_EQ(reply.substr(reply.size() - 21), "ipm_overruns_total 0\n");
+    EXPECT_EQ(ask("GET /other\n"), "ERR unknown request\n");
+    EXPECT_EQ(ask("BOGUS\n"), "ERR unknown request\n");
+
+    // One-off commands wait for link time at the end of a cycle
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(ask("SEND 2 NOSUCH?\n"), "ERR unknown command\n");
+    EXPECT_EQ(ask("SEND 2 STATUS?\n"), "");
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(ipm._queue.adhoc(), 1);
+    ipm._schedule.configure(1, 1);
+    ipm._schedule.startCycle();
+    testing::internal::CaptureStdout();
+    ipm.runQueue(-1, ipmQueue::ADHOC);  // send_command fails, no device
+    EXPECT_EQ(ipm._queue.adhoc(), 0);
+    testing::internal::GetCapturedStdout();
+    char buf[1024];
+    int n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    EXPECT_EQ(std::string(buf, n > 0 ? n : 0), "ERR command failed\n");
+
+    // A one-off that has waited MAXWAIT cycles is sent with no time left
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(ask("SEND 2 VER?\n"), "");
+    ipm._schedule._start -= std::chrono::seconds(2);  // cycle overran
+    ipm.runQueue(-1, ipmQueue::ADHOC);
+    EXPECT_EQ(ipm._queue.adhoc(), 1);
+    for (int c = 0; c < naiipm::MAXWAIT; c++)
+    {
+        ipm._schedule.next();
+    }
+    ipm._schedule._start -= std::chrono::seconds(2);
+    ipm.runQueue(-1, ipmQueue::ADHOC);
+    EXPECT_EQ(ipm._queue.adhoc(), 0);
+    testing::internal::GetCapturedStdout();
+
+    close(fd);
+    ipm._server.close();
+    args.setSocketPath(NULL);
+    ipm.close_udp();
+}
+
+/********************************************************************
+ ** Test that ad-hoc commands go after the cycle's scheduled queries
+ ********************************************************************
+*/
+TEST_F(IpmTest, ipmCommandQueue)
+{
+    MockNaiipm mipm;
+    mipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "2,3,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    mipm._schedule.configure(1, 1);
+    mipm._schedule.setPeriod(0, ipmSchedule::MEASURE, 1);
+    mipm._schedule.setPeriod(0, ipmSchedule::STATUS, 1);
+
+    EXPECT_CALL(mipm, setActiveAddress)
+        .WillRepeatedly(Return(true));
+    {
+        testing::InSequence seq;
+        EXPECT_CALL(mipm, send_command(_, "MEASURE?", _))
+            .WillOnce(Return(true));
+        EXPECT_CALL(mipm, send_command(_, "STATUS?", _))
+            .WillOnce(Return(true));
+        EXPECT_CALL(mipm, send_command(_, "VER?", _))
+            .WillOnce(Return(true));
+    }
+
+    int done = 0;
+    EXPECT_TRUE(mipm.enqueue(0, "VER?", [&](bool ok) { done += ok; }));
+    testing::internal::CaptureStdout();
+    EXPECT_TRUE(mipm.loop(-1));
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(done, 1);
+    EXPECT_TRUE(mipm._queue.empty());
+    EXPECT_EQ(mipm._linkTime[ipmSchedule::MEASURE].n, 1);
+    EXPECT_EQ(mipm._linkTime[ipmSchedule::STATUS].n, 1);
+
+    mipm.close_udp();
+}
+
+/********************************************************************
+ ** Test that a SEND reply of OK leaves the next reply in step
+ ********************************************************************
+*/
+TEST_F(IpmTest, ipmSendReply)
+{
+    MockNaiipm mipm;
+    mipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "2,3,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    std::string path = "/tmp/ipm_naiipm_gtest_" + std::to_string(getpid());
+    args.setSocketPath(path.c_str());
+    testing::internal::CaptureStdout();
+    mipm.setServer();
+    testing::internal::GetCapturedStdout();
+
+    EXPECT_CALL(mipm, setActiveAddress)
+        .WillRepeatedly(Return(true));
+    EXPECT_CALL(mipm, send_command(_, "OFF", _))
+        .WillOnce([&](int, std::string, std::string) {
+            strcpy(mipm.buffer, "OK\r\n");
+            return true;
+        });
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_EQ(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    mipm._server.poll(10);  // accept
+    auto request = [&](const char *req) {
+        send(fd, req, strlen(req), 0);
+        mipm._server.poll(10);
+        mipm.serve();
+    };
+
+    request("SEND 2 OFF\n");
+    mipm._schedule.configure(1, 1);
+    mipm._schedule.startCycle();
+    mipm.runQueue(-1, ipmQueue::ADHOC);
+    request("CLOCK 2\n");
+    char buf[1024];
+    int n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    EXPECT_EQ(std::string(buf, n > 0 ? n : 0),
+        "| OK\nOK\nRECORDS=0\nOK\n");
+
+    close(fd);
+    mipm._server.close();
+    args.setSocketPath(NULL);
+    mipm.close_udp();
+}
+
+/********************************************************************
+ ** Test an interactive session with no ipm_ctrl to connect to
+ ********************************************************************
+*/
+TEST_F(IpmTest, ipmRemote)
+{
+    args.setSocketPath("/tmp/ipm_naiipm_gtest_none");
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(ipm.remote(), 1);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+        "Unable to connect to ipm_ctrl on /tmp/ipm_naiipm_gtest_none\n");
+    args.setSocketPath(NULL);
+}
+
+TEST_F(IpmTest, ipmBinaryPacket)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "2,5,30101");
+    args.setNumAddr("1");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setBinary();
+
+    testing::internal::CaptureStdout();
+    ipm.parseData("STATUS?", 0);
+    ipm.parseData("STATUS?", 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+        "sending to port 30101 binary STATUS? seq 0, 32 bytes\n"
+        "sending to port 30101 binary STATUS? seq 1, 32 bytes\n");
+
+    // Queued packet decodes to the raw iPM data
+    ASSERT_EQ(ipm._udp.depth(), 2);
+    auto &p = ipm._udp._queue[(ipm._udp._head + 1) % ipmUdp::QUEUELEN];
+    ipmPacket::header h;
+    ASSERT_EQ(ipmPacket::decode(p.data, p.len, h), ipmPacket::HEADERLEN);
+    EXPECT_EQ(h.type, ipmPacket::STATUS);
+    EXPECT_EQ(h.addr, 2);
+    EXPECT_EQ(h.seq, 1u);
+    EXPECT_EQ(h.length, 12);
+    EXPECT_EQ(memcmp(p.data + ipmPacket::HEADERLEN, ipm.getData("STATUS?"),
+        12), 0);
+
+    args._binary = false;
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmSampleTime)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,5,30101");
+    args.setNumAddr("1");
+    args.setScaleFlag(0);
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setSampleTime();
+    ipm._dataTime = {1718215502, 104233000};
+
+    testing::internal::CaptureStdout();
+    ipm.parseData("STATUS?", 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+        "sending to port 30101 UDP string STATUS,1718215502.104233,02,01,"
+        "0000,0000,0000\r\n");
+
+    // With no fields the time still follows the frame name
+    ipm._fieldMask[0][ipmSchedule::STATUS] = 0;
+    testing::internal::CaptureStdout();
+    ipm.parseData("STATUS?", 0);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(),
+        "sending to port 30101 UDP string STATUS,1718215502.104233\r\n");
+
+    args._sampleTime = false;
+    ipm._fieldMask[0][ipmSchedule::STATUS] = ipmFields::all(1);
+    ipm.close_udp();
+}
+
+TEST_F(IpmTest, ipmClockRecord)
+{
+    ipm.open_udp("192.168.84.2");
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,4,30101");
+    args.setNumAddr("1");
+    args.setScaleFlag(0);
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+
+    // A Power Down saved 2 s after the first record, read 10 s later, was
+    // saved between the first RECORD? and 2 s after it, since the first
+    // record was there at the first RECORD?
+    testing::internal::CaptureStdout();
+    ipm._dataTime = {1718215502, 0};
+    ipm.parseData("RECORD?", 0);
+    char *record = ipm.getData("RECORD?");
+    uint32_t time;
+    memcpy(&time, record + 6, 4);
+    time += 2000;
+    memcpy(record + 6, &time, 4);
+    record[0] = 2;
+    ipm._dataTime = {1718215512, 0};
+    ipm.parseData("RECORD?", 0);
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find(" Address 0 Power Down at 20240612T180503.000 "
+        "+/- 1000 ms\n"), std::string::npos) << out;
+
+    ipm.close_udp();
 }
 
 /********************************************************************
@@ -251,17 +1025,25 @@ TEST_F(IpmTest, ipmParseDataScale)
 */
 TEST_F(IpmTest, ipmSleep)
 {
-    args.setRate("1");  // hz
+    // Sleeps until a cycle period after the cycle started
+    ipm._schedule.configure(5, 1);  // hz
+    ipm._schedule.startCycle();
+    usleep(50000);
     ipm.sleep();
-    EXPECT_EQ(ipm._sleeptime, 800000);
+    EXPECT_LE(ipm._sleeptime, 150000);
+    EXPECT_GT(ipm._sleeptime, 100000);
 
-    args.setRate("5");  // hz
+    ipm._schedule.configure(20, 1);
+    ipm._schedule.startCycle();
     ipm.sleep();
-    EXPECT_EQ(ipm._sleeptime, 0);
+    EXPECT_GT(ipm._sleeptime, 0);
+    EXPECT_LE(ipm._sleeptime, 50000);
 
-    args.setRate("2");  // hz
+    // An overrun cycle doesn't sleep
+    ipm._schedule.startCycle();
+    usleep(60000);
     ipm.sleep();
-    EXPECT_EQ(ipm._sleeptime, 300000);
+    EXPECT_EQ(ipm._sleeptime, 0);
 }
 
 TEST_F(IpmTest, ipmSetRecordFreq)
@@ -281,3 +1063,92 @@ TEST_F(IpmTest, ipmSetRecordFreq)
     ipm.setRecordFreq();
     EXPECT_EQ(ipm._recordFreq, 300);
 }
+
+TEST_F(IpmTest, ipmSetSchedule)
+{
+    char addrinfo0[24], addrinfo1[24];
+
+    args.setRate("5");  // hz
+    args.setPeriod("10");  // minutes
+    args.setNumAddr("2");
+    strcpy(addrinfo0, "0,7,30101,5,1,10");
+    args.setAddrInfo(0, addrinfo0);
+    args.parse_addrInfo(0);
+    strcpy(addrinfo1, "2,3,30102");
+    args.setAddrInfo(1, addrinfo1);
+    args.parse_addrInfo(1);
+
+    ipm.setSchedule();
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::MEASURE), 1);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::STATUS), 5);
+    EXPECT_EQ(ipm._schedule.period(0, ipmSchedule::RECORD), 3000);
+    EXPECT_EQ(ipm._schedule.period(1, ipmSchedule::MEASURE), 1);
+    EXPECT_EQ(ipm._schedule.period(1, ipmSchedule::STATUS), 1);
+    EXPECT_EQ(ipm._schedule.period(1, ipmSchedule::RECORD), 0);
+}
+
+/********************************************************************
+ ** Test the dry run, which judges the link against the cycle period
+ ********************************************************************
+*/
+TEST_F(IpmTest, ipmPlan)
+{
+    char addrinfo[24];
+    args.setRate("1");  // hz
+    args.setPeriod("1");  // minutes
+    args.setBaud("9600");
+    args.setNumAddr("1");
+    strcpy(addrinfo, "0,7,30101");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+
+    testing::internal::CaptureStdout();
+    ipm.plan();
+    std::string out = testing::internal::GetCapturedStdout();
+    // 240 ms of queries is a quarter of the 1000 ms cycle
+    EXPECT_NE(out.find("cycle rate 1.0 hz (1000.0 ms)"), std::string::npos);
+    EXPECT_NE(out.find("Link utilization 24.0 %"), std::string::npos);
+    EXPECT_NE(out.find("Cycle time: average 240.0 ms"), std::string::npos);
+    EXPECT_EQ(out.find("overloaded"), std::string::npos);
+    EXPECT_EQ(out.find("sleep()"), std::string::npos);
+    args.setBaud("57600");
+}
+
+/********************************************************************
+ ** Test baud rate auto-detect (using mock and a pseudo-terminal)
+ ********************************************************************
+*/
+TEST_F(IpmTest, ipmDetectBaud)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    ASSERT_GE(master, 0);
+    grantpt(master);
+    unlockpt(master);
+    int fd = open(ptsname(master), O_RDWR | O_NOCTTY);
+    ASSERT_GE(fd, 0);
+
+    char addrinfo[12];
+    strcpy(addrinfo, "0,5,30101");
+    args.setAddrInfo(0, addrinfo);
+    args.parse_addrInfo(0);
+    args.setBaud("auto");
+
+    MockNaiipm mipm;
+    EXPECT_CALL(mipm, setActiveAddress)
+        .WillRepeatedly(Return(true));
+    // The two fastest rates fail, the third answers reliably
+    EXPECT_CALL(mipm, send_command(_, "VER?", _))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    testing::internal::CaptureStdout();
+    int baud = mipm.detectBaud(fd);
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(baud, ipmBaud::candidates[2]);
+    EXPECT_EQ(atoi(args.BaudRate()), ipmBaud::candidates[2]);
+
+    args.setBaud("57600");
+    close(fd);
+    close(master);
+}
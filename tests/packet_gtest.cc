@@ -0,0 +1,100 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/packet.cc"
+
+/********************************************************************
+ ** Test binary packet encode and decode
+ ********************************************************************
+*/
+TEST(PacketTest, EncodeDecode)
+{
+    char payload[12] = {2, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+    char buf[64];
+    ipmPacket::header h = {ipmPacket::VERSION, ipmPacket::STATUS, 2, 0, 12,
+        0x01020304, 1700000000250000ull};
+
+    int len = ipmPacket::encode(buf, sizeof(buf), h, payload);
+    EXPECT_EQ(len, ipmPacket::HEADERLEN + 12);
+
+    // Header is little-endian regardless of host byte order
+    EXPECT_EQ(buf[0], 'i');
+    EXPECT_EQ(buf[1], 'P');
+    EXPECT_EQ(buf[6], 12);
+    EXPECT_EQ(buf[8], 0x04);
+    EXPECT_EQ(buf[11], 0x01);
+    EXPECT_EQ(memcmp(buf + ipmPacket::HEADERLEN, payload, 12), 0);
+
+    ipmPacket::header d;
+    EXPECT_EQ(ipmPacket::decode(buf, len, d), ipmPacket::HEADERLEN);
+    EXPECT_EQ(d.type, ipmPacket::STATUS);
+    EXPECT_EQ(d.addr, 2);
+    EXPECT_EQ(d.length, 12);
+    EXPECT_EQ(d.seq, 0x01020304u);
+    EXPECT_EQ(d.time, 1700000000250000ull);
+
+    // Doesn't fit
+    EXPECT_EQ(ipmPacket::encode(buf, 20, h, payload), -1);
+    // Truncated, wrong magic, unknown version
+    EXPECT_EQ(ipmPacket::decode(buf, len - 1, d), -1);
+    buf[0] = 'X';
+    EXPECT_EQ(ipmPacket::decode(buf, len, d), -1);
+    buf[0] = 'i';
+    buf[2] = 2;
+    EXPECT_EQ(ipmPacket::decode(buf, len, d), -1);
+}
+
+TEST(PacketTest, Type)
+{
+    EXPECT_EQ(ipmPacket::type("MEASURE?"), ipmPacket::MEASURE);
+    EXPECT_EQ(ipmPacket::type("BITRESULT?"), ipmPacket::BITRESULT);
+    EXPECT_EQ(ipmPacket::type("VER?"), -1);
+    EXPECT_STREQ(ipmPacket::command(ipmPacket::RECORD), "RECORD?");
+}
+
+/********************************************************************
+ ** Test receiver sequence tracking
+ ********************************************************************
+*/
+TEST(PacketTest, Receive)
+{
+    char payload[34] = {0};
+    char buf[64];
+    ipmPacket::header h = {ipmPacket::VERSION, ipmPacket::MEASURE, 0, 0, 34,
+        0, 0};
+    ipmPacket receiver;
+    ipmPacket::header d;
+
+    uint32_t seqs[] = {0, 1, 2, 5, 6};  // 3 and 4 lost
+    for (auto seq : seqs)
+    {
+        h.seq = seq;
+        int len = ipmPacket::encode(buf, sizeof(buf), h, payload);
+        EXPECT_TRUE(receiver.receive(buf, len, d));
+    }
+    EXPECT_EQ(receiver.received(), 5);
+    EXPECT_EQ(receiver.lost(), 2);
+
+    // Addresses are counted separately
+    h.addr = 1;
+    h.seq = 100;
+    int len = ipmPacket::encode(buf, sizeof(buf), h, payload);
+    EXPECT_TRUE(receiver.receive(buf, len, d));
+    EXPECT_EQ(receiver.lost(), 2);
+
+    // Sequence number wrap isn't a loss
+    h.seq = 0xffffffff;
+    len = ipmPacket::encode(buf, sizeof(buf), h, payload);
+    receiver.receive(buf, len, d);
+    h.seq = 0;
+    len = ipmPacket::encode(buf, sizeof(buf), h, payload);
+    receiver.receive(buf, len, d);
+    EXPECT_EQ(receiver.lost(), 2);
+
+    EXPECT_FALSE(receiver.receive(buf, 5, d));
+    EXPECT_EQ(receiver.invalid(), 1);
+}
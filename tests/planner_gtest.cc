@@ -0,0 +1,72 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/planner.cc"
+
+class PlannerTest : public ::testing::Test {
+private:
+    ipmSchedule _schedule;
+    ipmPlanner _planner;
+
+    void SetUp()
+    {
+        // 2 hz cycle, two addresses sending MEASURE every cycle and
+        // RECORD every 4 cycles
+        _schedule.configure(2, 2);
+        _schedule.setPeriod(0, ipmSchedule::MEASURE, 1);
+        _schedule.setPeriod(1, ipmSchedule::MEASURE, 1);
+        _schedule.setPeriod(0, ipmSchedule::RECORD, 4);
+        _schedule.setPeriod(1, ipmSchedule::RECORD, 4);
+        _schedule.setCost(ipmSchedule::MEASURE, 50000);
+        _schedule.setCost(ipmSchedule::RECORD, 100000);
+        _schedule.setSelectCost(100000);
+    }
+
+    void TearDown()
+    {
+    }
+};
+
+/********************************************************************
+ ** Test simulating the schedule
+ ********************************************************************
+*/
+TEST_F(PlannerTest, Simulate)
+{
+    _planner.simulate(_schedule);
+    EXPECT_EQ(_planner.cycles(), 4);
+    // Both RECORDs land in the same cycle: 2*(100+50) + 2*100 ms
+    EXPECT_EQ(_planner.worst(), 500000);
+    EXPECT_EQ(_planner.average(), 350000);
+    EXPECT_DOUBLE_EQ(_planner.utilization(), 0.7);
+    EXPECT_FLOAT_EQ(_planner.maxCycleRate(), 2.0);
+    EXPECT_FLOAT_EQ(_planner.rate(0, ipmSchedule::MEASURE), 2.0);
+    EXPECT_FLOAT_EQ(_planner.rate(1, ipmSchedule::RECORD), 0.5);
+    EXPECT_EQ(_planner.deferred(), 0);
+
+    // Staggered, the RECORDs go out in different cycles
+    _schedule.stagger();
+    _planner.simulate(_schedule);
+    EXPECT_EQ(_planner.worst(), 400000);
+    EXPECT_EQ(_planner.average(), 350000);
+    EXPECT_FLOAT_EQ(_planner.maxCycleRate(), 2.5);
+}
+
+TEST_F(PlannerTest, SimulateOverload)
+{
+    // At 5 hz the 300 ms of MEASUREs leave no room for RECORD, so the
+    // governor defers it
+    _schedule.configure(5, 2);
+    _schedule.setPeriod(0, ipmSchedule::MEASURE, 1);
+    _schedule.setPeriod(1, ipmSchedule::MEASURE, 1);
+    _schedule.setPeriod(0, ipmSchedule::RECORD, 4);
+    _planner.simulate(_schedule);
+    EXPECT_EQ(_planner.worst(), 300000);
+    EXPECT_EQ(_planner.deferred(), 1);
+    EXPECT_FLOAT_EQ(_planner.rate(0, ipmSchedule::RECORD), 0);
+    EXPECT_GT(_planner.utilization(), 1);
+}
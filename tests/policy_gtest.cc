@@ -0,0 +1,69 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/policy.cc"
+
+/********************************************************************
+ ** Test parsing limits
+ ********************************************************************
+*/
+TEST(PolicyTest, Configure)
+{
+    ipmPolicy policy;
+    std::string error;
+    EXPECT_TRUE(policy.configure("rate=5,thd=4.5,vmin=105,vmax=125,hold=3",
+        error));
+    EXPECT_FLOAT_EQ(policy.rate(), 5);
+    EXPECT_FLOAT_EQ(policy.thd(), 4.5);
+    EXPECT_FLOAT_EQ(policy.vmin(), 105);
+    EXPECT_FLOAT_EQ(policy.vmax(), 125);
+    EXPECT_FLOAT_EQ(policy.hold(), 3);
+
+    EXPECT_FALSE(policy.configure("thd=5,volts=1", error));
+    EXPECT_EQ(error, "volts=1");
+    EXPECT_FALSE(policy.configure("thd", error));
+    EXPECT_FALSE(policy.configure("thd=-1", error));
+}
+
+/********************************************************************
+ ** Test raising and relaxing on power quality
+ ********************************************************************
+*/
+TEST(PolicyTest, Evaluate)
+{
+    ipmPolicy policy;
+    std::string error;
+    EXPECT_TRUE(policy.configure("thd=5,vmin=105,vmax=125,hold=2", error));
+
+    // 115.5 V on phase A only, THD 1%, power OK
+    unsigned char measure[34] = {88, 2, 0, 0, 0, 0, 0x83, 4};
+    measure[30] = 10;
+    measure[33] = 1;
+    EXPECT_EQ(policy.evaluate(0, (char *)measure, 0), ipmPolicy::STEADY);
+
+    measure[30] = 60;  // THDA 6%
+    EXPECT_EQ(policy.evaluate(0, (char *)measure, 1), ipmPolicy::RAISE);
+    EXPECT_STREQ(policy.reason(0), "THDA 6.0% over 5%");
+    EXPECT_TRUE(policy.degraded(0));
+    measure[30] = 10;
+    measure[33] = 0;   // POWEROK
+    EXPECT_EQ(policy.evaluate(0, (char *)measure, 2), ipmPolicy::STEADY);
+
+    // Held until nominal for the hold time
+    measure[33] = 1;
+    EXPECT_EQ(policy.evaluate(0, (char *)measure, 3), ipmPolicy::STEADY);
+    EXPECT_EQ(policy.evaluate(0, (char *)measure, 4), ipmPolicy::RELAX);
+    EXPECT_STREQ(policy.reason(0), "nominal for 2 s");
+    EXPECT_FALSE(policy.degraded(0));
+
+    // Voltage band; addresses are independent
+    measure[6] = 0x10;
+    measure[7] = 0x4;  // 104.0 V
+    EXPECT_EQ(policy.evaluate(1, (char *)measure, 5), ipmPolicy::RAISE);
+    EXPECT_STREQ(policy.reason(1), "VRMSA 104.0 V outside 105-125 V");
+    EXPECT_FALSE(policy.degraded(0));
+}
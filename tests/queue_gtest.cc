@@ -0,0 +1,78 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <string>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/queue.cc"
+
+static ipmQueue::command make(int priority, long deadline, const char *cmd,
+    std::string *sent = NULL)
+{
+    ipmQueue::command c;
+    c.priority = priority;
+    c.deadline = deadline;
+    c.cmd = cmd;
+    if (sent != NULL)
+    {
+        c.done = [sent, cmd](bool ok) { if (ok) *sent += cmd; };
+    }
+    return c;
+}
+
+/********************************************************************
+ ** Test the order commands come off the queue
+ ********************************************************************
+*/
+TEST(QueueTest, Order)
+{
+    ipmQueue queue;
+    EXPECT_TRUE(queue.empty());
+
+    std::string sent;
+    queue.push(make(ipmQueue::ADHOC, 0, "VER?", &sent));
+    queue.push(make(ipmQueue::SCHEDULED, 1000000, "RECORD?", &sent));
+    queue.push(make(ipmQueue::ADHOC, 0, "SERNO?", &sent));
+    queue.push(make(ipmQueue::SCHEDULED, 200000, "MEASURE?", &sent));
+    queue.push(make(ipmQueue::SCHEDULED, 200000, "STATUS?", &sent));
+    EXPECT_EQ(queue.size(), 5);
+    EXPECT_EQ(queue.adhoc(), 2);
+
+    // Scheduled by deadline, equal deadlines in the order queued, then
+    // ad-hoc in the order queued
+    EXPECT_EQ(queue.top().cmd, "MEASURE?");
+    while (not queue.empty())
+    {
+        queue.pop().done(true);
+        sent += " ";
+    }
+    EXPECT_EQ(sent, "MEASURE? STATUS? RECORD? VER? SERNO? ");
+    EXPECT_EQ(queue.adhoc(), 0);
+}
+
+/********************************************************************
+ ** Test the ad-hoc limit and dropping a priority
+ ********************************************************************
+*/
+TEST(QueueTest, Limit)
+{
+    ipmQueue queue;
+    for (int j = 0; j < ipmQueue::MAXADHOC; j++)
+    {
+        EXPECT_TRUE(queue.push(make(ipmQueue::ADHOC, 0, "VER?")));
+    }
+    EXPECT_FALSE(queue.push(make(ipmQueue::ADHOC, 0, "VER?")));
+    EXPECT_TRUE(queue.push(make(ipmQueue::SCHEDULED, 0, "MEASURE?")));
+    EXPECT_EQ(queue.size(), ipmQueue::MAXADHOC + 1);
+
+    queue.drop(ipmQueue::ADHOC);
+    EXPECT_EQ(queue.size(), 1);
+    EXPECT_EQ(queue.adhoc(), 0);
+    EXPECT_EQ(queue.top().cmd, "MEASURE?");
+    EXPECT_TRUE(queue.push(make(ipmQueue::ADHOC, 0, "VER?")));
+    queue.drop(ipmQueue::SCHEDULED);
+    EXPECT_EQ(queue.top().cmd, "VER?");
+    EXPECT_EQ(queue.adhoc(), 1);
+}
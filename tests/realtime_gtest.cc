@@ -0,0 +1,35 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/realtime.cc"
+
+/********************************************************************
+ ** Test parsing the -R setting. apply() isn't tested, since it would
+ ** make the test process real-time.
+ ********************************************************************
+*/
+TEST(RealtimeTest, Configure)
+{
+    ipmRealtime rt;
+    EXPECT_FALSE(rt.enabled());
+
+    EXPECT_TRUE(rt.configure("50"));
+    EXPECT_TRUE(rt.enabled());
+    EXPECT_EQ(rt.priority(), 50);
+    EXPECT_EQ(rt.cpu(), -1);
+
+    EXPECT_TRUE(rt.configure("80,1"));
+    EXPECT_EQ(rt.priority(), 80);
+    EXPECT_EQ(rt.cpu(), 1);
+
+    EXPECT_FALSE(rt.configure("0"));
+    EXPECT_FALSE(rt.configure("100"));
+    EXPECT_FALSE(rt.configure("50,-1"));
+    EXPECT_FALSE(rt.configure("50,1,2"));
+    EXPECT_FALSE(rt.configure("fifo"));
+    EXPECT_EQ(rt.priority(), 80);
+}
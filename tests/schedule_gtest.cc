@@ -0,0 +1,171 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/schedule.cc"
+
+class ScheduleTest : public ::testing::Test {
+private:
+    ipmSchedule _schedule;
+
+    void SetUp()
+    {
+        // 5 hz cycle with two addresses
+        _schedule.configure(5, 2);
+    }
+
+    void TearDown()
+    {
+    }
+};
+
+/********************************************************************
+ ** Test converting rates to periods
+ ********************************************************************
+*/
+TEST_F(ScheduleTest, SetRate)
+{
+    _schedule.setRate(0, ipmSchedule::MEASURE, 5);
+    EXPECT_EQ(_schedule.period(0, ipmSchedule::MEASURE), 1);
+    _schedule.setRate(0, ipmSchedule::STATUS, 1);
+    EXPECT_EQ(_schedule.period(0, ipmSchedule::STATUS), 5);
+    _schedule.setRate(0, ipmSchedule::RECORD, 1.0/600);  // 10 minutes
+    EXPECT_EQ(_schedule.period(0, ipmSchedule::RECORD), 3000);
+
+    // Rates faster than the cycle rate run every cycle
+    _schedule.setRate(1, ipmSchedule::MEASURE, 20);
+    EXPECT_EQ(_schedule.period(1, ipmSchedule::MEASURE), 1);
+
+    // Zero rate disables the query
+    _schedule.setRate(1, ipmSchedule::STATUS, 0);
+    EXPECT_EQ(_schedule.period(1, ipmSchedule::STATUS), 0);
+}
+
+/********************************************************************
+ ** Test slot ordering and per-query timing
+ ********************************************************************
+*/
+TEST_F(ScheduleTest, Due)
+{
+    // Address 0 MEASURE at 1 hz, STATUS at 1 hz
+    // Address 1 MEASURE at 5 hz, RECORD every 3 cycles
+    _schedule.setRate(0, ipmSchedule::MEASURE, 1);
+    _schedule.setRate(0, ipmSchedule::STATUS, 1);
+    _schedule.setRate(1, ipmSchedule::MEASURE, 5);
+    _schedule.setPeriod(1, ipmSchedule::RECORD, 3);
+
+    int nmeasure0 = 0, nmeasure1 = 0, nrecord1 = 0;
+    for (int c = 0; c < 15; c++)
+    {
+        auto due = _schedule.due();
+        for (size_t k = 0; k < due.size(); k++)
+        {
+            if (due[k].index == 0 && due[k].query == ipmSchedule::MEASURE)
+                nmeasure0++;
+            if (due[k].index == 1 && due[k].query == ipmSchedule::MEASURE)
+                nmeasure1++;
+            if (due[k].index == 1 && due[k].query == ipmSchedule::RECORD)
+                nrecord1++;
+        }
+        if (c == 4)
+        {
+            // Highest rate address first, queries for an address grouped
+            // together and ordered MEASURE, STATUS
+            ASSERT_EQ(due.size(), 3u);
+            EXPECT_EQ(due[0].index, 1);
+            EXPECT_EQ(due[0].query, ipmSchedule::MEASURE);
+            EXPECT_EQ(due[1].index, 0);
+            EXPECT_EQ(due[1].query, ipmSchedule::MEASURE);
+            EXPECT_EQ(due[2].index, 0);
+            EXPECT_EQ(due[2].query, ipmSchedule::STATUS);
+        }
+        _schedule.next();
+    }
+    EXPECT_EQ(nmeasure0, 3);
+    EXPECT_EQ(nmeasure1, 15);
+    EXPECT_EQ(nrecord1, 5);
+}
+
+TEST_F(ScheduleTest, Command)
+{
+    EXPECT_STREQ(ipmSchedule::command(ipmSchedule::MEASURE), "MEASURE?");
+    EXPECT_STREQ(ipmSchedule::command(ipmSchedule::STATUS), "STATUS?");
+    EXPECT_STREQ(ipmSchedule::command(ipmSchedule::RECORD), "RECORD?");
+}
+
+/********************************************************************
+ ** Test staggering low rate queries and the per-cycle budget
+ ********************************************************************
+*/
+TEST_F(ScheduleTest, Stagger)
+{
+    // Two addresses sending MEASURE every cycle and RECORD every 10
+    // cycles. Unstaggered, both RECORDs land in the same cycle.
+    _schedule.setPeriod(0, ipmSchedule::MEASURE, 1);
+    _schedule.setPeriod(1, ipmSchedule::MEASURE, 1);
+    _schedule.setPeriod(0, ipmSchedule::RECORD, 10);
+    _schedule.setPeriod(1, ipmSchedule::RECORD, 10);
+    _schedule.setCost(ipmSchedule::MEASURE, 10000);
+    _schedule.setCost(ipmSchedule::RECORD, 40000);
+    _schedule.setSelectCost(100000);
+
+    long average, worst;
+    _schedule.budget(average, worst);
+    EXPECT_EQ(worst, 300000);
+    EXPECT_EQ(average, 228000);
+
+    _schedule.stagger();
+    EXPECT_NE(_schedule.phase(0, ipmSchedule::RECORD),
+              _schedule.phase(1, ipmSchedule::RECORD));
+    _schedule.budget(average, worst);
+    EXPECT_EQ(worst, 260000);
+    EXPECT_EQ(average, 228000);
+}
+
+TEST_F(ScheduleTest, TransferTime)
+{
+    // 57600 baud, 10 bits per byte
+    EXPECT_EQ(ipmSchedule::transferTime(576, 57600), 100000);
+    EXPECT_EQ(ipmSchedule::transferTime(46, 115200), 3993);
+}
+
+/********************************************************************
+ ** Test shedding low priority queries when the cycle budget is tight
+ ********************************************************************
+*/
+TEST_F(ScheduleTest, Admit)
+{
+    _schedule.setPeriod(0, ipmSchedule::MEASURE, 1);
+    _schedule.setPeriod(0, ipmSchedule::RECORD, 3);
+    _schedule.setCost(ipmSchedule::MEASURE, 10000);
+    _schedule.setCost(ipmSchedule::RECORD, 40000);
+    _schedule.setSelectCost(100000);
+
+    ipmSchedule::slot measure = {0, ipmSchedule::MEASURE};
+    ipmSchedule::slot record = {0, ipmSchedule::RECORD};
+
+    // MEASURE is always sent, even when there is no time left
+    EXPECT_TRUE(_schedule.admit(measure, false, 0));
+
+    // Advance to the cycle RECORD is due in
+    _schedule.next();
+    _schedule.next();
+    EXPECT_EQ(_schedule.due().size(), 2u);
+    // Not enough time left for RECORD, so shed it
+    EXPECT_FALSE(_schedule.admit(record, true, 30000));
+    EXPECT_EQ(_schedule.shed(0, ipmSchedule::RECORD), 1);
+    EXPECT_EQ(_schedule.lastShedCycle(0, ipmSchedule::RECORD), 2);
+
+    // Shed RECORD is offered again next cycle
+    _schedule.next();
+    EXPECT_EQ(_schedule.due().size(), 2u);
+    EXPECT_TRUE(_schedule.admit(record, true, 50000));
+    _schedule.sent(record);
+
+    // Once sent it waits for its next phase
+    _schedule.next();
+    EXPECT_EQ(_schedule.due().size(), 1u);
+}
@@ -0,0 +1,88 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <string>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/sequence.cc"
+
+/********************************************************************
+ ** Test stepping through a sequence
+ ********************************************************************
+*/
+TEST(SequenceTest, Steps)
+{
+    std::string log;
+    auto note = [&](bool ok, int tries) {
+        log += (ok ? "ok" : "fail") + std::to_string(tries) + " ";
+    };
+    ipmSequence seq(2);
+    seq.select(1).send("OFF", 2, note).delay(110000).delay(1000)
+        .send("RESET", 3, note);
+    EXPECT_EQ(seq.addr(), 2);
+
+    seq.start(100);
+    EXPECT_FALSE(seq.done());
+    EXPECT_EQ(seq.current().cmd, "ADR");
+    EXPECT_EQ(seq.wake(), 100);
+    seq.resume(true, 200);
+    EXPECT_EQ(seq.current().cmd, "OFF");
+    EXPECT_EQ(seq.wake(), 200);
+
+    // Waits add up, and the command after them is due once they're over
+    seq.resume(true, 300);
+    EXPECT_EQ(seq.current().cmd, "RESET");
+    EXPECT_EQ(seq.wake(), 300 + 111000);
+    seq.resume(true, 111400);
+    EXPECT_TRUE(seq.done());
+    EXPECT_EQ(seq.result(), 0);
+    EXPECT_EQ(log, "ok1 ok1 ");
+
+    // A failed step ends the sequence with its fail value
+    log.clear();
+    seq.start(0);
+    seq.resume(true, 0);
+    seq.resume(false, 0);
+    EXPECT_TRUE(seq.done());
+    EXPECT_EQ(seq.result(), 2);
+    EXPECT_EQ(log, "fail1 ");
+}
+
+/********************************************************************
+ ** Test retries
+ ********************************************************************
+*/
+TEST(SequenceTest, Retry)
+{
+    int tried = 0;
+    bool answered = false;
+    ipmSequence seq(0);
+    seq.retry("VER?", 3, 500000, 0, [&](bool ok, int tries) {
+        answered = ok;
+        tried = tries;
+    }).send("SERNO?");
+
+    seq.start(0);
+    seq.resume(false, 10);
+    EXPECT_EQ(seq.current().cmd, "VER?");
+    EXPECT_EQ(seq.wake(), 500010);
+    seq.resume(true, 500020);
+    EXPECT_TRUE(answered);
+    EXPECT_EQ(tried, 2);
+    EXPECT_EQ(seq.current().cmd, "SERNO?");
+
+    // Failures of a step with no fail value are passed over
+    seq.start(0);
+    for (int j = 0; j < 3; j++)
+    {
+        seq.resume(false, 0);
+    }
+    EXPECT_FALSE(answered);
+    EXPECT_EQ(tried, 3);
+    EXPECT_EQ(seq.current().cmd, "SERNO?");
+    seq.resume(true, 0);
+    EXPECT_TRUE(seq.done());
+    EXPECT_EQ(seq.result(), 0);
+}
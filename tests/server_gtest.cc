@@ -0,0 +1,338 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <sys/un.h>
+#include <string>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/server.cc"
+
+class ServerTest : public ::testing::Test {
+public:
+    std::string _path;
+    ipmServer _server;
+
+    // Connect a client to the server
+    int connectClient()
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, _path.c_str());
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+        return fd;
+    }
+
+    // Connect a client to the server's TCP port
+    int connectTcp()
+    {
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        getsockname(_server._tcp, (struct sockaddr *)&addr, &len);
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+        return fd;
+    }
+
+    // Read what a client has been sent
+    std::string receive(int fd)
+    {
+        char buf[1024];
+        int n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        return std::string(buf, n > 0 ? n : 0);
+    }
+
+private:
+    void SetUp()
+    {
+        _path = "/tmp/ipm_server_gtest_" + std::to_string(getpid());
+        ASSERT_TRUE(_server.open(_path.c_str()));
+    }
+
+    void TearDown()
+    {
+        _server.close();
+    }
+};
+
+/********************************************************************
+ ** Test requests and replies
+ ********************************************************************
+*/
+TEST_F(ServerTest, Requests)
+{
+    std::string line;
+    EXPECT_FALSE(_server.poll(0));
+    EXPECT_EQ(_server.next(line), -1);
+
+    int a = connectClient();
+    int b = connectClient();
+    _server.poll(10);
+    EXPECT_EQ(_server.clients(), 2);
+
+    // Requests may arrive in pieces and several at a time
+    send(a, "HEAL", 4, 0);
+    EXPECT_FALSE(_server.poll(10));
+    send(a, "TH\r\nLATENCY\n", 12, 0);
+    send(b, "LATEST 0 MEASURE\n", 17, 0);
+    EXPECT_TRUE(_server.poll(10));
+
+    // Each client's requests come in order
+    std::string lines[2];
+    int ids[3];
+    for (int j = 0; j < 3; j++)
+    {
+        ids[j] = _server.next(line);
+        lines[ids[j] % ipmServer::MAXCLIENTS] += line + ";";
+    }
+    EXPECT_EQ(_server.next(line), -1);
+    int ca = ids[0] % ipmServer::MAXCLIENTS == 0 ? ids[0] : ids[1];
+    EXPECT_EQ(lines[0], "HEALTH;LATENCY;");
+    EXPECT_EQ(lines[1], "LATEST 0 MEASURE;");
+
+    _server.reply(ca, "OK\n");
+    EXPECT_EQ(receive(a), "OK\n");
+    EXPECT_EQ(receive(b), "");
+
+    // A client that leaves doesn't get replies meant for the old one
+    close(a);
+    _server.poll(10);
+    EXPECT_EQ(_server.clients(), 1);
+    int c = connectClient();
+    _server.poll(10);
+    _server.reply(ca, "stale\n");
+    EXPECT_EQ(receive(c), "");
+
+    close(b);
+    close(c);
+}
+
+/********************************************************************
+ ** Test that an old socket is replaced but a file is left alone
+ ********************************************************************
+*/
+TEST_F(ServerTest, OpenPath)
+{
+    _server.close();
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);  // left by a crashed run
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, _path.c_str());
+    ASSERT_EQ(bind(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+    close(fd);
+    EXPECT_TRUE(_server.open(_path.c_str()));
+    _server.close();
+
+    std::string file = _path + ".txt";
+    FILE *f = fopen(file.c_str(), "w");
+    ASSERT_NE(f, nullptr);
+    fclose(f);
+    EXPECT_FALSE(_server.open(file.c_str()));
+    EXPECT_EQ(errno, EEXIST);
+    EXPECT_FALSE(_server.isOpen());
+    EXPECT_EQ(access(file.c_str(), F_OK), 0);
+    unlink(file.c_str());
+}
+
+/********************************************************************
+ ** Test that an overlong request drops the client
+ ********************************************************************
+*/
+TEST_F(ServerTest, TooLong)
+{
+    int a = connectClient();
+    std::string big(ipmServer::LINELEN, 'x');
+    send(a, big.data(), big.size(), 0);
+    _server.poll(10);
+    _server.poll(10);
+    EXPECT_EQ(_server.clients(), 0);
+    EXPECT_EQ(receive(a), "ERR request too long\n");
+    close(a);
+}
+
+/********************************************************************
+ ** Test scrapes over HTTP, on the Unix socket and on TCP
+ ********************************************************************
+*/
+TEST_F(ServerTest, Http)
+{
+    std::string line;
+    int a = connectClient();
+    _server.poll(10);
+    const char *get = "GET /metrics HTTP/1.1\r\nHost: dsm\r\n"
+        "Accept: text/plain\r\n\r\n";
+    send(a, get, strlen(get), 0);
+    EXPECT_TRUE(_server.poll(10));
+    int id = _server.next(line);
+    EXPECT_EQ(line, "GET /metrics HTTP/1.1");
+    EXPECT_EQ(_server.next(line), -1);  // headers aren't requests
+    _server.reply(id, "ipm_up 1\n");
+    EXPECT_EQ(receive(a), "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: 9\r\nConnection: close\r\n\r\nipm_up 1\n");
+    EXPECT_EQ(_server.clients(), 0);
+    close(a);
+
+    ASSERT_TRUE(_server.openTcp("127.0.0.1", 0));
+    int b = connectTcp();
+    _server.poll(10);
+    EXPECT_EQ(_server.clients(), 1);
+    get = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(b, get, strlen(get), 0);
+    EXPECT_TRUE(_server.poll(10));
+    id = _server.next(line);
+    EXPECT_EQ(line, "GET /metrics HTTP/1.0");
+    _server.reply(id, "ERR unknown request\n");
+    EXPECT_EQ(receive(b).substr(0, 24), "HTTP/1.0 404 Not Found\r\n");
+    close(b);
+}
+
+/********************************************************************
+ ** Test that the TCP port serves nothing but GET /metrics
+ ********************************************************************
+*/
+TEST_F(ServerTest, TcpOnlyMetrics)
+{
+    EXPECT_FALSE(_server.openTcp("nowhere", 0));
+    ASSERT_TRUE(_server.openTcp("127.0.0.1", 0));
+    const char *requests[3] = {"SEND 0 OFF\n",
+        "POST /metrics HTTP/1.1\r\n\r\n", "GET /other HTTP/1.1\r\n\r\n"};
+    const char *status[3] = {"HTTP/1.0 405 Method Not Allowed\r\n",
+        "HTTP/1.0 405 Method Not Allowed\r\n", "HTTP/1.0 404 Not Found\r\n"};
+    for (int j = 0; j < 3; j++)
+    {
+        int a = connectTcp();
+        _server.poll(10);
+        send(a, requests[j], strlen(requests[j]), 0);
+        _server.poll(10);
+        std::string line;
+        EXPECT_EQ(_server.next(line), -1);  // never passed on
+        std::string got = receive(a);
+        EXPECT_EQ(got.substr(0, strlen(status[j])), status[j]);
+        EXPECT_EQ(_server.clients(), 0);
+        close(a);
+    }
+
+    // The same request on the Unix socket is passed on
+    int a = connectClient();
+    _server.poll(10);
+    send(a, "SEND 0 OFF\n", 11, 0);
+    EXPECT_TRUE(_server.poll(10));
+    std::string line;
+    EXPECT_GE(_server.next(line), 0);
+    EXPECT_EQ(line, "SEND 0 OFF");
+    close(a);
+}
+
+/********************************************************************
+ ** Test that a reply bigger than the socket buffer is all sent, and that
+ ** a client not reading its replies is dropped
+ ********************************************************************
+*/
+TEST_F(ServerTest, BigReply)
+{
+    int a = connectClient();
+    int size = 4096;
+    setsockopt(a, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    _server.poll(10);
+    std::string text;
+    while (text.size() < 600000)
+    {
+        text += "1718215502.104233,MEASURE,0258,0000,0205,048b\n";
+    }
+    text += "OK\n";
+    _server.reply(0, text);
+    _server.reply(0, "OK\n");  // queued behind it
+    EXPECT_EQ(_server.clients(), 1);
+
+    std::string got;
+    char buf[65536];
+    for (int j = 0; j < 10000 and got.size() < text.size() + 3; j++)
+    {
+        int n = recv(a, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0)
+        {
+            got.append(buf, n);
+        }
+        _server.poll(1);
+    }
+    EXPECT_EQ(got, text + "OK\n");
+    EXPECT_EQ(_server.clients(), 1);
+    EXPECT_TRUE(_server._out[0].empty());
+
+    std::string big(ipmServer::MAXOUT, 'x');
+    _server.reply(0, big);
+    _server.reply(0, big);
+    EXPECT_EQ(_server.clients(), 0);
+    close(a);
+}
+
+/********************************************************************
+ ** Test that a response bigger than the socket buffer is all sent
+ ********************************************************************
+*/
+TEST_F(ServerTest, HttpPartial)
+{
+    int a = connectClient();
+    int size = 4096;
+    setsockopt(a, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    _server.poll(10);
+    send(a, "GET /metrics HTTP/1.0\r\n\r\n", 25, 0);
+    EXPECT_TRUE(_server.poll(10));
+    std::string line;
+    int id = _server.next(line);
+    std::string text(1 << 20, 'x');
+    _server.reply(id, text);
+    EXPECT_EQ(_server.clients(), 1);  // still sending
+
+    std::string got;
+    char buf[65536];
+    for (int j = 0; j < 10000 and _server.clients() > 0; j++)
+    {
+        int n = recv(a, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0)
+        {
+            got.append(buf, n);
+        }
+        _server.poll(1);
+    }
+    EXPECT_EQ(_server.clients(), 0);
+    int n;
+    while ((n = recv(a, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+    {
+        got.append(buf, n);
+    }
+    ASSERT_GT(got.size(), text.size());
+    EXPECT_EQ(got.substr(got.size() - text.size()), text);
+    close(a);
+}
+
+/********************************************************************
+ ** Test that idle TCP clients and scrapers are disconnected
+ ********************************************************************
+*/
+TEST_F(ServerTest, Idle)
+{
+    ASSERT_TRUE(_server.openTcp("127.0.0.1", 0));
+    int a = connectTcp();
+    int b = connectClient();
+    _server.poll(10);
+    EXPECT_EQ(_server.clients(), 2);
+    _server.poll(10);
+    EXPECT_EQ(_server.clients(), 2);
+
+    // As if IDLEMS has passed
+    for (int c = 0; c < ipmServer::MAXCLIENTS; c++)
+    {
+        _server._active[c] -= ipmServer::IDLEMS + 1;
+    }
+    _server.poll(10);
+    EXPECT_EQ(_server.clients(), 1);  // query clients on the socket stay
+    EXPECT_EQ(recv(a, NULL, 0, 0), 0);
+    close(a);
+    close(b);
+}
@@ -0,0 +1,52 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <string>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/shm.cc"
+
+/********************************************************************
+ ** Test publishing and reading the latest responses
+ ********************************************************************
+*/
+TEST(ShmTest, PublishRead)
+{
+    std::string name = "/ipm_gtest_" + std::to_string(getpid());
+    ipmShm writer;
+    int addr[2] = {3, 5};
+    ASSERT_TRUE(writer.create(name.c_str(), 2, addr));
+
+    ipmShm reader;
+    ASSERT_TRUE(reader.open(name.c_str()));
+    EXPECT_EQ(reader.numAddr(), 2);
+    EXPECT_EQ(reader.addr(1), 5);
+
+    // Nothing published yet
+    ipmShm::sample s;
+    EXPECT_FALSE(reader.read(1, 0, s));
+
+    unsigned char measure[34] = {88, 2};
+    writer.publish(1, 0, (char *)measure, 34, 1700000000123456);
+    measure[0] = 90;
+    writer.publish(1, 0, (char *)measure, 34, 1700000000223456);
+    ASSERT_TRUE(reader.read(1, 0, s));
+    EXPECT_EQ(s.count, 2u);
+    EXPECT_EQ(s.length, 34u);
+    EXPECT_EQ(s.time, 1700000000223456u);
+    EXPECT_EQ((unsigned char)s.data[0], 90);
+    EXPECT_FALSE(reader.read(0, 0, s));  // other address
+
+    // A slot being written isn't read
+    writer._seg->slots[1][0].seq++;
+    EXPECT_FALSE(reader.read(1, 0, s, 3));
+    writer._seg->slots[1][0].seq++;
+    EXPECT_TRUE(reader.read(1, 0, s));
+
+    // The segment goes away with its writer
+    reader.close();
+    writer.close();
+    EXPECT_FALSE(reader.open(name.c_str()));
+}
@@ -0,0 +1,78 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <unistd.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/stamp.cc"
+
+/********************************************************************
+ ** Test the exchange timestamps
+ ********************************************************************
+*/
+TEST(StampTest, Exchange)
+{
+    ipmStamp s;
+    s.start();
+    s.write(9);
+    usleep(1000);
+    s.received();
+    int64_t first = s.first();
+    usleep(1000);
+    s.received();
+    s.finish();
+
+    EXPECT_GT(s.written(), 0);
+    EXPECT_GE(first - s.written(), 1000);
+    EXPECT_EQ(s.first(), first);  // later reads don't move the first byte
+    EXPECT_GE(s.last() - s.first(), 1000);
+
+    // UTC follows the monotonic times
+    int64_t now = ipmStamp::realtime();
+    EXPECT_LE(s.utc(s.last()), now);
+    EXPECT_GT(s.utc(s.last()), now - 1000000);
+}
+
+TEST(StampTest, Sample)
+{
+    ipmStamp s;
+    s._write = 1000000;
+    s._len = 9;
+    s._first = 1010000;
+    s._last = 1016000;
+    s._offset = 5000000;
+
+    // At 10000 baud a byte takes 1 ms: the command reached the iPM at
+    // 1009000 and it started to answer by 1009000, so no window
+    EXPECT_EQ(s.sample(10000), 6009000);
+    EXPECT_EQ(s.uncertainty(10000), 0);
+
+    // At 100000 baud, between 1000900 and 1009900
+    EXPECT_EQ(s.sample(100000), 6005400);
+    EXPECT_EQ(s.uncertainty(100000), 4500);
+
+    // A read quicker than the link could deliver is a zero window
+    EXPECT_EQ(s.uncertainty(9600), 0);
+}
+
+TEST(StampTest, NoExchange)
+{
+    ipmStamp s;
+    int64_t now = ipmStamp::realtime();
+    EXPECT_GE(s.sample(9600), now);
+    EXPECT_LT(s.sample(9600), now + 1000000);
+}
+
+TEST(StampTest, ReadAhead)
+{
+    // A response that was all read with the one before it: the times fall
+    // back to the end of the exchange
+    ipmStamp s;
+    s.start();
+    s.finish();
+    EXPECT_GT(s.last(), 0);
+    EXPECT_EQ(s.first(), s.last());
+    EXPECT_EQ(s.written(), s.first());
+}
@@ -0,0 +1,94 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/trace.cc"
+
+class TraceTest : public ::testing::Test {
+public:
+    std::string _path;
+    ipmTrace _trace;
+
+    std::string contents()
+    {
+        std::ifstream in(_path);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+private:
+    void SetUp()
+    {
+        _path = "/tmp/ipm_trace_gtest_" + std::to_string(getpid()) +
+            ".json";
+        unlink(_path.c_str());
+    }
+
+    void TearDown()
+    {
+        _trace.close();
+        unlink(_path.c_str());
+    }
+};
+
+/********************************************************************
+ ** Test the events written
+ ********************************************************************
+*/
+TEST_F(TraceTest, Events)
+{
+    _trace.add("write", "MEASURE", 2, 100, 150);  // not open, ignored
+    ASSERT_TRUE(_trace.open(_path.c_str(), "/dev/ttyS0"));
+    _trace.name(2, "ADDR 2");
+    _trace.add("write", "MEASURE", 2, 1000, 1250);
+    _trace.add("read", "MEASURE", 2, 5000, 4000);  // no negative spans
+    _trace.close();
+    EXPECT_FALSE(_trace.isOpen());
+
+    std::string pid = std::to_string(getpid());
+    EXPECT_EQ(contents(), "[\n"
+        "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + pid +
+        ",\"tid\":0,\"args\":{\"name\":\"/dev/ttyS0\"}},\n"
+        "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid +
+        ",\"tid\":2,\"args\":{\"name\":\"ADDR 2\"}},\n"
+        "{\"name\":\"write\",\"cat\":\"MEASURE\",\"ph\":\"X\",\"ts\":1000,"
+        "\"dur\":250,\"pid\":" + pid + ",\"tid\":2},\n"
+        "{\"name\":\"read\",\"cat\":\"MEASURE\",\"ph\":\"X\",\"ts\":5000,"
+        "\"dur\":0,\"pid\":" + pid + ",\"tid\":2},\n");
+
+    // Another process appends to the same array
+    ASSERT_TRUE(_trace.open(_path.c_str(), "/dev/ttyS1"));
+    _trace.close();
+    std::string text = contents();
+    EXPECT_EQ(std::count(text.begin(), text.end(), '['), 1);
+    EXPECT_NE(text.find("\"name\":\"/dev/ttyS1\""), std::string::npos);
+}
+
+/********************************************************************
+ ** Test that a full ring drops events rather than blocking
+ ********************************************************************
+*/
+TEST_F(TraceTest, Full)
+{
+    ASSERT_TRUE(_trace.open(_path.c_str(), "/dev/ttyS0"));
+    {
+        // The flush thread can't write while the lock is held
+        std::lock_guard<std::mutex> hold(_trace._mutex);
+        for (int j = 0; j < ipmTrace::NEVENTS + 4; j++)
+        {
+            _trace.add("wait", "STATUS", 0, j, j + 1);
+        }
+        EXPECT_EQ(_trace.dropped(), 5);  // and the process name
+    }
+    _trace.close();
+    std::string text = contents();
+    EXPECT_EQ(std::count(text.begin(), text.end(), '\n'),
+        ipmTrace::NEVENTS + 1);
+}
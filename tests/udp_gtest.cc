@@ -0,0 +1,105 @@
+/********************************************************************
+ ** 2024, Copyright University Corporation for Atmospheric Research
+ ********************************************************************
+*/
+#include <gtest/gtest.h>
+// sytem header includes must be before private public def
+#define private public  // so can test private functions
+#include "../src/udp.cc"
+
+class UdpTest : public ::testing::Test {
+public:
+    int _rsock;     // local socket standing in for nidas
+    int _port;
+private:
+    ipmUdp _udp;
+
+    void SetUp()
+    {
+        struct sockaddr_in addr;
+        socklen_t alen = sizeof(addr);
+        _rsock = socket(AF_INET, SOCK_DGRAM, 0);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+        addr.sin_port = 0;  // any free port
+        bind(_rsock, (struct sockaddr *)&addr, sizeof(addr));
+        getsockname(_rsock, (struct sockaddr *)&addr, &alen);
+        _port = ntohs(addr.sin_port);
+
+        int ports[2] = {_port, _port};
+        _udp.open("127.0.0.1", ports, 2);
+    }
+
+    void TearDown()
+    {
+        _udp.close();
+        close(_rsock);
+    }
+};
+
+/********************************************************************
+ ** Test sending a cycle's packets in one batch
+ ********************************************************************
+*/
+TEST_F(UdpTest, Flush)
+{
+    _udp.enqueue("MEASURE,1\r\n", 11, 0);
+    _udp.enqueue("STATUS,2\r\n", 10, 1);
+    _udp.enqueue("RECORD,3\r\n", 10, 0);
+    EXPECT_EQ(_udp.depth(), 3);
+
+    EXPECT_EQ(_udp.flush(), 3);
+    EXPECT_EQ(_udp.depth(), 0);
+    EXPECT_EQ(_udp.sent(), 3);
+
+    char buf[100];
+    int n = recv(_rsock, buf, sizeof(buf), 0);
+    EXPECT_EQ(std::string(buf, n), "MEASURE,1\r\n");
+    n = recv(_rsock, buf, sizeof(buf), 0);
+    EXPECT_EQ(std::string(buf, n), "STATUS,2\r\n");
+    n = recv(_rsock, buf, sizeof(buf), 0);
+    EXPECT_EQ(std::string(buf, n), "RECORD,3\r\n");
+}
+
+/********************************************************************
+ ** Test dropping the oldest packets when the queue is full
+ ********************************************************************
+*/
+TEST_F(UdpTest, DropOldest)
+{
+    char pkt[20];
+    for (int k = 0; k < ipmUdp::QUEUELEN + 2; k++)
+    {
+        int len = snprintf(pkt, sizeof(pkt), "MEASURE,%d\r\n", k);
+        _udp.enqueue(pkt, len, 0);
+    }
+    EXPECT_EQ(_udp.depth(), ipmUdp::QUEUELEN);
+    EXPECT_EQ(_udp.dropped(), 2);
+
+    // Oldest remaining packet is the third one queued, and the wrapped
+    // ring is sent in order
+    EXPECT_EQ(_udp.flush(), ipmUdp::QUEUELEN);
+    char buf[100];
+    int n = recv(_rsock, buf, sizeof(buf), 0);
+    EXPECT_EQ(std::string(buf, n), "MEASURE,2\r\n");
+    for (int k = 1; k < ipmUdp::QUEUELEN; k++)
+    {
+        n = recv(_rsock, buf, sizeof(buf), 0);
+    }
+    EXPECT_EQ(std::string(buf, n), "MEASURE,65\r\n");
+}
+
+/********************************************************************
+ ** Test that a closed socket doesn't block or exit
+ ********************************************************************
+*/
+TEST_F(UdpTest, FlushClosed)
+{
+    _udp.close();
+    _udp.enqueue("MEASURE,1\r\n", 11, 0);
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(_udp.flush(), 0);
+    testing::internal::GetCapturedStdout();
+    EXPECT_EQ(_udp.depth(), 1);
+}